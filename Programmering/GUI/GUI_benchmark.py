@@ -136,57 +136,54 @@ display.pack(padx=20, pady=10)
 display.insert(END, "-- g")
 display.config(state=DISABLED)
 
-def update_display(grams: float):
+def show_text(text: str):
     display.config(state=NORMAL)
     display.delete("1.0", END)
-    display.insert(END, f"{grams:.1f} g")
+    display.insert(END, text)
     display.config(state=DISABLED)
 
+def update_display(grams: float):
+    show_text(f"{grams:.1f} g")
+
 def do_tare():
-    for s in sensors:
-        s.tare()
-    print("[TARE] all sensors")
+    hx.Op8.on_reply(hx.tare_all_async(), root, lambda resp: print(f"[TARE] all sensors: {resp or 'no reply'}"))
 
 def do_calibrate():
     known = simpledialog.askfloat("Calibrate", "Weight of object on scale (grams):", minvalue=1, parent=root)
     if known is None:
         return
-    for s in sensors:
-        s.calibrate(known)
-    print(f"[CALIBRATE] known={known}g")
-
-Button(root, text="Tare",      command=do_tare).pack()
-Button(root, text="Calibrate", command=do_calibrate).pack()
-
-use_median = False
-
-mode_btn = Button(root, text="Mode: Live", width=14)
-mode_btn.pack(pady=4)
-
-def toggle_mode():
-    global use_median
-    use_median = not use_median
-    mode_btn.config(text="Mode: Median" if use_median else "Mode: Live")
+    futs = [s.calibrate_async(known) for s in sensors]
+    hx.Op8.on_reply(futs[-1], root,
+                    lambda _: print(f"[CALIBRATE] known={known}g: {[f.result() or 'no reply' for f in futs]}"))
 
-mode_btn.config(command=toggle_mode)
+tare_btn = Button(root, text="Tare", command=do_tare)
+tare_btn.pack()
+cal_btn = Button(root, text="Calibrate", command=do_calibrate)
+cal_btn.pack()
 
 def poll_hx711():
-    try:
-        if use_median:
-            grams = (sensors[0].read_median() - sensors[0].hx_offset) / sensors[0].scale_factor
+    # The board filters, the reply comes back in the Tk thread
+    def show(resp):
+        grams = hx.parse_weights(resp)[0]
+        if grams is None:
+            print("[HX711] no reading")
         else:
-            grams = sensors[0].read_grams()
-        update_display(grams)
-    except Exception as e:
-        print(f"[HX711] {e}")
-    interval = 500 if use_median else 200
-    root.after(interval, poll_hx711)
+            update_display(grams)
+        root.after(200, poll_hx711)
+    hx.Op8.on_reply(hx.weights_async(), root, show)
 
+# Its own process: gets the link only while main.py does not hold it.
+# Opened from main.py's button it never does, so say so rather than polling.
 reset_all()
-poll_hx711()
+if hx.connect():
+    poll_hx711()
+else:
+    display.config(font=("Segoe UI", 12), width=28)
+    show_text("link held by main.py")
+    tare_btn.config(state=DISABLED)
+    cal_btn.config(state=DISABLED)
+    print("[HX711] serial link held by another process (main.py), weights off")
 root.mainloop()
 
-for s in sensors:
-    s.close()
-hx.sck.close()
+hx.close()
 i2c.bus.close()
@@ -1,44 +1,242 @@
 #include "adc.h"
 #include <avr/io.h>
-#include <stdint.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "prof.h"
+#include "sched.h"
 
-#define F_CPU 4000000UL
-#include <util/delay.h>
+//16 MHz / 16 = 1 MHz ADC clock, ~26 us per conversion with SAMPCTRL 10
+typedef struct {
+    uint8_t muxpos;
+    uint8_t refsel;
+    uint8_t sampctrl;
+} adc_channel_t;
 
-void adc0_init_tmp_freerun(void)
-{
-    VREF.ADC0REF = VREF_REFSEL_2V048_gc;   // internal 2.048 V reference
-    _delay_us(50);                          // settle time
+//Scan order, channels sharing a reference must be next to each other
+static const adc_channel_t adc_channels[ADC_CH_COUNT] = {
+    [ADC_CH_POT]   = { ADC_MUXPOS_AIN4_gc,       VREF_REFSEL_VDD_gc,   10 },
+    [ADC_CH_TMP]   = { ADC_MUXPOS_AIN5_gc,       VREF_REFSEL_2V048_gc, 10 },
+    [ADC_CH_ITEMP] = { ADC_MUXPOS_TEMPSENSE_gc,  VREF_REFSEL_2V048_gc, 32 },   //>= 28 us sampling
+};
 
-    ADC0.CTRLC   = ADC_PRESC_DIV16_gc;     // 4 MHz / 16 = 250 kHz
-    ADC0.SAMPCTRL = 10;
+//Oversampling per channel, changed at runtime with adc_scan_set_oversampling()
+typedef struct {
+    uint8_t samplenum;          //ADC_SAMPNUM_x_gc
+    uint8_t shift;              //right shift of the full sum
+} adc_ovs_t;
 
-    ADC0.MUXPOS   = ADC_MUXPOS_AIN5_gc;    // external TMP on AIN5
-    ADC0.CTRLA    = ADC_ENABLE_bm | ADC_FREERUN_bm;
-    ADC0.COMMAND  = ADC_STCONV_bm;         // start free-run
+static adc_ovs_t adc_ovs[ADC_CH_COUNT] = {
+    [ADC_CH_POT]   = { ADC_SAMPNUM_ACC16_gc, 2 },  //14 bit, ~0.5 ms per reading
+    [ADC_CH_TMP]   = { ADC_SAMPNUM_ACC16_gc, 2 },  //14 bit
+    [ADC_CH_ITEMP] = { ADC_SAMPNUM_ACC4_gc,  2 },  //12 bit like adc_temp_init() in analog.c
+};
+
+//Window compare per channel, lo/hi in the channel's result units
+typedef struct {
+    uint16_t lo;
+    uint16_t hi;
+    uint8_t  enabled;
+    uint8_t  outside;           //state at the last conversion
+} adc_watch_t;
+
+static adc_watch_t adc_watch[ADC_CH_COUNT];
+static volatile uint8_t adc_events = 0;             //bit per channel, transition not yet reported
+static volatile uint16_t adc_event_value[ADC_CH_COUNT];
+
+static volatile uint16_t adc_shadow[ADC_CH_COUNT];
+static volatile uint16_t adc_scans = 0;
+static uint8_t adc_ch = 0;
+static uint8_t adc_event_task;
+static uint8_t adc_ref = 0xFF;
+static uint8_t adc_discard = 0;
+
+static uint16_t t_offset;
+static uint16_t t_slope;
+
+//Shift from RES to the channel result, the ADC already dropped
+//samplenum - 4 LSBs itself when the sum overflowed 16 bits
+static uint8_t adc_res_shift(uint8_t ch){
+    uint8_t n = adc_ovs[ch].samplenum;
+    return adc_ovs[ch].shift - (n > 4 ? n - 4 : 0);
 }
 
-void adc0_init_pot_ain4_vdd_freerun(void)
-{
-    // Optional: disable digital input on PD4 (AIN4) for cleaner analog reads
-#if defined(PORTD) && defined(PORT_ISC_INPUT_DISABLE_gc)
-    PORTD.PIN4CTRL = PORT_ISC_INPUT_DISABLE_gc;
-#endif
+//Point the ADC at a channel and start one conversion
+static void adc_scan_start(uint8_t ch){
+    const adc_channel_t *c = &adc_channels[ch];
+    if(c->refsel != adc_ref){
+        VREF.ADC0REF = c->refsel;
+        adc_ref = c->refsel;
+        adc_discard = ADC_REF_DISCARD;
+    }
+    ADC0.MUXPOS = c->muxpos;
+    ADC0.SAMPCTRL = c->sampctrl;
+    ADC0.CTRLB = adc_ovs[ch].samplenum;
+    if(adc_watch[ch].enabled){
+        //compare in RES units, the hardware looks at RES before our shift
+        uint8_t rs = adc_res_shift(ch);
+        ADC0.WINLT = adc_watch[ch].lo << rs;
+        ADC0.WINHT = (adc_watch[ch].hi << rs) | ((1u << rs) - 1);
+        ADC0.CTRLE = ADC_WINCM_OUTSIDE_gc;
+    } else {
+        ADC0.CTRLE = ADC_WINCM_NONE_gc;
+    }
+    ADC0.COMMAND = ADC_STCONV_bm;
+}
+
+void adc_scan_init(uint8_t event_task){
+    adc_event_task = event_task;
+    t_offset = SIGROW.TEMPSENSE1;
+    t_slope = SIGROW.TEMPSENSE0;
 
-    VREF.ADC0REF = VREF_REFSEL_VDD_gc;     // use VDD as reference (full-scale = VDD)
-    _delay_us(50);
+    PORTD.PIN4CTRL = PORT_ISC_INPUT_DISABLE_gc;     //no digital input buffer on the analog pins
+    PORTD.PIN5CTRL = PORT_ISC_INPUT_DISABLE_gc;
 
-    ADC0.CTRLC   = ADC_PRESC_DIV16_gc;     // 4 MHz / 16 = 250 kHz
-    ADC0.SAMPCTRL = 10;
+    ADC0.CTRLC = ADC_PRESC_DIV16_gc;
+    ADC0.CTRLD = ADC_INITDLY_DLY32_gc;              //TEMPSENSE needs >= 25 us after enable
+    ADC0.INTCTRL = ADC_RESRDY_bm;
+    ADC0.CTRLA = ADC_ENABLE_bm;                     //single conversions, 12 bit, paused for standby
+
+    adc_ch = 0;
+    adc_scan_start(adc_ch);
+}
+
+ISR(ADC0_RESRDY_vect){
+    PROF_ENTER(PROF_ADC_ISR);
+    uint8_t flags = ADC0.INTFLAGS;
+    uint16_t res = ADC0.RES;                        //reading RES clears RESRDY
+    ADC0.INTFLAGS = ADC_WCMP_bm;
+    if(adc_discard){
+        adc_discard--;                              //VREF still settling, convert again
+    } else {
+        uint16_t v = res >> adc_res_shift(adc_ch);
+        adc_shadow[adc_ch] = v;
+        adc_watch_t *w = &adc_watch[adc_ch];
+        if(w->enabled){
+            uint8_t outside = (flags & ADC_WCMP_bm) ? 1 : 0;
+            if(outside != w->outside){              //edge: report it once
+                w->outside = outside;
+                adc_event_value[adc_ch] = v;
+                adc_events |= (uint8_t)(1 << adc_ch);
+                sched_wake(adc_event_task);         //reported now, not at the next poll
+            }
+        }
+        if(++adc_ch == ADC_CH_COUNT){
+            adc_ch = 0;
+            adc_scans++;
+        }
+    }
+    adc_scan_start(adc_ch);
+    PROF_EXIT(PROF_ADC_ISR);
+}
+
+void adc_scan_pause(void){
+    ADC0.CTRLA = 0;                                 //aborts the conversion in progress
+    ADC0.INTFLAGS = ADC_RESRDY_bm | ADC_WCMP_bm;
+}
+
+void adc_scan_resume(void){
+    ADC0.CTRLA = ADC_ENABLE_bm;
+    adc_scan_start(adc_ch);                         //the aborted channel again
+}
+
+uint16_t adc_scan_get(uint8_t ch){
+    uint16_t v;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){ v = adc_shadow[ch]; }
+    return v;
+}
+
+uint8_t adc_scan_bits(uint8_t ch){
+    return 12 + adc_ovs[ch].samplenum - adc_ovs[ch].shift;
+}
+
+uint16_t adc_scan_get12(uint8_t ch){
+    return adc_scan_get(ch) >> (adc_scan_bits(ch) - 12);
+}
+
+uint8_t adc_scan_set_oversampling(uint8_t ch, uint8_t samplenum, uint8_t shift){
+    if(ch >= ADC_CH_COUNT || samplenum > ADC_SAMPNUM_ACC128_gc) return 0;
+    if(shift > samplenum || 12 + samplenum - shift > ADC_BITS_MAX) return 0;
+    uint8_t old = adc_scan_bits(ch);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        adc_ovs[ch].samplenum = samplenum;
+        adc_ovs[ch].shift = shift;
+        //rescale the held value so readers never see a mix of resolutions
+        uint8_t bits = adc_scan_bits(ch);
+        if(bits > old){
+            adc_shadow[ch] <<= bits - old;
+            adc_watch[ch].lo <<= bits - old;
+            adc_watch[ch].hi = (adc_watch[ch].hi << (bits - old)) | ((1u << (bits - old)) - 1);
+        } else {
+            adc_shadow[ch] >>= old - bits;
+            adc_watch[ch].lo >>= old - bits;
+            adc_watch[ch].hi >>= old - bits;
+        }
+        //a conversion running for ch still uses the old CTRLB, redo it
+        if(ch == adc_ch && !adc_discard) adc_discard = 1;
+    }
+    return 1;
+}
+
+uint8_t adc_watch_set(uint8_t ch, uint16_t lo, uint16_t hi){
+    if(ch >= ADC_CH_COUNT || lo > hi) return 0;
+    uint16_t top = (uint16_t)((1ul << adc_scan_bits(ch)) - 1);
+    if(lo > top) return 0;
+    if(hi > top) hi = top;                          //"above lo" without knowing the resolution
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        adc_watch[ch].lo = lo;
+        adc_watch[ch].hi = hi;
+        adc_watch[ch].outside = 0;                  //already outside reports right away
+        adc_watch[ch].enabled = 1;
+        adc_events &= (uint8_t)~(1 << ch);
+        if(ch == adc_ch && !adc_discard) adc_discard = 1;  //running conversion has the old window
+    }
+    return 1;
+}
+
+uint8_t adc_watch_active(void){
+    for(uint8_t ch = 0; ch < ADC_CH_COUNT; ch++){
+        if(adc_watch[ch].enabled) return 1;
+    }
+    return 0;
+}
+
+void adc_watch_clear(uint8_t ch){
+    if(ch >= ADC_CH_COUNT) return;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        adc_watch[ch].enabled = 0;
+        adc_events &= (uint8_t)~(1 << ch);
+    }
+}
+
+uint8_t adc_watch_poll(uint8_t *ch, uint8_t *outside, uint16_t *value){
+    uint8_t found = 0;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        for(uint8_t i = 0; i < ADC_CH_COUNT && !found; i++){
+            if(adc_events & (1 << i)){
+                adc_events &= (uint8_t)~(1 << i);
+                *ch = i;
+                *outside = adc_watch[i].outside;
+                *value = adc_event_value[i];
+                found = 1;
+            }
+        }
+    }
+    return found;
+}
+
+void adc_scan_get_oversampling(uint8_t ch, uint8_t *samplenum, uint8_t *shift){
+    *samplenum = adc_ovs[ch].samplenum;
+    *shift = adc_ovs[ch].shift;
+}
 
-    ADC0.MUXPOS   = ADC_MUXPOS_AIN4_gc;    // R1 on AIN4
-    ADC0.CTRLA    = ADC_ENABLE_bm | ADC_FREERUN_bm;
-    ADC0.COMMAND  = ADC_STCONV_bm;         // start free-run
+uint16_t adc_scan_count(void){
+    uint16_t n;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){ n = adc_scans; }
+    return n;
 }
 
-uint16_t adc0_read12_wait(void)
-{
-    while(!(ADC0.INTFLAGS & ADC_RESRDY_bm)) { }
-    ADC0.INTFLAGS = ADC_RESRDY_bm;         // clear ready flag
-    return ADC0.RES;                        // 12-bit value (0..4095)
+int16_t adc_itemp_C(uint16_t adc12){
+    uint32_t k = (uint32_t)(t_offset - adc12) * t_slope;
+    k += 0x0800;                                    //rounding
+    return (int16_t)(k >> 12) - 273;
 }
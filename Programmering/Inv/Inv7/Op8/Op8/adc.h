@@ -3,11 +3,63 @@
 
 #include <stdint.h>
 
-//ADC0 for external TMP on PD5 (AIN5):
-void adc0_init_tmp_freerun(void);
+//Background ADC0 scan, driven by the RESRDY interrupt.
+//Every channel is converted in turn and the latest result is kept in a
+//shadow table, so reading a value never touches the ADC or waits.
+//Channels are ordered by reference so VREF only switches when it has to,
+//the first conversions after a switch are thrown away while it settles.
+enum {
+    ADC_CH_POT = 0,             //potentiometer PD4 (AIN4), VDD reference
+    ADC_CH_TMP,                 //TMP235 PD5 (AIN5), 2.048 V reference
+    ADC_CH_ITEMP,               //internal TEMPSENSE, 2.048 V reference
+    ADC_CH_COUNT
+};
 
-//Wait for RESRDY, clear flag, return 12-bit result
-uint16_t adc0_read12_wait(void);
+#define ADC_REF_DISCARD     2   //conversions dropped after a VREF change (~50 us)
+
+//Oversampling: the ADC accumulates 2^samplenum conversions in hardware
+//(ADC_SAMPNUM_ACC2_gc..ACC128_gc = 1..7) and the sum is shifted right by
+//shift, giving 12 + samplenum - shift result bits. Sums above 16 bits are
+//already truncated by the ADC, so shift must be at least samplenum - 4.
+//Every 4x oversampling buys one real bit (noise/dither permitting).
+#define ADC_BITS_MAX        16
+
+//Configure ADC0 and start scanning, needs interrupts enabled to run.
+//event_task is the scheduler task released by each window crossing.
+void adc_scan_init(uint8_t event_task);
+
+//Stop and restart the scan around STANDBY, with interrupts off. A running
+//scan wakes the CPU on every result. Paused, the shadow table keeps the
+//values from before, so nothing that needs fresh values or a watch should
+//let the board go to STANDBY.
+void adc_scan_pause(void);
+void adc_scan_resume(void);
+
+//Latest result of a channel at its configured resolution, 0 until the first scan finished
+uint16_t adc_scan_get(uint8_t ch);
+
+//Same, scaled to 12 bits for the conversion helpers below
+uint16_t adc_scan_get12(uint8_t ch);
+
+//Change a channel's oversampling, 0 if the combination is not valid
+uint8_t adc_scan_set_oversampling(uint8_t ch, uint8_t samplenum, uint8_t shift);
+void adc_scan_get_oversampling(uint8_t ch, uint8_t *samplenum, uint8_t *shift);
+uint8_t adc_scan_bits(uint8_t ch);
+
+//Window watch: the ADC window comparator checks every conversion of ch
+//against [lo, hi] (channel result units, follows OVS changes) and the ISR
+//latches an event on each crossing, out of the window and back in.
+//A window set while the value is already outside reports at once.
+uint8_t adc_watch_set(uint8_t ch, uint16_t lo, uint16_t hi);   //0 if not valid
+void adc_watch_clear(uint8_t ch);
+uint8_t adc_watch_active(void);     //any channel watched
+
+//Next pending crossing, lowest channel first. Only the latest crossing per
+//channel is kept, returns 0 when there is nothing to report.
+uint8_t adc_watch_poll(uint8_t *ch, uint8_t *outside, uint16_t *value);
+
+//Number of completed scans, wraps, lets a reader see if a value is new
+uint16_t adc_scan_count(void);
 
 //Convert 12-bit ADC to millivolts for 2.048 V ref
 static inline uint16_t adc_to_mV_2048(uint16_t adc12){
@@ -20,4 +72,7 @@ static inline int16_t tmp235_C_from_mV(uint16_t mv){
     return (int16_t)(((int32_t)mv - 500) / 10);
 }
 
+//Internal temperature sensor, uses the factory calibration in SIGROW
+int16_t adc_itemp_C(uint16_t adc12);
+
 #endif
@@ -3,10 +3,42 @@
 #endif
 
 #include "buzzer.h"
-#include <util/delay.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "prof.h"
 
-static volatile uint8_t buzzer_running = 0;
+#define BUZZER_TICKS_PER_MS ((F_CPU / 2u) / 1000u)     //TCB0 runs at F_CPU / 2
+#define BUZZER_REST_CCMP    (BUZZER_TICKS_PER_MS - 1u)  //silent steps tick once per ms
+
+//A queued event, everything the ISR needs is precomputed
+typedef struct {
+    uint32_t ccmp_q8;           //first step, Q8 so sweeps can move by fractions
+    int32_t  dccmp_q8;          //change per step, 0 for a plain note
+    uint32_t step_ticks;        //length of one step in TCB0 ticks, 0 = until stopped
+    uint8_t  steps;
+    uint8_t  rest;
+} buzzer_event_t;
+
+//Event being played
+typedef struct {
+    uint32_t ccmp_q8;
+    int32_t  dccmp_q8;
+    uint32_t step_ticks;
+    uint32_t ticks_left;
+    uint8_t  steps;
+    uint8_t  step;
+    uint8_t  rest;
+    uint8_t  active;
+} buzzer_play_t;
+
+//Single producer (main) / single consumer (TCB0 ISR)
+static buzzer_event_t buzzer_queue_buf[BUZZER_QUEUE_LEN];
+static volatile uint8_t buzzer_head = 0;
+static volatile uint8_t buzzer_tail = 0;
+
+static volatile buzzer_play_t buzzer_play;
+
+#define BUZZER_NEXT(i) ((uint8_t)((i) + 1u) & (BUZZER_QUEUE_LEN - 1u))
 
 //calculate CCMP for a given frequency
 static uint16_t buzzer_ccmp_from_freq(uint16_t freq_hz)
@@ -22,86 +54,175 @@ static uint16_t buzzer_ccmp_from_freq(uint16_t freq_hz)
     return (uint16_t)ccmp;
 }
 
-void buzzer_init(void)
+static void buzzer_pin_off(void)
 {
-    //PF2 as output
-    PORTF.DIRSET = PIN2_bm;
 #if BUZZER_ACTIVE_HIGH
-    PORTF.OUTCLR = PIN2_bm;   //OFF = low
+    PORTF.OUTCLR = PIN2_bm;
 #else
-    PORTF.OUTSET = PIN2_bm;   //OFF = high
+    PORTF.OUTSET = PIN2_bm;
 #endif
+}
+
+void buzzer_init(void)
+{
+    //PF2 as output
+    PORTF.DIRSET = PIN2_bm;
+    buzzer_pin_off();
 
-    //Disabled until start_tone()
+    //Disabled until something is queued
     TCB0.CTRLA  = 0;                          //disable while configuring
     TCB0.CTRLB  = TCB_CNTMODE_INT_gc;         //periodic interrupt (INT mode)
 
-    TCB0.CTRLA  = TCB_CLKSEL_DIV2_gc;         
+    TCB0.CTRLA  = TCB_CLKSEL_DIV2_gc | TCB_RUNSTDBY_bm;   //keeps playing in standby
     TCB0.INTFLAGS = TCB_CAPT_bm;              //clear pending
     TCB0.INTCTRL  = TCB_CAPT_bm;              //enable interrupt
 }
 
-//Start continuous tone at freq_hz
-void buzzer_start_tone(uint16_t freq_hz)
+uint8_t buzzer_queue_free(void)
 {
-    uint16_t ccmp = buzzer_ccmp_from_freq(freq_hz);
-    TCB0.CCMP = ccmp;
-    TCB0.CNT  = 0;
-    TCB0.INTFLAGS = TCB_CAPT_bm;
-    TCB0.CTRLA |= TCB_ENABLE_bm;              //start TCB0
-    buzzer_running = 1;
+    uint8_t used = (uint8_t)(buzzer_head - buzzer_tail) & (BUZZER_QUEUE_LEN - 1u);
+    return (BUZZER_QUEUE_LEN - 1u) - used;
 }
 
-//Stop tone
-void buzzer_stop(void)
+uint8_t buzzer_busy(void)
 {
-    TCB0.CTRLA &= ~TCB_ENABLE_bm;             //stop TCB0
-    buzzer_running = 0;
-#if BUZZER_ACTIVE_HIGH
-    PORTF.OUTCLR = PIN2_bm;                   //drive OFF
-#else
-    PORTF.OUTSET = PIN2_bm;                   //drive OFF
-#endif
+    return buzzer_play.active || buzzer_head != buzzer_tail;
 }
 
-//play a single beep at freq_hz for duration_ms
-void buzzer_beep(uint16_t freq_hz, uint16_t duration_ms)
+//Load the next event, returns 0 if the queue is empty. Interrupts off.
+static uint8_t buzzer_start_next(void)
 {
-    buzzer_start_tone(freq_hz);
-    while (duration_ms--) { _delay_ms(1); }
-    buzzer_stop();
+    uint8_t tail = buzzer_tail;
+    if (tail == buzzer_head) return 0;
+    const buzzer_event_t *ev = &buzzer_queue_buf[tail];
+
+    buzzer_play.ccmp_q8    = ev->ccmp_q8;
+    buzzer_play.dccmp_q8   = ev->dccmp_q8;
+    buzzer_play.step_ticks = ev->step_ticks;
+    buzzer_play.ticks_left = ev->step_ticks;
+    buzzer_play.steps      = ev->steps;
+    buzzer_play.step       = 0;
+    buzzer_play.rest       = ev->rest;
+    buzzer_play.active     = 1;
+    buzzer_tail = BUZZER_NEXT(tail);
+
+    if (ev->rest) buzzer_pin_off();
+    TCB0.CCMP = (uint16_t)(ev->ccmp_q8 >> 8);
+    return 1;
 }
 
-//repeat on/off pattern
-void buzzer_pattern(uint16_t freq_hz, uint8_t repeat, uint16_t on_ms, uint16_t off_ms)
+//Kick the timer if it is idle, otherwise the ISR picks the event up in turn
+static void buzzer_kick(void)
 {
-    for (uint8_t i = 0; i < repeat; i++) {
-        buzzer_start_tone(freq_hz);
-        for (uint16_t t = 0; t < on_ms; t++)  _delay_ms(1);
-        buzzer_stop();
-        if (i + 1u < repeat) {
-            for (uint16_t t = 0; t < off_ms; t++) _delay_ms(1);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (!buzzer_play.active && buzzer_start_next()) {
+            TCB0.CNT  = 0;
+            TCB0.INTFLAGS = TCB_CAPT_bm;
+            TCB0.CTRLA |= TCB_ENABLE_bm;      //start TCB0
         }
     }
 }
 
-//sweep from f_start to f_end in steps of step_ms each
-void buzzer_sweep(uint16_t f_start_hz, uint16_t f_end_hz,
-                  uint8_t steps, uint16_t step_ms)
+static uint8_t buzzer_push(uint32_t ccmp_q8, int32_t dccmp_q8, uint32_t step_ticks, uint8_t steps, uint8_t rest)
 {
-    if (steps == 0) return;
-    int32_t df = (int32_t)f_end_hz - (int32_t)f_start_hz;
-    buzzer_start_tone(f_start_hz);
-    for (uint8_t i = 1; i <= steps; i++) {
-        uint16_t f = (uint16_t)((int32_t)f_start_hz + (df * i) / steps);
-        TCB0.CCMP = buzzer_ccmp_from_freq(f);         //live pitch change
-        for (uint16_t t = 0; t < step_ms; t++) _delay_ms(1);
+    uint8_t head = buzzer_head;
+    uint8_t next = BUZZER_NEXT(head);
+    if (next == buzzer_tail) return 0;                  //full
+
+    buzzer_event_t *ev = &buzzer_queue_buf[head];
+    ev->ccmp_q8    = ccmp_q8;
+    ev->dccmp_q8   = dccmp_q8;
+    ev->step_ticks = step_ticks;
+    ev->steps      = steps;
+    ev->rest       = rest;
+    buzzer_head = next;                                 //publish after the event is complete
+    return 1;
+}
+
+uint8_t buzzer_note(uint16_t freq_hz, uint16_t duration_ms)
+{
+    if (duration_ms == 0) return 1;
+    uint32_t ticks = (uint32_t)duration_ms * BUZZER_TICKS_PER_MS;
+    uint8_t ok = (freq_hz == 0)
+        ? buzzer_push((uint32_t)BUZZER_REST_CCMP << 8, 0, ticks, 1, 1)
+        : buzzer_push((uint32_t)buzzer_ccmp_from_freq(freq_hz) << 8, 0, ticks, 1, 0);
+    buzzer_kick();
+    return ok;
+}
+
+uint8_t buzzer_sweep(uint16_t f_start_hz, uint16_t f_end_hz, uint8_t steps, uint16_t step_ms)
+{
+    if (steps == 0 || step_ms == 0) return 1;
+    uint16_t c0 = buzzer_ccmp_from_freq(f_start_hz);
+    uint16_t c1 = buzzer_ccmp_from_freq(f_end_hz);
+    int32_t dccmp_q8 = (((int32_t)c1 - (int32_t)c0) * 256) / steps;
+    //like the old blocking sweep the first step is already one step away from f_start
+    uint8_t ok = buzzer_push(((uint32_t)c0 << 8) + dccmp_q8, dccmp_q8,
+                             (uint32_t)step_ms * BUZZER_TICKS_PER_MS, steps, 0);
+    buzzer_kick();
+    return ok;
+}
+
+uint8_t buzzer_pattern(uint16_t freq_hz, uint8_t repeat, uint16_t on_ms, uint16_t off_ms)
+{
+    if (repeat == 0) return 1;
+    uint16_t need = 2u * repeat - 1u;
+    if (need > buzzer_queue_free()) return 0;
+    for (uint8_t i = 0; i < repeat; i++) {
+        buzzer_note(freq_hz, on_ms);
+        if (i + 1u < repeat) buzzer_note(0, off_ms);
     }
+    return 1;
+}
+
+//Start continuous tone at freq_hz
+void buzzer_start_tone(uint16_t freq_hz)
+{
     buzzer_stop();
+    buzzer_push((uint32_t)buzzer_ccmp_from_freq(freq_hz) << 8, 0, 0, 1, 0);
+    buzzer_kick();
+}
+
+//Stop tone and drop everything queued
+void buzzer_stop(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        TCB0.CTRLA &= ~TCB_ENABLE_bm;         //stop TCB0
+        buzzer_tail = buzzer_head;
+        buzzer_play.active = 0;
+        buzzer_pin_off();                     //drive OFF
+    }
+}
+
+void buzzer_beep(uint16_t freq_hz, uint16_t duration_ms)
+{
+    buzzer_stop();
+    buzzer_note(freq_hz, duration_ms);
 }
 
 ISR(TCB0_INT_vect)
 {
-    PORTF.OUTTGL = PIN2_bm;                  //toggling generates the tone
+    PROF_ENTER(PROF_BUZZER_ISR);
     TCB0.INTFLAGS = TCB_CAPT_bm;             //clear interrupt
+    if (!buzzer_play.rest) PORTF.OUTTGL = PIN2_bm;      //toggling generates the tone
+    if (buzzer_play.step_ticks == 0) {                  //continuous tone
+        PROF_EXIT(PROF_BUZZER_ISR);
+        return;
+    }
+
+    uint32_t period = (uint32_t)TCB0.CCMP + 1u;         //time since the last interrupt
+    if (buzzer_play.ticks_left > period) {
+        buzzer_play.ticks_left -= period;
+    } else if (++buzzer_play.step < buzzer_play.steps) {    //next sweep step
+        buzzer_play.ccmp_q8 += buzzer_play.dccmp_q8;
+        buzzer_play.ticks_left = buzzer_play.step_ticks;
+        TCB0.CCMP = (uint16_t)(buzzer_play.ccmp_q8 >> 8);
+    } else {
+        buzzer_play.active = 0;
+        if (!buzzer_start_next()) {
+            TCB0.CTRLA &= ~TCB_ENABLE_bm;    //queue empty, stop TCB0
+            buzzer_pin_off();
+        }
+    }
+    PROF_EXIT(PROF_BUZZER_ISR);
 }
@@ -8,19 +8,34 @@
 #define BUZZER_ACTIVE_HIGH 1        //set to 0 if buzzer is active-LOW
 #endif
 
+//Non-blocking tone sequencer on TCB0.
+//Notes, rests and sweeps go into a small queue and are played back by the
+//TCB0 interrupt that toggles the pin, so every call returns at once.
+//Timer values are worked out when an event is queued, the ISR never divides.
+#define BUZZER_QUEUE_LEN    16      //power of two, one slot is kept free
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void buzzer_init(void);
 
-//start/stop a continuous tone
+//start a continuous tone / stop everything and empty the queue
 void buzzer_start_tone(uint16_t freq_hz);
 void buzzer_stop(void);
 
+//Append to the queue, 0 if there is no room. freq_hz 0 is a rest.
+uint8_t buzzer_note(uint16_t freq_hz, uint16_t duration_ms);
+//steps pitch changes of step_ms each, linear in period (not in Hz), no division in the ISR
+uint8_t buzzer_sweep(uint16_t f_start_hz, uint16_t f_end_hz, uint8_t steps, uint16_t step_ms);
+//repeat on/off, queued as a whole or not at all
+uint8_t buzzer_pattern(uint16_t freq_hz, uint8_t repeat, uint16_t on_ms, uint16_t off_ms);
+
+//replace whatever is playing with a single beep
 void buzzer_beep(uint16_t freq_hz, uint16_t duration_ms);
-void buzzer_pattern(uint16_t freq_hz, uint8_t repeat, uint16_t on_ms, uint16_t off_ms);
-void buzzer_sweep(uint16_t f_start_hz, uint16_t f_end_hz, uint8_t steps, uint16_t step_ms);
+
+uint8_t buzzer_queue_free(void);
+uint8_t buzzer_busy(void);          //playing or queued
 
 #ifdef __cplusplus
 }
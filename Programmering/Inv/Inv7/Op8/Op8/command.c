@@ -0,0 +1,1337 @@
+#include "command.h"
+#include <avr/io.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "adc.h"
+#include "buzzer.h"
+#include "servo.h"
+#include "motion.h"
+#include "ik.h"
+#include "sched.h"
+#include "prof.h"
+#include "reply.h"
+#include "stream.h"
+#include "hx711.h"
+#include "led.h"
+#include "flight.h"
+
+//USART3 debug echo of every command, off unless built with COMMAND_ECHO=1.
+//The flight recorder keeps the timeline without costing the command path.
+//When on, its vfprintf is timed as PROF_FORMAT along with the reply digits,
+//so STATS shows what formatting costs per command in either build.
+#if COMMAND_ECHO
+#define echo(...)   do{ PROF_ENTER(PROF_FORMAT); printf(__VA_ARGS__); PROF_EXIT(PROF_FORMAT); }while(0)
+#else
+#define echo(...)   do{ if(0) printf(__VA_ARGS__); }while(0)     //still type checked
+#endif
+
+static uint8_t binary_mode = 0;
+static uint8_t command_task;            //runs command_poll(), woken by TX space and ADC events
+
+//Result of the ASCII command being handled, for the flight recorder
+static uint8_t ascii_result;
+
+//DUMP in progress: records left and the next one, sent by command_poll()
+static uint16_t dump_left = 0;
+static uint16_t dump_next;
+static uint8_t dump_crc;
+static uint8_t dump_pending = 0;        //announced, starts once the DUMP itself is logged
+static uint16_t dump_total;
+
+//Link benchmark burst, sent from command_poll() as TX space allows
+#define BURST_MAX_LEN   (PROTO_MAX_PAYLOAD - 2)
+static uint8_t burst_left = 0;
+static uint8_t burst_seq = 0;
+static uint8_t burst_len = 0;
+
+//Baud switch. The OK goes out at the old rate, then the link moves over and
+//the host has BAUD_CONFIRM_MS to get a PING through, else the old rate is back.
+//Both moves wait in baud_poll() for the TX ring to drain instead of blocking
+//the rx task, meanwhile RX is left alone and unsolicited output is held.
+#define BAUD_CONFIRM_MS 1000
+static uint32_t baud_pending = 0;       //switch to this once TX is idle, 0 = none
+static uint8_t baud_pending_back;       //the pending switch is the fallback
+static uint32_t baud_fallback = 0;      //0 = nothing to confirm
+static uint32_t baud_deadline;
+
+static void baud_switch(uint32_t baud){
+    if(baud == usart2_baud()) return;
+    baud_pending = baud;
+    baud_pending_back = 0;
+}
+
+static void baud_confirm(void){
+    if(baud_fallback){
+        uint32_t baud = usart2_baud();
+        baud_fallback = 0;
+        flight_log(FLIGHT_BAUD, 0, 1, &baud, 4, sched_time_us(), 0);
+        echo("BAUD: %lu confirmed\r\n", (unsigned long)usart2_baud());
+    }
+}
+
+static void baud_poll(void){
+    if(baud_pending){
+        if(!usart2_tx_idle()) return;           //the last reply still goes out at the old rate
+        uint32_t baud = baud_pending;
+        uint32_t old = usart2_baud();
+        baud_pending = 0;
+        usart2_set_baud(baud);
+        if(baud_pending_back){
+            flight_log(FLIGHT_BAUD, 0, 2, &baud, 4, sched_time_us(), 0);
+            echo("BAUD: no PING, back to %lu\r\n", (unsigned long)baud);
+        } else {
+            baud_fallback = old;
+            baud_deadline = sched_ms() + BAUD_CONFIRM_MS;
+            flight_log(FLIGHT_BAUD, 0, 0, &baud, 4, sched_time_us(), 0);
+            echo("BAUD: %lu, waiting for PING\r\n", (unsigned long)baud);
+        }
+    } else if(baud_fallback && (int32_t)(sched_ms() - baud_deadline) >= 0){
+        baud_pending = baud_fallback;
+        baud_pending_back = 1;
+        baud_fallback = 0;
+    }
+}
+
+uint8_t command_rx_held(void){
+    return baud_pending != 0;
+}
+
+static ik_config_t ik_cfg = IK_CONFIG_DEFAULT;
+
+//Servo
+static void servo_direct(const uint8_t *deg, uint8_t n){
+    motion_stop();                  //a direct position wins over a running move
+    servo_set_multi(deg, n);
+}
+
+//Start (or with queue set, append) a move of the first n channels,
+//the others hold the position they have at the start of the segment
+static uint8_t servo_move_ticks(uint16_t *target, uint8_t n, uint16_t ms, uint8_t profile, uint8_t queue){
+    for(uint8_t i = n; i < SERVO_COUNT; i++){
+        target[i] = queue ? motion_end_position(i) : servo_get(i);
+    }
+    if(queue) return motion_queue(target, ms, profile);
+    return motion_move(target, ms, profile);
+}
+
+static uint8_t servo_move(const uint8_t *deg, uint8_t n, uint16_t ms, uint8_t profile, uint8_t queue){
+    uint16_t target[SERVO_COUNT];
+    for(uint8_t i = 0; i < n; i++) target[i] = servo_angle_to_ticks(i, deg[i]);
+    return servo_move_ticks(target, n, ms, profile, queue);
+}
+
+//Cartesian target: solve IK and drive midje, skulder, albue (channels 0..2).
+//The wrist angle is solved but there is no fourth PWM channel for it yet.
+//ms == 0 sets the position directly, otherwise it queues an AUTO segment so
+//streamed waypoints chain without stopping.
+enum {
+    IK_MOVE_OK = 0,
+    IK_MOVE_UNREACHABLE,
+    IK_MOVE_RANGE,                  //solved, but a joint is outside the servo travel
+    IK_MOVE_FULL,
+};
+
+static uint8_t ik_move(int16_t x, int16_t y, int16_t z, int16_t phi, uint16_t ms){
+    int16_t joint[IK_JOINTS];
+    uint16_t target[SERVO_COUNT];
+    if(ik_solve(&ik_cfg, x, y, z, phi, 1, joint) != IK_OK) return IK_MOVE_UNREACHABLE;
+    for(uint8_t i = 0; i < SERVO_COUNT; i++){
+        int32_t cdeg = (int32_t)joint[i] + 9000;    //joint 0 = servo centre
+        if(cdeg < 0 || cdeg > 18000) return IK_MOVE_RANGE;
+        target[i] = servo_cdeg_to_ticks(i, (uint16_t)cdeg);
+    }
+    if(ms == 0){
+        motion_stop();
+        servo_write(target);
+        return IK_MOVE_OK;
+    }
+    return servo_move_ticks(target, SERVO_COUNT, ms, MOTION_AUTO, 1) ? IK_MOVE_OK : IK_MOVE_FULL;
+}
+
+//Parse "a,b,c" into out[], returns the number of values or 0 on a syntax error
+static uint8_t parse_list(const char *s, uint16_t *out, uint8_t max){
+    uint8_t n = 0;
+    for(;;){
+        char *end;
+        long v = strtol(s, &end, 10);
+        if(end == s || v < 0 || v > 0xFFFF || n == max) return 0;
+        out[n++] = (uint16_t)v;
+        if(*end == '\0') return n;
+        if(*end != ',') return 0;
+        s = end + 1;
+    }
+}
+
+//Signed version of parse_list()
+static uint8_t parse_list_signed(const char *s, int16_t *out, uint8_t max){
+    uint8_t n = 0;
+    for(;;){
+        char *end;
+        long v = strtol(s, &end, 10);
+        if(end == s || v < -32768 || v > 32767 || n == max) return 0;
+        out[n++] = (int16_t)v;
+        if(*end == '\0') return n;
+        if(*end != ',') return 0;
+        s = end + 1;
+    }
+}
+
+//Parse "ms,profile,a[,b[,c]]" as used by MOVE and SEG, returns the number of joints or 0
+static uint8_t parse_move(const char *s, uint16_t *ms, uint8_t *profile, uint8_t *deg){
+    uint16_t v[2 + SERVO_COUNT];
+    uint8_t n = parse_list(s, v, 2 + SERVO_COUNT);
+    if(n < 3 || v[1] >= MOTION_PROFILE_COUNT) return 0;
+    for(uint8_t i = 2; i < n; i++){
+        if(v[i] > 180) return 0;
+        deg[i - 2] = (uint8_t)v[i];
+    }
+    *ms = v[0];
+    *profile = (uint8_t)v[1];
+    return n - 2;
+}
+
+//Sensors, latest values from the background ADC scan
+static uint16_t read_pot(void){
+    return adc_scan_get(ADC_CH_POT);
+}
+
+static int16_t read_tmp(void){
+    return tmp235_C_from_mV(adc_to_mV_2048(adc_scan_get12(ADC_CH_TMP)));
+}
+
+static int16_t read_itmp(void){
+    return adc_itemp_C(adc_scan_get12(ADC_CH_ITEMP));
+}
+
+//Returns at once, the beep plays from the TCB0 interrupt
+static void buzz(uint16_t freq){
+    if(freq == 0){
+        buzzer_stop();
+    } else {
+        buzzer_beep(freq, 200);
+    }
+}
+
+uint8_t command_binary_mode(void){
+    return binary_mode;
+}
+
+uint8_t command_tx_held(void){
+    return (!binary_mode && (dump_left || dump_pending)) || baud_pending;
+}
+
+//The log is held for the whole transfer so the records stay put. The
+//DUMP command's own record is in when the log was full, else left out.
+static void dump_start(void){
+    if(!dump_pending) return;
+    dump_pending = 0;
+    dump_left = dump_total;
+    flight_hold(1);
+    dump_next = 0;
+    dump_crc = 0;
+    sched_wake(command_task);           //first records now, not at the next period
+    if(!dump_left){
+        if(!binary_mode) usart2_putc((char)dump_crc);
+        flight_hold(0);
+    }
+}
+
+//Count for a DUMP reply, the transfer starts after the reply
+static uint16_t dump_request(void){
+    dump_total = flight_count();
+    dump_pending = 1;
+    return dump_total;
+}
+
+//"ERR" or "FULL" and the matching PROTO_ERR_x for the flight recorder
+static void ascii_error(uint8_t err){
+    usart2_puts(err == PROTO_ERR_FULL ? "FULL\n" : "ERR\n");
+    ascii_result = err;
+}
+
+//ASCII commands
+static void ascii_dispatch(const usart_line_t *line){
+    const char *cmd = line->buf;
+
+    if(line->overflow){
+        ascii_error(PROTO_ERR_LENGTH);
+        echo("Too long: %s\r\n", cmd);
+
+    } else if(strcmp(cmd, "ADC") == 0){
+        uint16_t raw = read_pot();
+        reply_str("ADC:");
+        reply_u16(raw);
+        reply_end();
+        echo("ADC: %u\r\n", raw);
+
+    } else if(strcmp(cmd, "TMP") == 0){
+        int16_t deg = read_tmp();
+        reply_str("TMP:");
+        reply_i16(deg);
+        reply_end();
+        echo("TMP: %d C\r\n", deg);
+
+    } else if(strcmp(cmd, "ITMP") == 0){
+        int16_t deg = read_itmp();
+        reply_str("ITMP:");
+        reply_i16(deg);
+        reply_end();
+        echo("ITMP: %d C\r\n", deg);
+
+    } else if(strncmp(cmd, "OVS:", 4) == 0){
+        //ch or ch,samplenum,shift
+        uint16_t v[3];
+        uint8_t n = parse_list(cmd + 4, v, 3);
+        uint8_t ok = (n == 1 && v[0] < ADC_CH_COUNT) ||
+                     (n == 3 && v[1] <= 0xFF && v[2] <= 0xFF &&
+                      adc_scan_set_oversampling((uint8_t)v[0], (uint8_t)v[1], (uint8_t)v[2]));
+        if(ok){
+            uint8_t samplenum, shift;
+            adc_scan_get_oversampling((uint8_t)v[0], &samplenum, &shift);
+            reply_str("OVS:");
+            reply_u16(v[0]);
+            reply_char(',');
+            reply_u16(samplenum);
+            reply_char(',');
+            reply_u16(shift);
+            reply_char(',');
+            reply_u16(adc_scan_bits((uint8_t)v[0]));
+            reply_end();
+            echo("OVS%u: %u,%u\r\n", v[0], samplenum, shift);
+        } else {
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad OVS: %s\r\n", cmd);
+        }
+
+    } else if(strncmp(cmd, "WATCH:", 6) == 0){
+        //ch,lo,hi starts watching, ch alone stops
+        uint16_t v[3];
+        uint8_t n = parse_list(cmd + 6, v, 3);
+        uint8_t ok = 0;
+        if(n == 1 && v[0] < ADC_CH_COUNT){
+            adc_watch_clear((uint8_t)v[0]);
+            ok = 1;
+        } else if(n == 3){
+            ok = adc_watch_set((uint8_t)v[0], v[1], v[2]);
+        }
+        if(ok){
+            usart2_puts("OK\n");
+            echo("WATCH: %s\r\n", cmd + 6);
+        } else {
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad WATCH: %s\r\n", cmd);
+        }
+
+    } else if(strcmp(cmd, "LED") == 0){
+        reply_str("LED:");
+        for(uint8_t i = 0; i < LED_COUNT; i++){
+            if(i) reply_char(',');
+            reply_u16(led_level(i));
+        }
+        reply_end();
+
+    } else if(strncmp(cmd, "LED:", 4) == 0){
+        //n toggles, n,level sets, n,level,ms fades
+        uint16_t v[3];
+        uint8_t n = parse_list(cmd + 4, v, 3);
+        if(n == 1){
+            led_toggle((uint8_t)v[0]);
+            usart2_puts("OK\n");
+            echo("LED%u toggled\r\n", v[0]);
+        } else if(n >= 2 && v[0] < LED_COUNT && v[1] <= 255){
+            led_fade((uint8_t)v[0], (uint8_t)v[1], n == 3 ? v[2] : 0);
+            usart2_puts("OK\n");
+            echo("LED%u: %u\r\n", v[0], v[1]);
+        } else {
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad LED: %s\r\n", cmd);
+        }
+
+    } else if(strncmp(cmd, "PULSE:", 6) == 0){
+        //n,lo,hi,ms until the next LED command for n
+        uint16_t v[4];
+        if(parse_list(cmd + 6, v, 4) != 4 || v[0] >= LED_COUNT || v[1] > 255 || v[2] > 255){
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad PULSE: %s\r\n", cmd);
+        } else {
+            led_pulse((uint8_t)v[0], (uint8_t)v[1], (uint8_t)v[2], v[3]);
+            usart2_puts("OK\n");
+            echo("PULSE%u: %u..%u\r\n", v[0], v[1], v[2]);
+        }
+
+    } else if(strncmp(cmd, "SERVO:", 6) == 0){
+        uint8_t deg = (uint8_t)atoi(cmd + 6);
+        servo_direct(&deg, 1);
+        usart2_puts("OK\n");
+        echo("SERVO: %d deg\r\n", deg);
+
+    } else if(strncmp(cmd, "SERVOS:", 7) == 0){
+        uint16_t v[3];
+        uint8_t deg[3];
+        uint8_t n = parse_list(cmd + 7, v, 3);
+        for(uint8_t i = 0; i < n; i++){
+            if(v[i] > 180) n = 0;
+            deg[i] = (uint8_t)v[i];
+        }
+        if(n){
+            servo_direct(deg, n);
+            usart2_puts("OK\n");
+            echo("SERVOS: %u joints\r\n", n);
+        } else {
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad SERVOS: %s\r\n", cmd);
+        }
+
+    } else if(strncmp(cmd, "MOVE:", 5) == 0){
+        uint16_t ms;
+        uint8_t profile;
+        uint8_t deg[SERVO_COUNT];
+        uint8_t n = parse_move(cmd + 5, &ms, &profile, deg);
+        if(n && servo_move(deg, n, ms, profile, 0)){
+            usart2_puts("OK\n");
+            echo("MOVE: %u ms profile %u\r\n", ms, profile);
+        } else {
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad MOVE: %s\r\n", cmd);
+        }
+
+    } else if(strncmp(cmd, "SEG:", 4) == 0){
+        uint16_t ms;
+        uint8_t profile;
+        uint8_t deg[SERVO_COUNT];
+        uint8_t n = parse_move(cmd + 4, &ms, &profile, deg);
+        if(!n){
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad SEG: %s\r\n", cmd);
+        } else if(!servo_move(deg, n, ms, profile, 1)){
+            ascii_error(PROTO_ERR_FULL);
+            echo("SEG: queue full\r\n");
+        } else {
+            reply_str("OK:");
+            reply_u16(motion_queue_free());
+            reply_end();
+            echo("SEG: %u queued\r\n", motion_queue_count());
+        }
+
+    } else if(strcmp(cmd, "QLEN") == 0){
+        reply_str("QLEN:");
+        reply_u16(motion_queue_count());
+        reply_char(',');
+        reply_u16(motion_queue_free());
+        reply_char(',');
+        reply_u16(motion_busy());
+        reply_end();
+
+    } else if(strncmp(cmd, "XYZ:", 4) == 0){
+        static const char *const ik_reply[] = { "OK\n", "UNREACH\n", "RANGE\n", "FULL\n" };
+        int16_t v[5];
+        uint8_t n = parse_list_signed(cmd + 4, v, 5);
+        if(n < 4 || (n == 5 && v[4] < 0)){
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad XYZ: %s\r\n", cmd);
+        } else {
+            uint8_t r = ik_move(v[0], v[1], v[2], v[3], n == 5 ? (uint16_t)v[4] : 0);
+            usart2_puts(ik_reply[r]);
+            echo("XYZ: %d,%d,%d phi %d -> %s", v[0], v[1], v[2], v[3], ik_reply[r]);
+        }
+
+    } else if(strcmp(cmd, "IKCFG") == 0){
+        const int16_t v[4 + IK_JOINTS] = {
+            ik_cfg.l1, ik_cfg.l2, ik_cfg.l3, ik_cfg.z_base,
+            ik_cfg.mount[0], ik_cfg.mount[1], ik_cfg.mount[2], ik_cfg.mount[3],
+        };
+        reply_str("IKCFG:");
+        for(uint8_t i = 0; i < 4 + IK_JOINTS; i++){
+            if(i) reply_char(',');
+            reply_i16(v[i]);
+        }
+        reply_end();
+
+    } else if(strncmp(cmd, "IKCFG:", 6) == 0){
+        //l1,l2,l3,z_base[,m0[,m1[,m2[,m3]]]], missing mounts keep their value
+        int16_t v[4 + IK_JOINTS];
+        uint8_t n = parse_list_signed(cmd + 6, v, 4 + IK_JOINTS);
+        uint8_t ok = n >= 4 && v[0] > 0 && v[1] > 0 && v[2] >= 0 &&
+                     v[0] <= IK_LINK_MAX && v[1] <= IK_LINK_MAX && v[2] <= IK_LINK_MAX;
+        for(uint8_t i = 4; i < n; i++){
+            if(v[i] < -IK_MOUNT_MAX || v[i] > IK_MOUNT_MAX) ok = 0;
+        }
+        if(!ok){
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad IKCFG: %s\r\n", cmd);
+        } else {
+            ik_cfg.l1 = v[0];
+            ik_cfg.l2 = v[1];
+            ik_cfg.l3 = v[2];
+            ik_cfg.z_base = v[3];
+            for(uint8_t i = 4; i < n; i++) ik_cfg.mount[i - 4] = v[i];
+            usart2_puts("OK\n");
+            echo("IKCFG: %s\r\n", cmd + 6);
+        }
+
+    } else if(strcmp(cmd, "CAL") == 0){
+        reply_str("CAL:");
+        for(uint8_t i = 0; i < SERVO_COUNT; i++){
+            servo_cal_t c;
+            servo_cal_get(i, &c);
+            if(i) reply_char(';');
+            reply_u16(c.min);
+            reply_char(',');
+            reply_u16(c.center);
+            reply_char(',');
+            reply_u16(c.max);
+            reply_char(',');
+            reply_i16(c.dir);
+        }
+        reply_end();
+
+    } else if(strcmp(cmd, "CAL:SAVE") == 0){
+        servo_cal_save();
+        usart2_puts("OK\n");
+        echo("CAL saved\r\n");
+
+    } else if(strncmp(cmd, "CAL:", 4) == 0){
+        //ch,min,center,max,dir
+        int16_t v[5];
+        servo_cal_t c;
+        uint8_t ok = parse_list_signed(cmd + 4, v, 5) == 5 && v[0] >= 0;
+        if(ok){
+            c.min = (uint16_t)v[1];
+            c.center = (uint16_t)v[2];
+            c.max = (uint16_t)v[3];
+            c.dir = (int8_t)v[4];
+            ok = servo_cal_set((uint8_t)v[0], &c);
+        }
+        if(ok){
+            usart2_puts("OK\n");
+            echo("CAL%d: %u %u %u %d\r\n", v[0], c.min, c.center, c.max, c.dir);
+        } else {
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad CAL: %s\r\n", cmd);
+        }
+
+    } else if(strncmp(cmd, "BUZZ:", 5) == 0){
+        uint16_t freq = (uint16_t)atoi(cmd + 5);
+        buzz(freq);
+        usart2_puts("OK\n");
+        echo("BUZZ: %u Hz\r\n", freq);
+
+    } else if(strncmp(cmd, "NOTE:", 5) == 0){
+        //freq,ms appended to the buzzer queue, freq 0 = rest
+        uint16_t v[2];
+        if(parse_list(cmd + 5, v, 2) != 2){
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad NOTE: %s\r\n", cmd);
+        } else if(!buzzer_note(v[0], v[1])){
+            ascii_error(PROTO_ERR_FULL);
+        } else {
+            reply_str("OK:");
+            reply_u16(buzzer_queue_free());
+            reply_end();
+        }
+
+    } else if(strncmp(cmd, "SWEEP:", 6) == 0){
+        //f_start,f_end,steps,step_ms
+        uint16_t v[4];
+        if(parse_list(cmd + 6, v, 4) != 4 || v[2] > 255){
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad SWEEP: %s\r\n", cmd);
+        } else if(!buzzer_sweep(v[0], v[1], (uint8_t)v[2], v[3])){
+            ascii_error(PROTO_ERR_FULL);
+        } else {
+            usart2_puts("OK\n");
+            echo("SWEEP: %u -> %u Hz\r\n", v[0], v[1]);
+        }
+
+    } else if(strcmp(cmd, "TASKS") == 0){
+        reply_str("TASKS:");
+        for(uint8_t i = 0; i < sched_task_count(); i++){
+            const sched_task_t *t = sched_task(i);
+            if(i) reply_char(';');
+            reply_str(t->name);
+            reply_char(',');
+            reply_u16(t->runs);
+            reply_char(',');
+            reply_u16(t->wcet_us);
+            reply_char(',');
+            reply_u16(t->max_latency_us);
+            reply_char(',');
+            reply_u16(sched_misses(i));
+        }
+        reply_end();
+
+    } else if(strcmp(cmd, "TASKS:RESET") == 0){
+        sched_reset_stats();
+        usart2_puts("OK\n");
+
+    } else if(strcmp(cmd, "SLEEP") == 0){
+        const sched_sleep_stats_t *st = sched_sleep_stats();
+        reply_str("SLEEP:");
+        reply_u16(sched_sleep_mode());
+        reply_char(',');
+        reply_u16(sched_idle_permille());
+        reply_char(',');
+        reply_u16(st->max_wake_us);
+        reply_char(',');
+        reply_u32(st->sleeps);
+        reply_char(',');
+        reply_u32(st->standby);
+        reply_end();
+
+    } else if(strncmp(cmd, "SLEEP:", 6) == 0){
+        //0 off, 1 IDLE, 2 STANDBY
+        uint16_t v[1];
+        if(parse_list(cmd + 6, v, 1) != 1 || v[0] > 0xFF || !sched_set_sleep((uint8_t)v[0])){
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad SLEEP: %s\r\n", cmd);
+        } else {
+            usart2_puts("OK\n");
+            echo("SLEEP: mode %u\r\n", v[0]);
+        }
+
+    } else if(strcmp(cmd, "STATS") == 0){
+        //name,count,min,avg,max in cycles per probe, reply can be long, TX blocks
+        reply_str("STATS:");
+        for(uint8_t i = 0; i < PROF_COUNT; i++){
+            prof_stat_t s;
+            prof_get(i, &s);
+            if(i) reply_char(';');
+            reply_str(prof_name(i));
+            reply_char(',');
+            reply_u32(s.count);
+            reply_char(',');
+            reply_u16(s.count ? s.min : 0);
+            reply_char(',');
+            reply_u32(s.count ? s.sum / s.count : 0);
+            reply_char(',');
+            reply_u16(s.max);
+        }
+        reply_end();
+
+    } else if(strcmp(cmd, "STATS:RESET") == 0){
+        prof_reset();
+        usart2_puts("OK\n");
+
+    } else if(strncmp(cmd, "STATS:", 6) == 0){
+        //histogram of one probe, bin n = 2^n..2^(n+1)-1 cycles
+        uint16_t id;
+        if(parse_list(cmd + 6, &id, 1) != 1 || id >= PROF_COUNT){
+            ascii_error(PROTO_ERR_ARG);
+        } else {
+            prof_stat_t s;
+            prof_get((uint8_t)id, &s);
+            reply_str("HIST:");
+            reply_str(prof_name((uint8_t)id));
+            for(uint8_t b = 0; b < PROF_HIST_BINS; b++){
+                reply_char(',');
+                reply_u16(s.hist[b]);
+            }
+            reply_end();
+        }
+
+    } else if(strcmp(cmd, "PING") == 0){
+        baud_confirm();
+        usart2_puts("PONG\n");
+
+    } else if(strcmp(cmd, "BAUD") == 0){
+        reply_str("BAUD:");
+        reply_u32(usart2_baud());
+        reply_end();
+
+    } else if(strncmp(cmd, "BAUD:", 5) == 0){
+        char *end;
+        unsigned long baud = strtoul(cmd + 5, &end, 10);
+        if(end == cmd + 5 || *end != '\0' || !usart2_baud_supported(baud)){
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad BAUD: %s\r\n", cmd);
+        } else {
+            reply_str("OK:");
+            reply_u32(baud);
+            reply_end();
+            baud_switch(baud);
+        }
+
+    } else if(strncmp(cmd, "ECHO:", 5) == 0){
+        usart2_puts(cmd);
+        usart2_puts("\n");
+
+    } else if(strncmp(cmd, "BURST:", 6) == 0){
+        //n,len: n lines "B:seq,<len filler chars>" streamed after the OK
+        uint16_t v[2];
+        if(parse_list(cmd + 6, v, 2) != 2 || v[0] > 255 || v[1] > BURST_MAX_LEN){
+            ascii_error(PROTO_ERR_ARG);
+        } else {
+            usart2_puts("OK\n");
+            burst_seq = 0;
+            burst_len = (uint8_t)v[1];
+            burst_left = (uint8_t)v[0];
+            sched_wake(command_task);
+        }
+
+    } else if(strcmp(cmd, "WEIGHT") == 0){
+        //valid mask then 0.1 g per load cell
+        reply_str("WEIGHT:");
+        reply_u16(hx711_valid());
+        for(uint8_t ch = 0; ch < HX711_CH_COUNT; ch++){
+            reply_char(',');
+            reply_fixed(hx711_weight(ch), 1);
+        }
+        reply_end();
+
+    } else if(strcmp(cmd, "HXRAW") == 0){
+        //raw,filtered,reads,errors per cell, then present mask and longest read in us
+        reply_str("HXRAW:");
+        for(uint8_t ch = 0; ch < HX711_CH_COUNT; ch++){
+            const hx711_channel_t *c = hx711_channel(ch);
+            if(ch) reply_char(';');
+            reply_i32(c->raw);
+            reply_char(',');
+            reply_i32(c->filtered);
+            reply_char(',');
+            reply_u16(c->reads);
+            reply_char(',');
+            reply_u16(c->errors);
+        }
+        reply_char(';');
+        reply_u16(hx711_present());
+        reply_char(',');
+        reply_u16(hx711_read_us_max());
+        reply_end();
+
+    } else if(strcmp(cmd, "TARE") == 0 || strncmp(cmd, "TARE:", 5) == 0){
+        //all cells or TARE:ch
+        uint16_t ch;
+        uint8_t ok = 1;
+        if(cmd[4] == ':'){
+            ok = parse_list(cmd + 5, &ch, 1) == 1 && ch < HX711_CH_COUNT && hx711_tare((uint8_t)ch);
+        } else {
+            for(uint8_t i = 0; i < HX711_CH_COUNT; i++) hx711_tare(i);
+        }
+        if(ok){
+            usart2_puts("OK\n");
+        } else {
+            ascii_error(PROTO_ERR_ARG);    //bad channel or no reading yet
+        }
+
+    } else if(strncmp(cmd, "HXCAL:", 6) == 0){
+        //ch,grams with the known weight on the tared cell
+        uint16_t v[2];
+        if(parse_list(cmd + 6, v, 2) != 2 || v[0] > 0xFF || !hx711_calibrate((uint8_t)v[0], v[1])){
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad HXCAL: %s\r\n", cmd);
+        } else {
+            reply_str("OK:");
+            reply_i32(hx711_channel((uint8_t)v[0])->counts_per_g_q8);
+            reply_end();
+            echo("HXCAL%u: %u g\r\n", v[0], v[1]);
+        }
+
+    } else if(strcmp(cmd, "STREAM") == 0){
+        reply_str("STREAM:");
+        reply_u16(stream_rate());
+        reply_char(',');
+        reply_u16(stream_mask());
+        reply_char(',');
+        reply_u16(stream_skipped());
+        reply_end();
+
+    } else if(strncmp(cmd, "STREAM:", 7) == 0){
+        //rate_hz,mask (stream.h), rate 0 stops
+        uint16_t v[2];
+        uint8_t n = parse_list(cmd + 7, v, 2);
+        if(!((n == 1 && v[0] == 0) || (n == 2 && v[1] <= 0xFF)) ||
+           !stream_set(v[0], n == 2 ? (uint8_t)v[1] : 0)){
+            ascii_error(PROTO_ERR_ARG);
+            echo("Bad STREAM: %s\r\n", cmd);
+        } else {
+            reply_str("OK:");
+            reply_u16(stream_rate());
+            reply_end();
+            echo("STREAM: %u Hz mask %u\r\n", stream_rate(), stream_mask());
+        }
+
+    } else if(strcmp(cmd, "DUMP") == 0 && (dump_left || dump_pending)){
+        ascii_error(PROTO_ERR_FULL);
+
+    } else if(strcmp(cmd, "DUMP") == 0){
+        //header line, then count raw 16 byte records and a CRC-8 over them (flight.h).
+        //Anything sent meanwhile would land in the middle, the host waits for the CRC.
+        reply_str("DUMP:");
+        reply_u16(dump_request());
+        reply_char(',');
+        reply_u16(sizeof(flight_rec_t));
+        reply_char(',');
+        reply_u16(flight_boots());
+        reply_char(',');
+        reply_u16(flight_lost());
+        reply_end();
+
+    } else if(strcmp(cmd, "DUMP:CLEAR") == 0){
+        flight_clear();
+        usart2_puts("OK\n");
+
+    } else if(strcmp(cmd, "BIN") == 0){
+        usart2_puts("OK\n");
+        binary_mode = 1;
+        echo("Binary mode\r\n");
+
+    } else {
+        ascii_error(PROTO_ERR_OPCODE);
+        echo("Unknown: %s\r\n", cmd);
+    }
+}
+
+void command_ascii(const usart_line_t *line){
+    uint32_t t0 = sched_time_us();
+    ascii_result = PROTO_ERR_NONE;
+    echo("CMD: %s\r\n", line->buf);
+    ascii_dispatch(line);
+    flight_log(FLIGHT_ASCII, PROTO_OP_ASCII, ascii_result, line->buf, line->len,
+               t0, sched_time_us() - t0);
+    dump_start();
+}
+
+//Binary commands
+//A handler gets the request payload (length already checked against the
+//table) and fills reply/reply_len, it returns PROTO_ERR_NONE or an error code.
+typedef uint8_t (*bin_handler_t)(const uint8_t *arg, uint8_t len,
+                                 uint8_t *reply, uint8_t *reply_len);
+
+typedef struct {
+    bin_handler_t fn;
+    uint8_t min_len;
+    uint8_t max_len;
+} bin_command_t;
+
+static uint8_t bin_ascii(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    binary_mode = 0;                //takes effect after this reply
+    return PROTO_ERR_NONE;
+}
+
+static uint8_t bin_adc(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    proto_put_u16(reply, read_pot());
+    *reply_len = 2;
+    return PROTO_ERR_NONE;
+}
+
+static uint8_t bin_tmp(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    proto_put_u16(reply, (uint16_t)read_tmp());
+    *reply_len = 2;
+    return PROTO_ERR_NONE;
+}
+
+static uint8_t bin_itmp(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    proto_put_u16(reply, (uint16_t)read_itmp());
+    *reply_len = 2;
+    return PROTO_ERR_NONE;
+}
+
+//u8 ch [, u8 samplenum, u8 shift] -> u8 ch, samplenum, shift, bits
+static uint8_t bin_ovs(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(arg[0] >= ADC_CH_COUNT) return PROTO_ERR_ARG;
+    if(len == 2) return PROTO_ERR_LENGTH;
+    if(len == 3 && !adc_scan_set_oversampling(arg[0], arg[1], arg[2])) return PROTO_ERR_ARG;
+    reply[0] = arg[0];
+    adc_scan_get_oversampling(arg[0], &reply[1], &reply[2]);
+    reply[3] = adc_scan_bits(arg[0]);
+    *reply_len = 4;
+    return PROTO_ERR_NONE;
+}
+
+//u8 ch, u16 lo, u16 hi, or u8 ch alone to stop
+static uint8_t bin_watch(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(arg[0] >= ADC_CH_COUNT) return PROTO_ERR_ARG;
+    if(len == 1){
+        adc_watch_clear(arg[0]);
+        return PROTO_ERR_NONE;
+    }
+    if(len != 5) return PROTO_ERR_LENGTH;
+    if(!adc_watch_set(arg[0], proto_get_u16(arg + 1), proto_get_u16(arg + 3))) return PROTO_ERR_ARG;
+    return PROTO_ERR_NONE;
+}
+
+//u8 n toggles, u8 n, u8 level sets, u8 n, u8 level, u16 ms fades
+static uint8_t bin_led(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(arg[0] >= LED_COUNT) return PROTO_ERR_ARG;
+    if(len == 1){
+        led_toggle(arg[0]);
+    } else if(len == 2 || len == 4){
+        led_fade(arg[0], arg[1], len == 4 ? proto_get_u16(arg + 2) : 0);
+    } else {
+        return PROTO_ERR_LENGTH;
+    }
+    return PROTO_ERR_NONE;
+}
+
+//u8 n, u8 lo, u8 hi, u16 ms per ramp
+static uint8_t bin_led_pulse(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(!led_pulse(arg[0], arg[1], arg[2], proto_get_u16(arg + 3))) return PROTO_ERR_ARG;
+    return PROTO_ERR_NONE;
+}
+
+static uint8_t bin_servo(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(arg[0] > 180) return PROTO_ERR_ARG;
+    servo_direct(arg, 1);
+    return PROTO_ERR_NONE;
+}
+
+static uint8_t bin_buzz(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    buzz(proto_get_u16(arg));
+    return PROTO_ERR_NONE;
+}
+
+//u16 freq, u16 ms -> u8 free slots
+static uint8_t bin_note(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    uint8_t ok = buzzer_note(proto_get_u16(arg), proto_get_u16(arg + 2));
+    reply[0] = buzzer_queue_free();
+    *reply_len = 1;
+    return ok ? PROTO_ERR_NONE : PROTO_ERR_FULL;
+}
+
+//u16 f_start, u16 f_end, u8 steps, u16 step_ms
+static uint8_t bin_sweep(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(!buzzer_sweep(proto_get_u16(arg), proto_get_u16(arg + 2), arg[4], proto_get_u16(arg + 5)))
+        return PROTO_ERR_FULL;
+    return PROTO_ERR_NONE;
+}
+
+static uint8_t bin_servo_multi(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    for(uint8_t i = 0; i < len; i++){
+        if(arg[i] > 180) return PROTO_ERR_ARG;
+    }
+    servo_direct(arg, len);
+    return PROTO_ERR_NONE;
+}
+
+//u16 ms, u8 profile, u8 deg[1..3]
+static uint8_t bin_move_common(const uint8_t *arg, uint8_t len, uint8_t queue){
+    const uint8_t *deg = arg + 3;
+    uint8_t n = len - 3;
+    if(arg[2] >= MOTION_PROFILE_COUNT) return PROTO_ERR_ARG;
+    for(uint8_t i = 0; i < n; i++){
+        if(deg[i] > 180) return PROTO_ERR_ARG;
+    }
+    if(!servo_move(deg, n, proto_get_u16(arg), arg[2], queue)) return PROTO_ERR_FULL;
+    return PROTO_ERR_NONE;
+}
+
+static uint8_t bin_move(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    return bin_move_common(arg, len, 0);
+}
+
+//same payload as MOVE -> u8 free slots
+static uint8_t bin_seg(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    uint8_t err = bin_move_common(arg, len, 1);
+    reply[0] = motion_queue_free();
+    *reply_len = 1;
+    return err;
+}
+
+//-> u8 queued, u8 free, u8 busy
+static uint8_t bin_qlen(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    reply[0] = motion_queue_count();
+    reply[1] = motion_queue_free();
+    reply[2] = motion_busy();
+    *reply_len = 3;
+    return PROTO_ERR_NONE;
+}
+
+//i16 x, y, z, phi [, u16 ms]
+static uint8_t bin_ik(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(len == 9) return PROTO_ERR_LENGTH;
+    uint16_t ms = (len == 10) ? proto_get_u16(arg + 8) : 0;
+    switch(ik_move((int16_t)proto_get_u16(arg), (int16_t)proto_get_u16(arg + 2),
+                   (int16_t)proto_get_u16(arg + 4), (int16_t)proto_get_u16(arg + 6), ms)){
+    case IK_MOVE_OK:    return PROTO_ERR_NONE;
+    case IK_MOVE_FULL:  return PROTO_ERR_FULL;
+    default:            return PROTO_ERR_ARG;
+    }
+}
+
+//i16 l1, l2, l3, z_base, mount[4], empty payload reads the current config
+static uint8_t bin_ik_cfg(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    int16_t *field[4 + IK_JOINTS] = {
+        &ik_cfg.l1, &ik_cfg.l2, &ik_cfg.l3, &ik_cfg.z_base,
+        &ik_cfg.mount[0], &ik_cfg.mount[1], &ik_cfg.mount[2], &ik_cfg.mount[3],
+    };
+    if(len){
+        if(len != 2 * (4 + IK_JOINTS)) return PROTO_ERR_LENGTH;
+        int16_t l1 = (int16_t)proto_get_u16(arg);
+        int16_t l2 = (int16_t)proto_get_u16(arg + 2);
+        int16_t l3 = (int16_t)proto_get_u16(arg + 4);
+        if(l1 <= 0 || l2 <= 0 || l3 < 0 ||
+           l1 > IK_LINK_MAX || l2 > IK_LINK_MAX || l3 > IK_LINK_MAX) return PROTO_ERR_ARG;
+        for(uint8_t i = 4; i < 4 + IK_JOINTS; i++){
+            int16_t m = (int16_t)proto_get_u16(arg + 2 * i);
+            if(m < -IK_MOUNT_MAX || m > IK_MOUNT_MAX) return PROTO_ERR_ARG;
+        }
+        for(uint8_t i = 0; i < 4 + IK_JOINTS; i++) *field[i] = (int16_t)proto_get_u16(arg + 2 * i);
+    }
+    for(uint8_t i = 0; i < 4 + IK_JOINTS; i++) proto_put_u16(reply + 2 * i, (uint16_t)*field[i]);
+    *reply_len = 2 * (4 + IK_JOINTS);
+    return PROTO_ERR_NONE;
+}
+
+//u8 ch [, u16 min, center, max, i8 dir] -> u8 ch, u16 min, center, max, i8 dir
+static uint8_t bin_cal(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    servo_cal_t c;
+    if(arg[0] >= SERVO_COUNT) return PROTO_ERR_ARG;
+    if(len > 1){
+        if(len != 8) return PROTO_ERR_LENGTH;
+        c.min = proto_get_u16(arg + 1);
+        c.center = proto_get_u16(arg + 3);
+        c.max = proto_get_u16(arg + 5);
+        c.dir = (int8_t)arg[7];
+        if(!servo_cal_set(arg[0], &c)) return PROTO_ERR_ARG;
+    }
+    servo_cal_get(arg[0], &c);
+    reply[0] = arg[0];
+    proto_put_u16(reply + 1, c.min);
+    proto_put_u16(reply + 3, c.center);
+    proto_put_u16(reply + 5, c.max);
+    reply[7] = (uint8_t)c.dir;
+    *reply_len = 8;
+    return PROTO_ERR_NONE;
+}
+
+static uint8_t bin_cal_save(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    servo_cal_save();
+    return PROTO_ERR_NONE;
+}
+
+//u8 id -> u8 id, u16 runs, wcet_us, last_us, max_latency_us, misses, u16 period_ms, deadline_us
+//id 0xFF clears all statistics
+static uint8_t bin_tasks(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(arg[0] == 0xFF){
+        sched_reset_stats();
+        return PROTO_ERR_NONE;
+    }
+    if(arg[0] >= sched_task_count()) return PROTO_ERR_ARG;
+    const sched_task_t *t = sched_task(arg[0]);
+    reply[0] = arg[0];
+    proto_put_u16(reply + 1, t->runs);
+    proto_put_u16(reply + 3, t->wcet_us);
+    proto_put_u16(reply + 5, t->last_us);
+    proto_put_u16(reply + 7, t->max_latency_us);
+    proto_put_u16(reply + 9, sched_misses(arg[0]));
+    proto_put_u16(reply + 11, t->period_ms);
+    proto_put_u16(reply + 13, t->deadline_us);
+    *reply_len = 15;
+    return PROTO_ERR_NONE;
+}
+
+//u8 id -> u8 id, u32 count, u16 min, u16 avg, u16 max (cycles), id 0xFF clears all
+static uint8_t bin_stats(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    prof_stat_t s;
+    if(arg[0] == 0xFF){
+        prof_reset();
+        return PROTO_ERR_NONE;
+    }
+    if(arg[0] >= PROF_COUNT) return PROTO_ERR_ARG;
+    prof_get(arg[0], &s);
+    reply[0] = arg[0];
+    proto_put_u16(reply + 1, (uint16_t)s.count);
+    proto_put_u16(reply + 3, (uint16_t)(s.count >> 16));
+    proto_put_u16(reply + 5, s.count ? s.min : 0);
+    proto_put_u16(reply + 7, (uint16_t)(s.count ? s.sum / s.count : 0));
+    proto_put_u16(reply + 9, s.max);
+    *reply_len = 11;
+    return PROTO_ERR_NONE;
+}
+
+//u8 id -> u16 hist[16]
+static uint8_t bin_hist(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    prof_stat_t s;
+    if(arg[0] >= PROF_COUNT) return PROTO_ERR_ARG;
+    prof_get(arg[0], &s);
+    for(uint8_t b = 0; b < PROF_HIST_BINS; b++) proto_put_u16(reply + 2 * b, s.hist[b]);
+    *reply_len = 2 * PROF_HIST_BINS;
+    return PROTO_ERR_NONE;
+}
+
+//any payload, echoed back
+static uint8_t bin_ping(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    baud_confirm();
+    memcpy(reply, arg, len);
+    *reply_len = len;
+    return PROTO_ERR_NONE;
+}
+
+//u8 n, u8 len: n PROTO_EVT_BURST event frames follow the reply
+static uint8_t bin_burst(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(arg[1] > BURST_MAX_LEN) return PROTO_ERR_ARG;
+    burst_seq = 0;
+    burst_len = arg[1];
+    burst_left = arg[0];
+    sched_wake(command_task);
+    return PROTO_ERR_NONE;
+}
+
+//[u32 baud] -> u32 current baud, a new rate takes effect after the reply
+static uint8_t bin_baud(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(len == 4){
+        uint32_t baud = proto_get_u16(arg) | ((uint32_t)proto_get_u16(arg + 2) << 16);
+        if(!usart2_baud_supported(baud)) return PROTO_ERR_ARG;
+        baud_switch(baud);                  //after the reply, baud_poll() waits for it
+        proto_put_u16(reply, (uint16_t)baud);
+        proto_put_u16(reply + 2, (uint16_t)(baud >> 16));
+    } else {
+        if(len) return PROTO_ERR_LENGTH;
+        proto_put_u16(reply, (uint16_t)usart2_baud());
+        proto_put_u16(reply + 2, (uint16_t)(usart2_baud() >> 16));
+    }
+    *reply_len = 4;
+    return PROTO_ERR_NONE;
+}
+
+//u16 rate_hz, u8 mask, rate 0 stops, empty reads -> u16 rate, u8 mask, u16 skipped
+static uint8_t bin_stream(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(len == 3){
+        if(!stream_set(proto_get_u16(arg), arg[2])) return PROTO_ERR_ARG;
+    } else if(len){
+        return PROTO_ERR_LENGTH;
+    }
+    proto_put_u16(reply, stream_rate());
+    reply[2] = stream_mask();
+    proto_put_u16(reply + 3, stream_skipped());
+    *reply_len = 5;
+    return PROTO_ERR_NONE;
+}
+
+//-> u8 valid mask, i16 weight[3] in 0.1 g
+static uint8_t bin_weight(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    reply[0] = hx711_valid();
+    for(uint8_t ch = 0; ch < HX711_CH_COUNT; ch++) proto_put_u16(reply + 1 + 2 * ch, (uint16_t)hx711_weight(ch));
+    *reply_len = 1 + 2 * HX711_CH_COUNT;
+    return PROTO_ERR_NONE;
+}
+
+//[u8 ch], empty tares every cell
+static uint8_t bin_tare(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(len) return hx711_tare(arg[0]) ? PROTO_ERR_NONE : PROTO_ERR_ARG;
+    for(uint8_t ch = 0; ch < HX711_CH_COUNT; ch++) hx711_tare(ch);
+    return PROTO_ERR_NONE;
+}
+
+//u8 ch, u16 grams -> i32 counts per gram << 8
+static uint8_t bin_hx_cal(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(!hx711_calibrate(arg[0], proto_get_u16(arg + 1))) return PROTO_ERR_ARG;
+    int32_t q8 = hx711_channel(arg[0])->counts_per_g_q8;
+    proto_put_u16(reply, (uint16_t)q8);
+    proto_put_u16(reply + 2, (uint16_t)((uint32_t)q8 >> 16));
+    *reply_len = 4;
+    return PROTO_ERR_NONE;
+}
+
+//u8 ch -> i32 raw, i32 filtered, u16 reads, u16 errors, u8 present mask, u16 longest read us
+static uint8_t bin_hx_raw(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(arg[0] >= HX711_CH_COUNT) return PROTO_ERR_ARG;
+    const hx711_channel_t *c = hx711_channel(arg[0]);
+    proto_put_u16(reply, (uint16_t)c->raw);
+    proto_put_u16(reply + 2, (uint16_t)((uint32_t)c->raw >> 16));
+    proto_put_u16(reply + 4, (uint16_t)c->filtered);
+    proto_put_u16(reply + 6, (uint16_t)((uint32_t)c->filtered >> 16));
+    proto_put_u16(reply + 8, c->reads);
+    proto_put_u16(reply + 10, c->errors);
+    reply[12] = hx711_present();
+    proto_put_u16(reply + 13, hx711_read_us_max());
+    *reply_len = 15;
+    return PROTO_ERR_NONE;
+}
+
+//[u8 mode] -> u8 mode, u16 idle permille, u16 max_wake_us, u32 sleeps, u32 standby
+static uint8_t bin_sleep(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(len && !sched_set_sleep(arg[0])) return PROTO_ERR_ARG;
+    const sched_sleep_stats_t *st = sched_sleep_stats();
+    reply[0] = sched_sleep_mode();
+    proto_put_u16(reply + 1, sched_idle_permille());
+    proto_put_u16(reply + 3, st->max_wake_us);
+    proto_put_u16(reply + 5, (uint16_t)st->sleeps);
+    proto_put_u16(reply + 7, (uint16_t)(st->sleeps >> 16));
+    proto_put_u16(reply + 9, (uint16_t)st->standby);
+    proto_put_u16(reply + 11, (uint16_t)(st->standby >> 16));
+    *reply_len = 13;
+    return PROTO_ERR_NONE;
+}
+
+//[u8 0xFF clears] -> u16 count, u16 boots, u16 lost, then count PROTO_EVT_DUMP events
+static uint8_t bin_dump(const uint8_t *arg, uint8_t len, uint8_t *reply, uint8_t *reply_len){
+    if(len){
+        if(arg[0] != 0xFF) return PROTO_ERR_ARG;
+        flight_clear();
+        return PROTO_ERR_NONE;
+    }
+    if(dump_left || dump_pending) return PROTO_ERR_FULL;
+    proto_put_u16(reply, dump_request());
+    proto_put_u16(reply + 2, flight_boots());
+    proto_put_u16(reply + 4, flight_lost());
+    *reply_len = 6;
+    return PROTO_ERR_NONE;
+}
+
+static const bin_command_t bin_commands[PROTO_OP_COUNT] = {
+    [PROTO_OP_ASCII]       = { bin_ascii,       0, 0 },
+    [PROTO_OP_ADC]         = { bin_adc,         0, 0 },
+    [PROTO_OP_TMP]         = { bin_tmp,         0, 0 },
+    [PROTO_OP_LED]         = { bin_led,         1, 4 },
+    [PROTO_OP_SERVO]       = { bin_servo,       1, 1 },
+    [PROTO_OP_BUZZ]        = { bin_buzz,        2, 2 },
+    [PROTO_OP_SERVO_MULTI] = { bin_servo_multi, 1, SERVO_COUNT },
+    [PROTO_OP_MOVE]        = { bin_move,        4, 3 + SERVO_COUNT },
+    [PROTO_OP_SEG]         = { bin_seg,         4, 3 + SERVO_COUNT },
+    [PROTO_OP_QLEN]        = { bin_qlen,        0, 0 },
+    [PROTO_OP_IK]          = { bin_ik,          8, 10 },
+    [PROTO_OP_IK_CFG]      = { bin_ik_cfg,      0, 2 * (4 + IK_JOINTS) },
+    [PROTO_OP_CAL]         = { bin_cal,         1, 8 },
+    [PROTO_OP_CAL_SAVE]    = { bin_cal_save,    0, 0 },
+    [PROTO_OP_ITMP]        = { bin_itmp,        0, 0 },
+    [PROTO_OP_OVS]         = { bin_ovs,         1, 3 },
+    [PROTO_OP_WATCH]       = { bin_watch,       1, 5 },
+    [PROTO_OP_NOTE]        = { bin_note,        4, 4 },
+    [PROTO_OP_SWEEP]       = { bin_sweep,       7, 7 },
+    [PROTO_OP_TASKS]       = { bin_tasks,       1, 1 },
+    [PROTO_OP_STATS]       = { bin_stats,       1, 1 },
+    [PROTO_OP_HIST]        = { bin_hist,        1, 1 },
+    [PROTO_OP_PING]        = { bin_ping,        0, PROTO_MAX_PAYLOAD },
+    [PROTO_OP_BURST]       = { bin_burst,       2, 2 },
+    [PROTO_OP_BAUD]        = { bin_baud,        0, 4 },
+    [PROTO_OP_STREAM]      = { bin_stream,      0, 3 },
+    [PROTO_OP_WEIGHT]      = { bin_weight,      0, 0 },
+    [PROTO_OP_TARE]        = { bin_tare,        0, 1 },
+    [PROTO_OP_HX_CAL]      = { bin_hx_cal,      3, 3 },
+    [PROTO_OP_HX_RAW]      = { bin_hx_raw,      1, 1 },
+    [PROTO_OP_SLEEP]       = { bin_sleep,       0, 1 },
+    [PROTO_OP_LED_PULSE]   = { bin_led_pulse,   5, 5 },
+    [PROTO_OP_DUMP]        = { bin_dump,        0, 1 },
+};
+
+static void send_frame(uint8_t opcode, const uint8_t *payload, uint8_t len){
+    uint8_t frame[PROTO_MAX_FRAME];
+    uint8_t n = proto_encode(frame, opcode, payload, len);
+    for(uint8_t i = 0; i < n; i++) usart2_putc((char)frame[i]);
+}
+
+static void send_nak(uint8_t opcode, uint8_t error){
+    uint8_t payload[2] = { opcode, error };
+    send_frame(PROTO_OP_NAK, payload, sizeof(payload));
+}
+
+//Run one frame and send its reply or NAK, returns the PROTO_ERR_x sent
+static uint8_t bin_dispatch(const proto_rx_t *rx, uint8_t result){
+    uint8_t err;
+    if(result == PROTO_RX_ERROR){
+        err = rx->error;
+    } else if(rx->opcode >= PROTO_OP_COUNT || bin_commands[rx->opcode].fn == NULL){
+        err = PROTO_ERR_OPCODE;
+    } else if(rx->len < bin_commands[rx->opcode].min_len || rx->len > bin_commands[rx->opcode].max_len){
+        err = PROTO_ERR_LENGTH;
+    } else {
+        uint8_t reply[PROTO_MAX_PAYLOAD];
+        uint8_t reply_len = 0;
+        err = bin_commands[rx->opcode].fn(rx->payload, rx->len, reply, &reply_len);
+        if(err == PROTO_ERR_NONE){
+            send_frame(rx->opcode | PROTO_REPLY_bm, reply, reply_len);
+            return err;
+        }
+    }
+    send_nak(rx->opcode, err);
+    return err;
+}
+
+void command_binary(const proto_rx_t *rx, uint8_t result){
+    uint32_t t0 = sched_time_us();
+    uint8_t err = bin_dispatch(rx, result);
+    flight_log(result == PROTO_RX_ERROR ? FLIGHT_RX_ERROR : FLIGHT_BINARY, rx->opcode, err,
+               rx->payload, result == PROTO_RX_ERROR ? 0 : rx->len, t0, sched_time_us() - t0);
+    dump_start();
+}
+
+//No room for the next n bytes yet: run again once the DRE interrupt made it
+static uint8_t tx_room(uint8_t n){
+    if(usart2_tx_free() >= n) return 1;
+    usart2_tx_wake(command_task, n);
+    return 0;
+}
+
+//Queue as many burst messages as the TX ring takes without blocking
+static void burst_poll(void){
+    while(burst_left){
+        if(binary_mode){
+            uint8_t payload[2 + BURST_MAX_LEN];
+            if(!tx_room(burst_len + 2 + PROTO_OVERHEAD)) return;
+            payload[0] = PROTO_EVT_BURST;
+            payload[1] = burst_seq;
+            for(uint8_t i = 0; i < burst_len; i++) payload[2 + i] = (uint8_t)(burst_seq + i);
+            send_frame(PROTO_OP_EVENT, payload, burst_len + 2);
+        } else {
+            if(!tx_room(burst_len + 7)) return;
+            reply_str("B:");
+            reply_u16(burst_seq);
+            reply_char(',');
+            for(uint8_t i = 0; i < burst_len; i++) reply_char((char)('a' + (burst_seq + i) % 26));
+            reply_end();
+        }
+        burst_seq++;
+        burst_left--;
+    }
+}
+
+//Send flight records as the TX ring takes them, then release the log
+static void dump_poll(void){
+    flight_rec_t r;
+    while(dump_left){
+        if(binary_mode){
+            uint8_t payload[3 + sizeof(flight_rec_t)];
+            if(!tx_room(sizeof(payload) + PROTO_OVERHEAD)) return;
+            flight_get(dump_next, &r);
+            payload[0] = PROTO_EVT_DUMP;
+            proto_put_u16(payload + 1, dump_next);
+            memcpy(payload + 3, &r, sizeof(r));
+            send_frame(PROTO_OP_EVENT, payload, sizeof(payload));
+        } else {
+            if(!tx_room(sizeof(r) + 1)) return;
+            flight_get(dump_next, &r);
+            const uint8_t *b = (const uint8_t *)&r;
+            for(uint8_t i = 0; i < sizeof(r); i++){
+                usart2_putc((char)b[i]);
+                dump_crc = proto_crc8_update(dump_crc, b[i]);
+            }
+            if(dump_left == 1) usart2_putc((char)dump_crc);
+        }
+        dump_next++;
+        if(!--dump_left) flight_hold(0);
+    }
+}
+
+void command_init(uint8_t task){
+    command_task = task;
+}
+
+void command_poll(void){
+    uint8_t ch, outside;
+    uint16_t value;
+    baud_poll();
+    dump_poll();
+    if(command_tx_held()) return;           //events stay latched until the dump is out
+    burst_poll();
+    while(adc_watch_poll(&ch, &outside, &value)){
+        uint8_t arg[4] = { ch, outside };
+        proto_put_u16(arg + 2, value);
+        flight_log(FLIGHT_EVENT, PROTO_EVT_WATCH, PROTO_ERR_NONE, arg, sizeof(arg), sched_time_us(), 0);
+        if(binary_mode){
+            uint8_t payload[5] = { PROTO_EVT_WATCH, ch, outside };
+            proto_put_u16(payload + 3, value);
+            send_frame(PROTO_OP_EVENT, payload, sizeof(payload));
+        } else {
+            reply_str("EVT:");
+            reply_u16(ch);
+            reply_char(',');
+            reply_u16(outside);
+            reply_char(',');
+            reply_u16(value);
+            reply_end();
+        }
+    }
+}
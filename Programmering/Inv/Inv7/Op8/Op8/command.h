@@ -0,0 +1,42 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stdint.h>
+#include "usart.h"
+#include "proto.h"
+
+#ifndef COMMAND_ECHO
+#define COMMAND_ECHO    0       //1: echo every command and its result on USART3 (printf)
+#endif
+
+//Command handling for the RPi link.
+//ASCII lines ("ADC", "SERVO:90", ...) are the default, "BIN" switches the
+//link to framed binary commands (proto.h) until PROTO_OP_ASCII is received.
+
+uint8_t command_binary_mode(void);
+
+//An ASCII DUMP is sending raw records: anything else on the link would land
+//inside them, so unsolicited output (TLM, EVT, BURST) waits or is skipped.
+//Also true while a baud switch waits for TX to drain.
+uint8_t command_tx_held(void);
+
+//A baud switch is waiting for TX to drain. What the host sends meanwhile is
+//at the new rate, leave it in the RX ring, the switch throws it away.
+uint8_t command_rx_held(void);
+
+//Handle a complete ASCII line
+void command_ascii(const usart_line_t *line);
+
+//Handle the result of proto_rx_feed() (PROTO_RX_FRAME or PROTO_RX_ERROR)
+void command_binary(const proto_rx_t *rx, uint8_t result);
+
+//task is the scheduler id of the task that runs command_poll()
+void command_init(uint8_t task);
+
+//Send pending unsolicited reports (ADC watch events), BURST and DUMP output.
+//"EVT:ch,outside,value" in ASCII mode, a PROTO_OP_EVENT frame in binary mode.
+//Periodic, and also woken by an ADC window crossing and by TX space while
+//BURST or DUMP output is waiting for it.
+void command_poll(void);
+
+#endif
@@ -0,0 +1,90 @@
+#include "filter.h"
+
+//First index in sorted[0..n) whose value is >= x
+static uint8_t lower_bound(const int32_t *sorted, uint8_t n, int32_t x){
+    uint8_t lo = 0;
+    while(n){
+        uint8_t half = n / 2;
+        if(sorted[lo + half] < x){
+            lo += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return lo;
+}
+
+int32_t filter_median_update(filter_median_t *f, int32_t x){
+    uint8_t n = f->count;
+    if(n == f->len){
+        //drop the oldest sample from the sorted window
+        uint8_t i = lower_bound(f->sorted, n, f->ring[f->head]);
+        for(; i + 1 < n; i++) f->sorted[i] = f->sorted[i + 1];
+        n--;
+    }
+    //shift the larger values up and put x in the gap
+    uint8_t i = n;
+    for(; i > 0 && f->sorted[i - 1] > x; i--) f->sorted[i] = f->sorted[i - 1];
+    f->sorted[i] = x;
+
+    f->ring[f->head] = x;
+    if(++f->head == f->len) f->head = 0;
+    if(f->count < f->len) f->count++;
+    return filter_median_value(f);
+}
+
+int32_t filter_median_value(const filter_median_t *f){
+    uint8_t n = f->count;
+    if(n == 0) return 0;
+    if(n & 1) return f->sorted[n / 2];
+    int32_t a = f->sorted[n / 2 - 1], b = f->sorted[n / 2];
+    return a + (b - a) / 2;
+}
+
+void filter_median_reset(filter_median_t *f){
+    f->count = 0;
+    f->head = 0;
+}
+
+int32_t filter_boxcar_update(filter_boxcar_t *f, int32_t x){
+    if(f->count == f->len){
+        f->sum -= f->ring[f->head];
+    } else {
+        f->count++;
+    }
+    f->sum += x;
+    f->ring[f->head] = x;
+    if(++f->head == f->len) f->head = 0;
+    return filter_boxcar_value(f);
+}
+
+int32_t filter_boxcar_value(const filter_boxcar_t *f){
+    return f->count ? f->sum / f->count : 0;
+}
+
+void filter_boxcar_reset(filter_boxcar_t *f){
+    f->sum = 0;
+    f->count = 0;
+    f->head = 0;
+}
+
+int32_t filter_ema_update(filter_ema_t *f, int32_t x){
+    if(!f->primed){
+        f->acc = x * ((int32_t)1 << f->shift);
+        f->primed = 1;
+    } else {
+        //acc += x - acc * alpha, in acc's fixed point
+        f->acc += x - (f->acc >> f->shift);
+    }
+    return filter_ema_value(f);
+}
+
+int32_t filter_ema_value(const filter_ema_t *f){
+    return f->acc >> f->shift;
+}
+
+void filter_ema_reset(filter_ema_t *f){
+    f->acc = 0;
+    f->primed = 0;
+}
@@ -0,0 +1,65 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+
+//Fixed-size sample filters, updated once per sample, value ready at any time.
+//Storage belongs to the caller and is sized at compile time, like ringbuf_t:
+//
+//  static int32_t med_ring[5], med_sorted[5];
+//  static filter_median_t med = FILTER_MEDIAN_INIT(med_ring, med_sorted);
+//
+//Samples are int32, enough for 24-bit ADCs.
+
+//Running median over the last len samples. The window is kept sorted, an
+//update removes the oldest and inserts the new sample: O(len), no sort.
+typedef struct {
+    int32_t *ring;              //arrival order, oldest at head once full
+    int32_t *sorted;
+    uint8_t  len;
+    uint8_t  count;
+    uint8_t  head;
+} filter_median_t;
+
+#define FILTER_MEDIAN_INIT(ring, sorted) \
+    { (ring), (sorted), (uint8_t)(sizeof(ring) / sizeof((ring)[0])), 0, 0 }
+
+//Mean of the last len samples, kept as a running sum
+typedef struct {
+    int32_t *ring;
+    int32_t  sum;
+    uint8_t  len;
+    uint8_t  count;
+    uint8_t  head;
+} filter_boxcar_t;
+
+#define FILTER_BOXCAR_INIT(ring) \
+    { (ring), 0, (uint8_t)(sizeof(ring) / sizeof((ring)[0])), 0, 0 }
+
+//Exponential moving average, alpha = 2^-shift. acc holds the average with
+//shift fraction bits, so |sample| << shift must fit in 31 bits.
+typedef struct {
+    int32_t acc;
+    uint8_t shift;
+    uint8_t primed;             //first sample sets the average directly
+} filter_ema_t;
+
+#define FILTER_EMA_INIT(shift)  { 0, (shift), 0 }
+
+//Each returns the filtered value after adding x
+int32_t filter_median_update(filter_median_t *f, int32_t x);
+int32_t filter_boxcar_update(filter_boxcar_t *f, int32_t x);
+int32_t filter_ema_update(filter_ema_t *f, int32_t x);
+
+//Current value, 0 before the first sample. A median of an even count
+//is the mean of the two middle samples.
+int32_t filter_median_value(const filter_median_t *f);
+int32_t filter_boxcar_value(const filter_boxcar_t *f);
+int32_t filter_ema_value(const filter_ema_t *f);
+
+//Forget every sample
+void filter_median_reset(filter_median_t *f);
+void filter_boxcar_reset(filter_boxcar_t *f);
+void filter_ema_reset(filter_ema_t *f);
+
+#endif
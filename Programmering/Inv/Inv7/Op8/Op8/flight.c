@@ -0,0 +1,81 @@
+#include "flight.h"
+#include <avr/io.h>
+#include <string.h>
+
+#define FLIGHT_MAGIC    0x464C5431UL    //"FLT1"
+
+_Static_assert((FLIGHT_LEN & (FLIGHT_LEN - 1)) == 0, "FLIGHT_LEN must be a power of two");
+
+typedef struct {
+    uint32_t magic;
+    uint16_t head;              //next slot to write
+    uint16_t count;
+    uint16_t boots;
+    uint16_t lost;
+    flight_rec_t rec[FLIGHT_LEN];
+} flight_arena_t;
+
+//Not cleared by the C startup, survives every reset but power-on
+static flight_arena_t flight __attribute__((section(".noinit")));
+static uint8_t flight_held = 0;
+
+void flight_clear(void){
+    flight.head = 0;
+    flight.count = 0;
+    flight.lost = 0;
+}
+
+void flight_init(void){
+    uint8_t cause = RSTCTRL.RSTFR;
+    RSTCTRL.RSTFR = cause;                      //write one to clear
+    if((cause & RSTCTRL_PORF_bm) || flight.magic != FLIGHT_MAGIC ||
+       flight.head >= FLIGHT_LEN || flight.count > FLIGHT_LEN){
+        flight.magic = FLIGHT_MAGIC;
+        flight.boots = 0;
+        flight_clear();
+    } else {
+        flight.boots++;
+    }
+    flight_log(FLIGHT_BOOT, cause, 0, &flight.boots, 2, 0, 0);
+}
+
+void flight_log(uint8_t kind, uint8_t op, uint8_t result, const void *arg, uint8_t len,
+                uint32_t t_us, uint32_t latency_us){
+    if(flight_held){
+        flight.lost++;
+        return;
+    }
+    flight_rec_t *r = &flight.rec[flight.head];
+    r->t_us = t_us;
+    r->latency_us = latency_us > 0xFFFF ? 0xFFFF : (uint16_t)latency_us;
+    r->kind = kind;
+    r->op = op;
+    r->result = result;
+    r->len = len;
+    memset(r->arg, 0, FLIGHT_ARGS);
+    memcpy(r->arg, arg, len < FLIGHT_ARGS ? len : FLIGHT_ARGS);
+    flight.head = (flight.head + 1) & (FLIGHT_LEN - 1);
+    if(flight.count < FLIGHT_LEN) flight.count++;
+}
+
+uint16_t flight_count(void){
+    return flight.count;
+}
+
+uint8_t flight_get(uint16_t i, flight_rec_t *r){
+    if(i >= flight.count) return 0;
+    *r = flight.rec[(flight.head - flight.count + i) & (FLIGHT_LEN - 1)];
+    return 1;
+}
+
+void flight_hold(uint8_t on){
+    flight_held = on;
+}
+
+uint16_t flight_lost(void){
+    return flight.lost;
+}
+
+uint16_t flight_boots(void){
+    return flight.boots;
+}
@@ -0,0 +1,58 @@
+#ifndef FLIGHT_H
+#define FLIGHT_H
+
+#include <stdint.h>
+
+//Flight recorder: every command, its result and handling time, and the
+//unsolicited traffic go into a circular log of fixed 16 byte records in a
+//static RAM arena. The oldest record is overwritten when it is full.
+//The arena is in .noinit, so a watchdog, software or pin reset keeps the
+//log from before it and adds a FLIGHT_BOOT record; power-on starts empty.
+//"DUMP" sends it all in one transfer (command.c), Inv8/flight.py decodes it.
+//
+//Main context only, the ISRs never write here.
+
+#ifndef FLIGHT_LEN
+#define FLIGHT_LEN      128     //records, power of two, 2 KB
+#endif
+#define FLIGHT_ARGS     6       //first argument bytes kept per record
+
+//Record kinds
+enum {
+    FLIGHT_BOOT = 1,            //op = RSTCTRL.RSTFR, arg u16 boots since power-on
+    FLIGHT_ASCII,               //op PROTO_OP_ASCII, result PROTO_ERR_x, arg first chars, len line length
+    FLIGHT_BINARY,              //op opcode, result PROTO_ERR_x, arg payload
+    FLIGHT_RX_ERROR,            //op opcode as far as received, result PROTO_ERR_LENGTH/CRC
+    FLIGHT_EVENT,               //op PROTO_EVT_x sent, or not sent with result PROTO_ERR_FULL
+    FLIGHT_BAUD,                //result 0 switched, 1 confirmed, 2 fell back, arg u32 baud
+};
+
+//Little-endian on the wire, the same as in RAM
+typedef struct {
+    uint32_t t_us;              //sched_time_us() at the start
+    uint16_t latency_us;        //handling time, saturated
+    uint8_t  kind;
+    uint8_t  op;
+    uint8_t  result;
+    uint8_t  len;               //full argument length, only FLIGHT_ARGS are kept
+    uint8_t  arg[FLIGHT_ARGS];
+} flight_rec_t;
+
+_Static_assert(sizeof(flight_rec_t) == 16, "flight_rec_t is 16 bytes on the wire");
+
+void flight_init(void);
+
+void flight_log(uint8_t kind, uint8_t op, uint8_t result, const void *arg, uint8_t len,
+                uint32_t t_us, uint32_t latency_us);
+
+uint16_t flight_count(void);
+//i = 0 is the oldest, 0 if i >= flight_count()
+uint8_t flight_get(uint16_t i, flight_rec_t *r);
+void flight_clear(void);
+
+//While held, e.g. during a dump, records are counted in flight_lost() instead
+void flight_hold(uint8_t on);
+uint16_t flight_lost(void);
+uint16_t flight_boots(void);
+
+#endif
@@ -0,0 +1,179 @@
+#include "hx711.h"
+#include <avr/io.h>
+#include <avr/cpufunc.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "sched.h"
+#include "filter.h"
+
+#define HX711_DT_MASK   (((1u << HX711_CH_COUNT) - 1) << HX711_DT_PIN0)
+#define HX711_SCK_bm    (1u << HX711_SCK_PIN)
+
+//Until a cell is calibrated its weight reads in raw counts
+#define HX711_SCALE_DEFAULT (((int32_t)1 << 8) * HX711_GRAMS_SCALE)
+
+typedef struct {
+    hx711_channel_t pub;
+    filter_median_t median;
+    filter_boxcar_t avg;
+} hx711_state_t;
+
+static int32_t hx_median_ring[HX711_CH_COUNT][HX711_MEDIAN_LEN];
+static int32_t hx_median_sorted[HX711_CH_COUNT][HX711_MEDIAN_LEN];
+static int32_t hx_avg_ring[HX711_CH_COUNT][HX711_AVG_LEN];
+
+#define HX711_STATE_INIT(ch) { \
+    .median = FILTER_MEDIAN_INIT(hx_median_ring[ch], hx_median_sorted[ch]), \
+    .avg = FILTER_BOXCAR_INIT(hx_avg_ring[ch]) }
+
+_Static_assert(HX711_CH_COUNT == 3, "one HX711_STATE_INIT per channel");
+static hx711_state_t hx[HX711_CH_COUNT] = { HX711_STATE_INIT(0), HX711_STATE_INIT(1), HX711_STATE_INIT(2) };
+static uint8_t hx_task;
+static volatile uint8_t hx_present = (1 << HX711_CH_COUNT) - 1;
+static volatile uint8_t hx_busy = 0;
+static uint32_t hx_last_ms = 0;
+static uint16_t hx_us_max = 0;
+
+void hx711_init(uint8_t task){
+    hx_task = task;
+    for(uint8_t ch = 0; ch < HX711_CH_COUNT; ch++) hx[ch].pub.counts_per_g_q8 = HX711_SCALE_DEFAULT;
+
+    PORTA.OUTCLR = HX711_SCK_bm;        //low: chips run, high > 60 us powers them down
+    PORTA.DIRSET = HX711_SCK_bm;
+    PORTA.DIRCLR = HX711_DT_MASK;
+    PORTA.PIN2CTRL = PORT_ISC_FALLING_gc;
+    PORTA.PIN3CTRL = PORT_ISC_FALLING_gc;
+    PORTA.PIN4CTRL = PORT_ISC_FALLING_gc;
+    PORTA.INTFLAGS = HX711_DT_MASK;
+    hx_last_ms = sched_ms();
+}
+
+//DT low means data ready. Wait for every present channel, the first
+//sample after a missing channel comes back is taken as soon as it is ready.
+static uint8_t hx711_ready(void){
+    uint8_t low = (uint8_t)(~VPORTA.IN & HX711_DT_MASK) >> HX711_DT_PIN0;
+    return low && (low & hx_present) == hx_present;
+}
+
+ISR(PORTA_PORT_vect){
+    PORTA.INTFLAGS = HX711_DT_MASK;
+    if(!hx_busy && hx711_ready()) sched_release(hx_task);
+}
+
+//One SCK pulse, returns VPORTA.IN sampled while SCK is high.
+//High time is a few cycles with interrupts off, datasheet: 0.2 .. 50 us.
+static inline uint8_t hx711_pulse(void){
+    uint8_t in;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        VPORTA.OUT |= HX711_SCK_bm;
+        _NOP(); _NOP();                 //DT valid 0.1 us after the rising edge
+        in = VPORTA.IN;
+        VPORTA.OUT &= ~HX711_SCK_bm;
+    }
+    return in;
+}
+
+static void hx711_filter(hx711_state_t *h, int32_t raw){
+    hx711_channel_t *p = &h->pub;
+    if(p->fill == 0){
+        filter_median_reset(&h->median);
+        filter_boxcar_reset(&h->avg);
+    }
+    p->raw = raw;
+    p->filtered = filter_boxcar_update(&h->avg, filter_median_update(&h->median, raw));
+    if(p->fill < 0xFF) p->fill++;
+}
+
+static void hx711_read(void){
+    uint8_t bits[24];
+    uint8_t chans = (uint8_t)(~VPORTA.IN & HX711_DT_MASK) >> HX711_DT_PIN0;
+    uint32_t t0 = sched_time_us();
+
+    hx_busy = 1;                        //data bits toggle DT, keep the ISR out
+    for(uint8_t b = 0; b < 24; b++) bits[b] = hx711_pulse();
+    uint8_t after = 0;
+    for(uint8_t b = 24; b < HX711_GAIN_PULSES; b++) after = hx711_pulse();
+    PORTA.INTFLAGS = HX711_DT_MASK;
+    hx_busy = 0;
+
+    uint16_t us = (uint16_t)(sched_time_us() - t0);
+    if(us > hx_us_max) hx_us_max = us;
+
+    for(uint8_t ch = 0; ch < HX711_CH_COUNT; ch++){
+        if(!(chans & (1 << ch))) continue;
+        hx711_state_t *h = &hx[ch];
+        uint8_t pin = (uint8_t)(1 << (HX711_DT_PIN0 + ch));
+        int32_t raw = 0;
+        for(uint8_t b = 0; b < 24; b++) raw = (raw << 1) | ((bits[b] & pin) ? 1 : 0);
+        if(raw & 0x800000) raw -= 0x1000000;
+        h->pub.reads++;
+        //the 25th pulse forces DT high, low means we were out of step;
+        //full scale either way is clipping
+        if(!(after & pin) || raw == 0x7FFFFF || raw == -0x800000){
+            h->pub.errors++;
+            continue;
+        }
+        hx711_filter(h, raw);
+    }
+    hx_present |= chans;
+}
+
+void hx711_task(void){
+    uint32_t now = sched_ms();
+    if(hx711_ready()){
+        hx711_read();
+        hx_last_ms = now;
+    } else if((int32_t)(now - hx_last_ms) >= HX711_TIMEOUT_MS){
+        //channels that never went ready stop holding up the others
+        uint8_t high = (uint8_t)(VPORTA.IN & HX711_DT_MASK) >> HX711_DT_PIN0;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE){ hx_present &= (uint8_t)~high; }
+        for(uint8_t ch = 0; ch < HX711_CH_COUNT; ch++){
+            if(high & (1 << ch)) hx[ch].pub.fill = 0;
+        }
+        hx_last_ms = now;
+    }
+}
+
+uint8_t hx711_present(void){
+    return hx_present;
+}
+
+uint8_t hx711_valid(void){
+    uint8_t v = 0;
+    for(uint8_t ch = 0; ch < HX711_CH_COUNT; ch++){
+        if(hx[ch].pub.fill) v |= (uint8_t)(1 << ch);
+    }
+    return v & hx_present;
+}
+
+const hx711_channel_t *hx711_channel(uint8_t ch){
+    return &hx[ch].pub;
+}
+
+uint16_t hx711_read_us_max(void){
+    return hx_us_max;
+}
+
+int16_t hx711_weight(uint8_t ch){
+    const hx711_channel_t *p = &hx[ch].pub;
+    if(!(hx711_valid() & (1 << ch))) return 0;
+    int64_t w = ((int64_t)(p->filtered - p->offset) << 8) * HX711_GRAMS_SCALE / p->counts_per_g_q8;
+    if(w > INT16_MAX) return INT16_MAX;
+    if(w < INT16_MIN) return INT16_MIN;
+    return (int16_t)w;
+}
+
+uint8_t hx711_tare(uint8_t ch){
+    if(ch >= HX711_CH_COUNT || !(hx711_valid() & (1 << ch))) return 0;
+    hx[ch].pub.offset = hx[ch].pub.filtered;
+    return 1;
+}
+
+uint8_t hx711_calibrate(uint8_t ch, uint16_t grams){
+    if(ch >= HX711_CH_COUNT || grams == 0 || !(hx711_valid() & (1 << ch))) return 0;
+    hx711_channel_t *p = &hx[ch].pub;
+    int32_t q8 = (int32_t)(((int64_t)(p->filtered - p->offset) << 8) / grams);
+    if(q8 == 0) return 0;
+    p->counts_per_g_q8 = q8;
+    return 1;
+}
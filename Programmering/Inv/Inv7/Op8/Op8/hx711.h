@@ -0,0 +1,56 @@
+#ifndef HX711_H
+#define HX711_H
+
+#include <stdint.h>
+
+//Three HX711 load cell amplifiers on one shared clock.
+//DT1..DT3 on PA2..PA4, SCK on PA5. One SCK pulse clocks a bit out of all
+//three and a single VPORTA.IN read samples them together.
+//
+//A falling DT edge (data ready) releases the HX711 task once every present
+//channel is ready. The task clocks the 24 bits plus the gain pulses with
+//interrupts off only for each high pulse, so SCK never stays high long
+//enough (60 us) to put the chips into power down, whatever the ISRs do.
+//Samples go through a running median and a boxcar (filter.h) per channel.
+
+#define HX711_CH_COUNT      3
+#define HX711_DT_PIN0       2           //PA2, channel n on PA(2 + n)
+#define HX711_SCK_PIN       5           //PA5
+
+#define HX711_GAIN_PULSES   25          //25 = A gain 128, 26 = B gain 32, 27 = A gain 64
+#define HX711_MEDIAN_LEN    5           //running median window (filter.h)
+#define HX711_AVG_LEN       4           //boxcar over the medians
+#define HX711_TIMEOUT_MS    500         //not ready that long: the channel counts as missing
+
+#define HX711_GRAMS_SCALE   10          //weights are in 0.1 g
+
+typedef struct {
+    int32_t  raw;                       //last sample
+    int32_t  filtered;                  //median then moving average
+    int32_t  offset;                    //tare
+    int32_t  counts_per_g_q8;           //calibration, counts per gram << 8
+    uint16_t reads;
+    uint16_t errors;                    //DT still low after the gain pulses, or clipped
+    uint8_t  fill;                      //samples since the filters were reset, 0 = no value
+} hx711_channel_t;
+
+//task is the scheduler id of the task that runs hx711_task()
+void hx711_init(uint8_t task);
+void hx711_task(void);
+
+uint8_t hx711_present(void);            //bit n = channel n answers
+uint8_t hx711_valid(void);              //bit n = channel n has a filtered value
+const hx711_channel_t *hx711_channel(uint8_t ch);
+uint16_t hx711_read_us_max(void);       //longest clock-out, interrupts included
+
+//Filtered weight in 0.1 g, saturated to int16, 0 if the channel is not valid
+int16_t hx711_weight(uint8_t ch);
+
+//Use the filtered value as zero. Returns 0 if the channel has no value yet.
+uint8_t hx711_tare(uint8_t ch);
+
+//Known weight on the (tared) cell, in grams. Returns 0 if the channel has
+//no value yet or the reading does not move from the tare.
+uint8_t hx711_calibrate(uint8_t ch, uint16_t grams);
+
+#endif
@@ -0,0 +1,188 @@
+#include "ik.h"
+
+#define IK_CORDIC_ITER  16
+#define IK_CORDIC_K23   5094012L        //same in Q23 for the rotation start vector
+#define IK_HALF_TURN    32768L
+#define IK_QUARTER_TURN 16384
+#define IK_FRAC         8               //lengths carried as 1/256 mm, coarse steps cost degrees near full reach
+#define IK_ONE          (1L << IK_FRAC)
+
+//atan(2^-i) as binary angles
+static const int16_t ik_atan_tab[IK_CORDIC_ITER] = {
+    8192, 4836, 2555, 1297, 651, 326, 163, 81, 41, 20, 10, 5, 3, 1, 1, 0
+};
+
+static int32_t ik_abs(int32_t v){
+    return v < 0 ? -v : v;
+}
+
+//Scale (x, y) up to ~2^22 so small vectors keep their angle resolution
+static uint8_t ik_normalize(int32_t *x, int32_t *y){
+    uint8_t shift = 0;
+    int32_t m = ik_abs(*x) | ik_abs(*y);
+    if(m == 0) return 0;
+    while(m < (1L << 22)){
+        m <<= 1;
+        shift++;
+    }
+    *x *= (1L << shift);
+    *y *= (1L << shift);
+    return shift;
+}
+
+//Vectoring mode: rotate (x, y) onto the +x axis.
+//Returns the angle rotated through, *x ends up as length * CORDIC gain.
+static int32_t ik_cordic_vector(int32_t *px, int32_t *py){
+    int32_t x = *px, y = *py, z = 0;
+    if(x < 0){                              //CORDIC converges for |angle| < 90 deg only
+        x = -x;
+        y = -y;
+        z = IK_HALF_TURN;
+    }
+    for(uint8_t i = 0; i < IK_CORDIC_ITER; i++){
+        int32_t dx = y >> i, dy = x >> i;
+        if(y > 0){
+            x += dx; y -= dy; z += ik_atan_tab[i];
+        } else {
+            x -= dx; y += dy; z -= ik_atan_tab[i];
+        }
+    }
+    *px = x;
+    *py = y;
+    return z;
+}
+
+int16_t ik_atan2(int32_t y, int32_t x){
+    ik_normalize(&x, &y);
+    return (int16_t)(uint16_t)ik_cordic_vector(&x, &y);     //wraps into -180..180 deg
+}
+
+int32_t ik_hypot(int32_t x, int32_t y){
+    uint8_t shift = ik_normalize(&x, &y);
+    if(shift == 0 && x == 0 && y == 0) return 0;
+    ik_cordic_vector(&x, &y);
+    //x < 2^25 here, the gain goes in Q23 so it costs no length resolution
+    return (int32_t)(((int64_t)x * IK_CORDIC_K23 + (1L << 22)) >> 23) >> shift;
+}
+
+void ik_sincos(int16_t angle, int16_t *s, int16_t *c){
+    int32_t z = angle;
+    uint8_t flip = 0;
+    if(z > IK_QUARTER_TURN || z < -IK_QUARTER_TURN){     //rotate by 180 deg and negate after
+        z += (z > 0) ? -IK_HALF_TURN : IK_HALF_TURN;
+        flip = 1;
+    }
+    int32_t x = IK_CORDIC_K23, y = 0;       //gain is pre-compensated in the start vector
+    for(uint8_t i = 0; i < IK_CORDIC_ITER; i++){
+        int32_t dx = y >> i, dy = x >> i;
+        if(z >= 0){
+            x -= dx; y += dy; z -= ik_atan_tab[i];
+        } else {
+            x += dx; y -= dy; z += ik_atan_tab[i];
+        }
+    }
+    x = (x + 128) >> 8;                     //Q23 -> Q15
+    y = (y + 128) >> 8;
+    if(flip){
+        x = -x;
+        y = -y;
+    }
+    if(x > 32767) x = 32767;
+    if(y > 32767) y = 32767;
+    *c = (int16_t)x;
+    *s = (int16_t)y;
+}
+
+static uint16_t ik_isqrt(uint32_t v){
+    uint32_t res = 0, bit = 1UL << 30;
+    while(bit > v) bit >>= 2;
+    while(bit){
+        if(v >= res + bit){
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint16_t)res;
+}
+
+//binary angle -> centidegrees, rounded
+static int16_t ik_to_cdeg(int16_t a){
+    int32_t v = (int32_t)a * 18000;
+    return (int16_t)((v + (v >= 0 ? 16384 : -16384)) / IK_HALF_TURN);
+}
+
+//World angle minus the mount in centidegrees, in int32: both reach 180 deg,
+//the difference does not fit int16. Turned back into -180..180 deg, the
+//same servo orientation.
+static int16_t ik_joint(int16_t a, int16_t mount_deg){
+    int32_t v = (int32_t)ik_to_cdeg(a) - (int32_t)mount_deg * 100;
+    if(v > 18000) v -= 36000;
+    if(v < -18000) v += 36000;
+    return (int16_t)v;
+}
+
+//degrees -> binary angle, 32768/180 = 182.04 = 46603/256
+static int16_t ik_from_deg(int16_t deg){
+    return (int16_t)(uint16_t)(((int32_t)deg * 46603L) >> 8);
+}
+
+uint8_t ik_solve(const ik_config_t *cfg, int16_t x, int16_t y, int16_t z, int16_t phi_deg,
+                 uint8_t elbow_up, int16_t joint[IK_JOINTS]){
+    if(cfg->l1 <= 0 || cfg->l2 <= 0 || cfg->l3 < 0 ||
+       cfg->l1 > IK_LINK_MAX || cfg->l2 > IK_LINK_MAX || cfg->l3 > IK_LINK_MAX) return IK_UNREACHABLE;
+
+    //Nothing past the stretched arm, this also bounds every length below to a few m
+    int32_t dz = (int32_t)z - cfg->z_base;
+    int32_t reach = (int32_t)cfg->l1 + cfg->l2 + cfg->l3;
+    if((int64_t)x * x + (int64_t)y * y + (int64_t)dz * dz > (int64_t)reach * reach) return IK_UNREACHABLE;
+
+    int32_t l1 = (int32_t)cfg->l1 * IK_ONE;
+    int32_t l2 = (int32_t)cfg->l2 * IK_ONE;
+    int32_t l3 = (int32_t)cfg->l3 * IK_ONE;
+    int16_t phi = ik_from_deg(phi_deg);
+
+    //Base rotation and horizontal reach
+    int16_t base = (x == 0 && y == 0) ? 0 : ik_atan2(y, x);
+    int32_t r = ik_hypot((int32_t)x * IK_ONE, (int32_t)y * IK_ONE);
+
+    //Wrist point in the (r, z) plane
+    int16_t sphi, cphi;
+    ik_sincos(phi, &sphi, &cphi);
+    int32_t xw = r - (int32_t)(((int64_t)l3 * cphi) >> 15);
+    int32_t yw = dz * IK_ONE - (int32_t)(((int64_t)l3 * sphi) >> 15);
+
+    //Cosine rule for albue, cos(t2) = num / den
+    int64_t num = (int64_t)xw * xw + (int64_t)yw * yw - (int64_t)l1 * l1 - (int64_t)l2 * l2;
+    int64_t den = 2 * (int64_t)l1 * l2;
+    if(num > den || num < -den) return IK_UNREACHABLE;
+    while(den >= (1L << 22)){               //|num| <= den still holds after each halving
+        den /= 2;
+        num /= 2;
+    }
+    //tan(t2 / 2) = sqrt((1 - cos) / (1 + cos)), no division and no precision lost
+    //next to full reach, where 1 - cos is tiny
+    uint16_t h_sin = ik_isqrt((uint32_t)(den - num) << 8);
+    uint16_t h_cos = ik_isqrt((uint32_t)(den + num) << 8);
+    int16_t t2 = (int16_t)(uint16_t)(2 * (uint16_t)ik_atan2(h_sin, h_cos));
+    if(!elbow_up) t2 = (int16_t)(uint16_t)(0u - (uint16_t)t2);
+
+    //Skulder
+    int16_t s2, c2;
+    ik_sincos(t2, &s2, &c2);
+    int32_t kx = l1 + (int32_t)(((int64_t)l2 * c2) >> 15);
+    int32_t ky = (int32_t)(((int64_t)l2 * s2) >> 15);
+    int16_t t1 = (int16_t)(uint16_t)(ik_atan2(yw, xw) - ((kx | ky) ? ik_atan2(ky, kx) : 0));
+
+    //Wrist
+    int16_t t3 = (int16_t)(uint16_t)(phi - t1 - t2);
+
+    //Subtract mount offsets to convert world angles to servo commands
+    joint[0] = ik_joint(base, cfg->mount[0]);
+    joint[1] = ik_joint(t1,   cfg->mount[1]);
+    joint[2] = ik_joint(t2,   cfg->mount[2]);
+    joint[3] = ik_joint(t3,   cfg->mount[3]);
+    return IK_OK;
+}
@@ -0,0 +1,52 @@
+#ifndef IK_H
+#define IK_H
+
+#include <stdint.h>
+
+//Fixed-point inverse kinematics for the 4-joint arm (same model as solve_ik() in main.py)
+//
+//  Midje   : base = atan2(y, x)
+//  Planar IK in the vertical plane, r = horizontal reach:
+//    wrist point  xw = r - L3*cos(phi),  yw = z - Z_BASE - L3*sin(phi)
+//    albue        cos(t2) = (xw^2 + yw^2 - L1^2 - L2^2) / (2*L1*L2), taken as
+//                 t2 = 2*atan2(sqrt(1 - cos t2), sqrt(1 + cos t2))
+//    skulder      t1 = atan2(yw, xw) - atan2(L2*sin t2, L1 + L2*cos t2)
+//    wrist        t3 = phi - t1 - t2
+//
+//No floating point: angles are binary angles (32768 = 180 deg), sin/cos/atan2
+//come from a 16 step CORDIC, lengths are mm (1/256 mm inside, squares in 64 bit).
+//Links up to IK_LINK_MAX, targets past L1+L2+L3 are rejected before any of it.
+//Plain C with no AVR dependencies so it can be checked on the host.
+
+#define IK_JOINTS   4           //midje, skulder, albue, wrist
+#define IK_LINK_MAX 2000        //mm, per link
+#define IK_MOUNT_MAX 180        //deg, |mount| per joint
+
+enum {
+    IK_OK          = 0,
+    IK_UNREACHABLE = 1,         //wrist point out of the L1+L2 annulus
+};
+
+typedef struct {
+    int16_t l1;                 //skulder -> albue, mm
+    int16_t l2;                 //albue -> wrist, mm
+    int16_t l3;                 //wrist -> end effector, mm
+    int16_t z_base;             //height of the arm base above the floor, mm
+    int16_t mount[IK_JOINTS];   //servo mounting offsets, degrees (+-IK_MOUNT_MAX), subtracted from the world angles
+} ik_config_t;
+
+//main.py defaults: 15/15/5 cm links, 5 cm base, skulder mounted at 45 deg
+#define IK_CONFIG_DEFAULT { 150, 150, 50, 50, { 0, 45, 0, 0 } }
+
+//x, y, z in mm, phi = end effector pitch in degrees.
+//joint[] gets midje, skulder, albue, wrist in centidegrees, -18000..18000.
+//cfg->mount must be within +-IK_MOUNT_MAX.
+uint8_t ik_solve(const ik_config_t *cfg, int16_t x, int16_t y, int16_t z, int16_t phi_deg,
+                 uint8_t elbow_up, int16_t joint[IK_JOINTS]);
+
+//Building blocks, angles are binary (32768 = 180 deg), sin/cos in Q15
+int16_t ik_atan2(int32_t y, int32_t x);
+int32_t ik_hypot(int32_t x, int32_t y);
+void ik_sincos(int16_t angle, int16_t *s, int16_t *c);
+
+#endif
@@ -0,0 +1,243 @@
+#include "led.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "prof.h"
+#include "sched.h"
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define LED_MASK        (PIN0_bm | PIN1_bm | PIN2_bm | PIN3_bm)
+#define LED_SLICES      8
+#define LED_UNIT_TICKS  ((F_CPU / 2u) / 1000000u * LED_UNIT_US)     //TCB3 at F_CPU / 2
+
+_Static_assert((LED_UNIT_TICKS << (LED_SLICES - 1)) <= 0x10000, "LED slice too long for TCB3");
+
+//round(255 * (i / 255)^2.2)
+static const uint8_t led_gamma[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+     12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+     20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+     30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+     42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+     56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+     91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
+
+//Main context only: the commands and led_task()
+typedef struct {
+    uint16_t level_q8;          //perceptual level, Q8
+    int16_t  step_q8;           //change per period while left > 0
+    uint16_t left;              //periods to the end of the ramp, 0 = steady
+    uint16_t periods;           //ramp length, a pulse turns round with it
+    uint8_t  target;
+    uint8_t  other;             //pulse: the far end
+    uint8_t  pulse;
+} led_t;
+
+static led_t leds[LED_COUNT];
+static uint8_t led_task_id;
+
+//Shared with the ISR. It outputs led_masks[led_front], the task fills the
+//other set and the ISR changes over at the next slice 0.
+static volatile uint8_t led_masks[2][LED_SLICES];  //bit n = LED n lit in slice k
+static volatile uint8_t led_steady[2];              //set is all 0/255, stop after its slice 0
+static volatile uint8_t led_front = 0;
+static volatile uint8_t led_ready = 0;              //the other set is built
+static volatile uint8_t led_due = 0;                //periods started since led_task() ran
+static volatile uint8_t led_slice = LED_SLICES - 1;
+static volatile uint8_t led_running = 0;
+
+static void led_out(uint8_t lit){
+    PORTC.OUTSET = LED_MASK & (uint8_t)~lit;
+    PORTC.OUTCLR = lit;
+}
+
+//One period of every ramp
+static void led_advance(void){
+    for(uint8_t n = 0; n < LED_COUNT; n++){
+        led_t *l = &leds[n];
+        if(!l->left) continue;
+        l->level_q8 += (uint16_t)l->step_q8;
+        if(--l->left) continue;
+        l->level_q8 = (uint16_t)l->target << 8;     //land exactly, the step was rounded
+        if(l->pulse){
+            uint8_t t = l->target;
+            l->target = l->other;
+            l->other = t;
+            l->step_q8 = -l->step_q8;
+            l->left = l->periods;
+        }
+    }
+}
+
+//Slice masks from the levels into a set the ISR is not outputting
+static void led_build(uint8_t set){
+    uint8_t duty[LED_COUNT];
+    uint8_t steady = 1;
+    for(uint8_t n = 0; n < LED_COUNT; n++){
+        duty[n] = led_gamma[leds[n].level_q8 >> 8];
+        if(leds[n].left || (duty[n] != 0 && duty[n] != 255)) steady = 0;
+    }
+    for(uint8_t k = 0; k < LED_SLICES; k++){
+        uint8_t m = 0;
+        for(uint8_t n = 0; n < LED_COUNT; n++){
+            if(duty[n] & (1 << k)) m |= (uint8_t)(1 << n);
+        }
+        led_masks[set][k] = m;
+    }
+    led_steady[set] = steady;
+}
+
+//Start the timer if it stopped, otherwise led_task() picks the change up
+//at the next period
+static void led_kick(void){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        if(led_running){
+            led_steady[0] = 0;                      //not steady after all
+            led_steady[1] = 0;
+        } else {
+            led_build(led_front);
+            led_ready = 0;
+            led_due = 0;
+            led_slice = LED_SLICES - 1;             //next interrupt starts slice 0
+            led_running = 1;
+            TCB3.CCMP = 1;
+            TCB3.CNT = 0;
+            TCB3.INTFLAGS = TCB_CAPT_bm;
+            TCB3.CTRLA |= TCB_ENABLE_bm;
+        }
+    }
+}
+
+void led_init(uint8_t task){
+    led_task_id = task;
+    PORTC.DIRSET = LED_MASK;
+    PORTC.OUTSET = LED_MASK;                        //off
+
+    TCB3.CTRLA = 0;
+    TCB3.CTRLB = TCB_CNTMODE_INT_gc;
+    TCB3.INTFLAGS = TCB_CAPT_bm;
+    TCB3.INTCTRL = TCB_CAPT_bm;
+    TCB3.CTRLA = TCB_CLKSEL_DIV2_gc | TCB_RUNSTDBY_bm;     //enabled by led_kick()
+}
+
+//End of a slice: output the next one and set its length. Nothing else,
+//a level 0 ISR holds off every other one, RX included, until it returns.
+ISR(TCB3_INT_vect){
+    PROF_ENTER(PROF_LED_ISR);
+    TCB3.INTFLAGS = TCB_CAPT_bm;
+    uint8_t k = (uint8_t)(led_slice + 1) & (LED_SLICES - 1);
+    led_slice = k;
+    if(k == 0 && led_ready){
+        led_front ^= 1;
+        led_ready = 0;
+    }
+    uint8_t f = led_front;
+    led_out(led_masks[f][k]);
+    if(k == 0 && led_steady[f]){
+        TCB3.CTRLA &= ~TCB_ENABLE_bm;               //steady, the pins hold it
+        led_running = 0;
+    } else {
+        uint16_t top = (uint16_t)((LED_UNIT_TICKS << k) - 1);
+        TCB3.CCMP = top;
+        //a late interrupt must not let CNT run past TOP and round 0xFFFF
+        if(TCB3.CNT >= top) TCB3.CNT = top - 1;
+        if(k == LED_SLICES - 1){
+            led_due++;                              //the longest slice, 2 ms for the task
+            sched_release(led_task_id);
+        }
+    }
+    PROF_EXIT(PROF_LED_ISR);
+}
+
+void led_task(void){
+    uint8_t n;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        n = led_due;
+        led_due = 0;
+    }
+    while(n--) led_advance();                       //late runs catch up, ramps keep their length
+    if(!led_ready){                                 //else the ISR has not taken the last one yet
+        led_build(led_front ^ 1);
+        led_ready = 1;
+    }
+}
+
+void led_set(uint8_t n, uint8_t level){
+    if(n >= LED_COUNT) return;
+    led_t *l = &leds[n];
+    l->level_q8 = (uint16_t)level << 8;
+    l->left = 0;
+    l->pulse = 0;
+    led_kick();
+}
+
+//Ramp from the present level
+static void led_ramp(led_t *l, uint8_t level, uint16_t periods){
+    int32_t diff = ((int32_t)level << 8) - (int32_t)l->level_q8;
+    l->target = level;
+    l->periods = periods;
+    l->step_q8 = (int16_t)(diff / (int32_t)periods);
+    l->left = periods;
+}
+
+static uint16_t led_periods(uint16_t ms){
+    return (uint16_t)(((uint32_t)ms * 1000u) / LED_PERIOD_US);
+}
+
+uint8_t led_fade(uint8_t n, uint8_t level, uint16_t ms){
+    if(n >= LED_COUNT) return 0;
+    uint16_t periods = led_periods(ms);
+    if(periods < 2){
+        led_set(n, level);                          //a one-period step could overflow step_q8
+        return 1;
+    }
+    led_t *l = &leds[n];
+    l->pulse = 0;
+    led_ramp(l, level, periods);
+    led_kick();
+    return 1;
+}
+
+uint8_t led_pulse(uint8_t n, uint8_t lo, uint8_t hi, uint16_t ms){
+    if(n >= LED_COUNT) return 0;
+    uint16_t periods = led_periods(ms);
+    if(periods < 2) periods = 2;
+    led_t *l = &leds[n];
+    l->level_q8 = (uint16_t)lo << 8;
+    l->other = lo;
+    l->pulse = 1;
+    led_ramp(l, hi, periods);
+    led_kick();
+    return 1;
+}
+
+void led_toggle(uint8_t n){
+    n &= LED_COUNT - 1;
+    led_set(n, led_level(n) ? 0 : 255);
+}
+
+uint8_t led_level(uint8_t n){
+    if(n >= LED_COUNT) return 0;
+    return (uint8_t)(leds[n].level_q8 >> 8);
+}
+
+uint8_t led_lit(void){
+    uint8_t m = 0;
+    for(uint8_t n = 0; n < LED_COUNT; n++){
+        if(led_level(n)) m |= (uint8_t)(1 << n);
+    }
+    return m;
+}
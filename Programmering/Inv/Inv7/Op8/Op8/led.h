@@ -0,0 +1,41 @@
+#ifndef LED_H
+#define LED_H
+
+#include <stdint.h>
+
+//LED brightness on PC0..PC3, active low, with fades and pulses that run
+//by themselves. TCA0 belongs to the servos, so the LEDs are driven by
+//binary code modulation from the TCB3 interrupt instead: every PWM period
+//is 8 slices of 1, 2, 4 .. 128 units and in slice k an LED is lit if bit k
+//of its duty is set. 8 interrupts per period whatever the duty.
+//
+//Levels are perceptual 0..255, a gamma 2.2 table turns them into duty.
+//The ISR only outputs precomputed slice masks. At the start of the
+//longest slice (2 ms) it releases led_task(), which steps the fades and
+//builds the next period's masks into a second set, no division there.
+//With every LED steady at 0 or 255 the timer stops.
+
+#define LED_COUNT       4
+#define LED_UNIT_US     16                          //shortest slice
+#define LED_PERIOD_US   (255u * LED_UNIT_US)        //4080 us, ~245 Hz
+
+//task is the scheduler id of the task that runs led_task()
+void led_init(uint8_t task);
+void led_task(void);
+
+//At once, stops a fade or pulse on that LED
+void led_set(uint8_t n, uint8_t level);
+
+//Ramp from the present level to level in ms. 0 if n is not an LED.
+uint8_t led_fade(uint8_t n, uint8_t level, uint16_t ms);
+
+//Ramp lo -> hi -> lo ... with ms per ramp until the next set/fade/toggle
+uint8_t led_pulse(uint8_t n, uint8_t lo, uint8_t hi, uint16_t ms);
+
+//Off <-> full on, the old LED:n, n is taken mod LED_COUNT
+void led_toggle(uint8_t n);
+
+uint8_t led_level(uint8_t n);
+uint8_t led_lit(void);                              //bit n = LED n above 0
+
+#endif
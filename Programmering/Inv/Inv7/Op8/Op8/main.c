@@ -1,12 +1,47 @@
 /*
- * 38400 baud
+ * 38400 baud after reset (USART2_BAUD)
  *
  *   "ADC\n"     
  *   "TMP\n"       
- *   "LED:n\n"     
+ *   "ITMP\n"         internal temperature sensor
+ *   "OVS:ch[,n,shift]\n"  ADC oversampling 2^n samples >> shift, "OVS:ch,n,shift,bits"
+ *   "WATCH:ch[,lo,hi]\n"  report ADC channel leaving/entering [lo, hi] as
+ *                        "EVT:ch,outside,value", "WATCH:ch" stops
+ *   "LED:n\n"        toggle LED n, "LED:n,level[,ms]\n" brightness 0..255 with an
+ *                    optional fade, "LED" -> "LED:l0,l1,l2,l3" (led.h)
+ *   "PULSE:n,lo,hi,ms\n"  fade LED n lo -> hi -> lo ... until the next LED command
  *   "SERVO:X\n"     
+ *   "SERVOS:a,b,c\n"  all servo channels on the same PWM period
+ *   "MOVE:ms,p,a[,b[,c]]\n"  interpolated move, p = easing profile (motion.h)
+ *   "SEG:ms,p,a[,b[,c]]\n"   queue a path segment, reply "OK:free" or "FULL"
+ *   "QLEN\n"         "QLEN:queued,free,busy"
+ *   "XYZ:x,y,z,phi[,ms]\n"   Cartesian target in mm/deg, IK on the board (ik.h),
+ *                            reply OK, UNREACH, RANGE or FULL
+ *   "IKCFG[:l1,l2,l3,zb[,m0..m3]]\n"  read or set link lengths (mm, up to 2000) and mount offsets (deg, +-180)
+ *   "CAL\n"           "CAL:min,center,max,dir;..." per servo, in timer ticks
+ *   "CAL:ch,min,center,max,dir\n"  set servo calibration, "CAL:SAVE\n" stores it in EEPROM
  *   "BUZZ:X\n"      
  *   "BUZZ:0\n"        
+ *   "NOTE:f,ms\n"     queue a note (f 0 = rest), reply "OK:free" or "FULL"
+ *   "SWEEP:f0,f1,steps,ms\n"  queue a sweep, ms per step
+ *   "STATS\n"        "STATS:probe,count,min,avg,max;..." in CPU cycles (prof.h),
+ *                    "STATS:id" -> "HIST:probe,b0..b15", "STATS:RESET" clears
+ *   "TASKS\n"        "TASKS:name,runs,wcet_us,max_latency_us,misses;...", "TASKS:RESET" clears
+ *   "SLEEP[:mode]\n" "SLEEP:mode,idle_permille,max_wake_us,sleeps,standby", mode 0 off,
+ *                    1 IDLE, 2 STANDBY between tasks (sched.h), TASKS:RESET clears
+ *   "PING\n"         "PONG", "ECHO:text\n" -> "ECHO:text"
+ *   "BURST:n,len\n"  "OK" then n lines "B:seq,<len chars>" (link benchmark)
+ *   "BAUD[:n]\n"     read or switch the RPi link rate, "OK:n" comes at the old rate,
+ *                    then PING at the new rate within 1 s or the board goes back
+ *   "WEIGHT\n"       "WEIGHT:valid,g0,g1,g2" load cells in 0.1 g (hx711.h)
+ *   "TARE[:ch]\n"    zero one or every load cell, "HXCAL:ch,grams\n" calibrate with a known weight
+ *   "HXRAW\n"        "HXRAW:raw,filtered,reads,errors;...;present,read_us"
+ *   "STREAM:rate,mask\n"  push "TLM:seq,t_us,mask,..." at rate Hz (stream.h), rate 0 stops,
+ *                        "STREAM" -> "STREAM:rate,mask,skipped"
+ *   "DUMP\n"         "DUMP:count,size,boots,lost" then count raw flight records and a
+ *                    CRC-8 (flight.h, Inv8/flight.py decodes), "DUMP:CLEAR" empties it.
+ *                    TLM is skipped and EVT/BURST wait until the CRC is out.
+ *   "BIN\n"          switch to binary frames, see proto.h
  */
 
 #define F_CPU 16000000UL
@@ -15,14 +50,20 @@
 #include <avr/interrupt.h>
 #include <util/delay.h>
 #include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
 
 #include "usart.h"
 #include "adc.h"
-#include "analog.h"
+#include "proto.h"
+#include "command.h"
 #include "buzzer.h"
-#include "pwm.h"
+#include "servo.h"
+#include "motion.h"
+#include "sched.h"
+#include "prof.h"
+#include "stream.h"
+#include "hx711.h"
+#include "led.h"
+#include "flight.h"
 
 static void xosc_16MHz_init(void){
     ccp_write_io((void*)&CLKCTRL.XOSCHFCTRLA,
@@ -36,109 +77,88 @@ static void xosc_16MHz_init(void){
     while(CLKCTRL.MCLKSTATUS & CLKCTRL_SOSC_bm);
 }
 
-//LED
-#define LED_MASK (PIN0_bm | PIN1_bm | PIN2_bm | PIN3_bm)
-
-static void led_init(void){
-    PORTC.DIRSET = LED_MASK;
-    PORTC.OUTSET = LED_MASK;
-}
-static void led_toggle(uint8_t n){
-    uint8_t pin = (1 << (n & 0x03));
-    PORTC.OUTTGL = pin;
-}
-
-//Servo
-static uint16_t angle_to_ticks(uint8_t deg){
-    if(deg > 180) deg = 180;
-    return (uint16_t)(1000u + ((uint32_t)deg * 4000u) / 180u);
-}
-
-//USART2 (RPi)
-static uint8_t usart2_getline(char *buf, uint8_t maxlen){
-    uint8_t i = 0;
-    while(i < maxlen - 1){
-        while(!(USART2.STATUS & USART_RXCIF_bm)){}
-        char c = USART2.RXDATAL;
-        if(c == '\n' || c == '\r'){
-            break;
+//Feed received bytes to the ASCII line assembler or, in binary mode, the frame parser.
+//Bytes keep arriving in the RX ISR while a command is being handled.
+static void rx_pump(void){
+    static usart_line_t line;
+    static proto_rx_t frame;
+    int16_t c;
+
+    if(command_rx_held()) return;
+    PROF_ENTER(PROF_RX);
+    while((c = usart2_getc()) >= 0){
+        if(command_binary_mode()){
+            uint8_t r = proto_rx_feed(&frame, (uint8_t)c);
+            if(r != PROTO_RX_NONE){
+                PROF_ENTER(PROF_DISPATCH);
+                command_binary(&frame, r);
+                PROF_EXIT(PROF_DISPATCH);
+            }
+        } else if(usart_line_feed(&line, (char)c)){
+            PROF_ENTER(PROF_DISPATCH);
+            command_ascii(&line);
+            PROF_EXIT(PROF_DISPATCH);
         }
-        buf[i++] = c;
     }
-    buf[i] = '\0';
-    return i;
+    PROF_EXIT(PROF_RX);
 }
 
-static void usart2_puts(const char *s){
-    while(*s){
-        while(!(USART2.STATUS & USART_DREIF_bm)){}
-        USART2.TXDATAL = *s++;
-    }
+//Tasks, in priority order. The ADC scan and the buzzer sequencer stay
+//in their own interrupts, they need microseconds per event.
+enum {
+    TASK_MOTION = 0,
+    TASK_HX711,
+    TASK_LED,
+    TASK_RX,
+    TASK_EVENTS,
+    TASK_STREAM,
+    TASK_COUNT
+};
+
+static sched_task_t tasks[TASK_COUNT] = {
+    [TASK_MOTION] = { "motion", motion_step,  0, SERVO_FRAME_MS * 1000u },     //next frame before the next overflow
+    [TASK_HX711]  = { "hx711",  hx711_task,   50, 2000 },       //released by DT ready, timeout check every 50 ms
+    [TASK_LED]    = { "led",    led_task,     0, 2000 },        //released by TCB3 for the next PWM period
+    [TASK_RX]     = { "rx",     rx_pump,      0, 5000 },        //released by the USART2 RX ISR
+    [TASK_EVENTS] = { "events", command_poll, 5, 10000 },     //also woken by ADC events and TX space
+    [TASK_STREAM] = { "stream", stream_task,  0, 2000 },      //period set by STREAM
+};
+
+//STANDBY stops the USART clocks, wait until every reply has left.
+//The ADC scan is paused in STANDBY, so not while it is watched or streamed.
+static uint8_t standby_ok(void){
+    return usart_tx_idle() && !adc_watch_active() &&
+           !(stream_mask() & (STREAM_ADC | STREAM_TEMP));
+}
+
+//End of a PWM period, the motion task computes the next one
+ISR(TCA0_OVF_vect){
+    TCA0.SINGLE.INTFLAGS = TCA_SINGLE_OVF_bm;
+    sched_release(TASK_MOTION);
 }
 
 //Main
 int main(void){
     xosc_16MHz_init();
-    usart_init();
-    led_init();
+    prof_init();
+    flight_init();
+    usart_init(TASK_RX);
+    adc_scan_init(TASK_EVENTS);
     buzzer_init();
-    pwm_1_servo_init();
+    led_init(TASK_LED);
+    servo_init();
+    motion_init();
+    sched_init(tasks, TASK_COUNT);
+    command_init(TASK_EVENTS);
+    sched_set_standby_check(standby_ok);
+    sched_set_standby_hooks(adc_scan_pause, adc_scan_resume);
+    stream_init(TASK_STREAM);
+    hx711_init(TASK_HX711);
     sei();
 
     //Printf goes to PC terminal
     stdout = &usart3_stdout;
     printf("IO-kort ready\r\n");
 
-    char cmd[32];
-
-    for(;;){
-        // Wait for command
-        usart2_getline(cmd, sizeof(cmd));
-        printf("CMD: %s\r\n", cmd);   //Echo command
-
-        if(strcmp(cmd, "ADC") == 0){
-            adc0_init_pot_ain4_vdd_freerun();
-            uint16_t raw = adc0_read12_wait();
-            char reply[16];
-            snprintf(reply, sizeof(reply), "ADC:%u\n", raw);
-            usart2_puts(reply);
-            printf("ADC: %u\r\n", raw);
-
-        } else if(strcmp(cmd, "TMP") == 0){
-            adc0_init_tmp_freerun();
-            uint16_t raw = adc0_read12_wait();
-            uint16_t mv  = adc_to_mV_2048(raw);
-            int16_t  deg = tmp235_C_from_mV(mv);
-            char reply[16];
-            snprintf(reply, sizeof(reply), "TMP:%d\n", deg);
-            usart2_puts(reply);
-            printf("TMP: %d C\r\n", deg);
-
-        } else if(strncmp(cmd, "LED:", 4) == 0){
-            uint8_t n = (uint8_t)atoi(cmd + 4);
-            led_toggle(n);
-            usart2_puts("OK\n");
-            printf("LED%d toggled\r\n", n);
-
-        } else if(strncmp(cmd, "SERVO:", 6) == 0){
-            uint8_t deg = (uint8_t)atoi(cmd + 6);
-            pwm_1_servo_set_pos(angle_to_ticks(deg));
-            usart2_puts("OK\n");
-            printf("SERVO: %d deg\r\n", deg);
-
-        } else if(strncmp(cmd, "BUZZ:", 5) == 0){
-            uint16_t freq = (uint16_t)atoi(cmd + 5);
-            if(freq == 0){
-                buzzer_stop();
-            } else {
-                buzzer_beep(freq, 200);
-            }
-            usart2_puts("OK\n");
-            printf("BUZZ: %u Hz\r\n", freq);
-
-        } else {
-            usart2_puts("ERR\n");
-            printf("Unknown: %s\r\n", cmd);
-        }
-    }
-}
\ No newline at end of file
+    sched_run();
+}
@@ -0,0 +1,169 @@
+#include "motion.h"
+#include <avr/io.h>
+#include <util/atomic.h>
+#include "prof.h"
+
+//Progress t runs 0..MOTION_ONE in Q15
+#define MOTION_ONE  32768u
+
+//A queued segment, frames and step are worked out when it is queued so motion_step() never divides
+typedef struct {
+    uint16_t target[SERVO_COUNT];
+    uint16_t frames;
+    uint16_t step;              //Q15 progress per frame
+    uint8_t  profile;
+} motion_seg_t;
+
+//The segment being executed
+typedef struct {
+    int16_t  start[SERVO_COUNT];
+    int16_t  delta[SERVO_COUNT];
+    uint16_t frames;            //total frames of the segment
+    uint16_t frame;             //frames done
+    uint16_t step;
+    uint8_t  profile;
+    uint8_t  active;
+} motion_t;
+
+//Static segment arena, single producer (commands) / single consumer (motion_step)
+static motion_seg_t motion_queue_buf[MOTION_QUEUE_LEN];
+static volatile uint8_t motion_head = 0;    //next free slot, written by main
+static volatile uint8_t motion_tail = 0;    //next segment to run, written by motion_step()
+
+static volatile motion_t motion;
+
+#define MOTION_NEXT(i) ((uint8_t)((i) + 1u) & (MOTION_QUEUE_LEN - 1u))
+
+void motion_init(void){
+    TCA0.SINGLE.INTFLAGS = TCA_SINGLE_OVF_bm;
+    TCA0.SINGLE.INTCTRL |= TCA_SINGLE_OVF_bm;
+}
+
+//Q15 in, Q15 out, only multiplies and shifts
+static uint16_t motion_ease(uint16_t t, uint8_t profile){
+    uint32_t t2 = ((uint32_t)t * t) >> 15;
+    uint32_t u;
+    switch(profile){
+    case MOTION_SMOOTH:
+        return (uint16_t)((t2 * (3ul * MOTION_ONE - 2ul * t)) >> 15);
+    case MOTION_EASE_IN:
+        return (uint16_t)t2;
+    case MOTION_EASE_OUT:
+        u = MOTION_ONE - t;
+        return (uint16_t)(MOTION_ONE - ((u * u) >> 15));
+    case MOTION_LINEAR:
+    default:
+        return t;
+    }
+}
+
+uint8_t motion_queue_count(void){
+    return (uint8_t)(motion_head - motion_tail) & (MOTION_QUEUE_LEN - 1u);
+}
+
+uint8_t motion_queue_free(void){
+    return (MOTION_QUEUE_LEN - 1u) - motion_queue_count();
+}
+
+uint8_t motion_queue(const uint16_t target[SERVO_COUNT], uint16_t duration_ms, uint8_t profile){
+    if(profile >= MOTION_PROFILE_COUNT) return 0;
+    uint8_t head = motion_head;
+    uint8_t next = MOTION_NEXT(head);
+    if(next == motion_tail) return 0;                   //full
+
+    uint16_t frames = duration_ms / SERVO_FRAME_MS;
+    if(frames == 0) frames = 1;
+
+    motion_seg_t *seg = &motion_queue_buf[head];
+    for(uint8_t i = 0; i < SERVO_COUNT; i++) seg->target[i] = target[i];
+    seg->frames  = frames;
+    seg->step    = (uint16_t)(MOTION_ONE / frames);
+    seg->profile = profile;
+    motion_head = next;                                 //publish after the segment is complete
+    return 1;
+}
+
+uint8_t motion_move(const uint16_t target[SERVO_COUNT], uint16_t duration_ms, uint8_t profile){
+    if(profile >= MOTION_PROFILE_COUNT) return 0;
+    motion_stop();
+    return motion_queue(target, duration_ms, profile);
+}
+
+void motion_stop(void){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        motion_tail = motion_head;
+        motion.active = 0;
+    }
+}
+
+uint16_t motion_end_position(uint8_t ch){
+    uint16_t pos;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        if(motion_head != motion_tail){
+            pos = motion_queue_buf[(uint8_t)(motion_head - 1u) & (MOTION_QUEUE_LEN - 1u)].target[ch];
+        } else if(motion.active){
+            pos = (uint16_t)(motion.start[ch] + motion.delta[ch]);
+        } else {
+            pos = servo_get(ch);
+        }
+    }
+    return pos;
+}
+
+uint8_t motion_busy(void){
+    return motion.active || motion_queue_count();
+}
+
+//Look-ahead for MOTION_AUTO: only slow down where the path really stops
+static uint8_t motion_auto_profile(uint8_t flowing_in, uint8_t more_queued){
+    if(flowing_in) return more_queued ? MOTION_LINEAR : MOTION_EASE_OUT;
+    return more_queued ? MOTION_EASE_IN : MOTION_SMOOTH;
+}
+
+//Take the next segment off the queue, returns 0 if there is none
+static uint8_t motion_start_next(uint8_t flowing_in){
+    uint8_t tail = motion_tail;
+    if(tail == motion_head) return 0;
+    const motion_seg_t *seg = &motion_queue_buf[tail];
+    tail = MOTION_NEXT(tail);
+
+    for(uint8_t i = 0; i < SERVO_COUNT; i++){
+        uint16_t from = servo_get(i);
+        if(from == 0) from = seg->target[i];            //never set: no start point, jump
+        motion.start[i] = (int16_t)from;
+        motion.delta[i] = (int16_t)(seg->target[i] - from);
+    }
+    motion.frames  = seg->frames;
+    motion.frame   = 0;
+    motion.step    = seg->step;
+    motion.profile = (seg->profile == MOTION_AUTO)
+                     ? motion_auto_profile(flowing_in, tail != motion_head)
+                     : seg->profile;
+    motion.active  = 1;
+    motion_tail = tail;                                 //slot may be reused from here
+    return 1;
+}
+
+//Once per PWM period, the new positions latch at the next UPDATE
+void motion_step(void){
+    if(!motion.active && !motion_start_next(0)) return;
+    PROF_ENTER(PROF_MOTION);
+
+    uint16_t ticks[SERVO_COUNT];
+    uint16_t frame = motion.frame + 1;
+    uint16_t s = (frame >= motion.frames) ? MOTION_ONE
+                 : motion_ease((uint16_t)(frame * motion.step), motion.profile);
+
+    for(uint8_t i = 0; i < SERVO_COUNT; i++){
+        int32_t d = ((int32_t)motion.delta[i] * s) >> 15;
+        ticks[i] = (uint16_t)(motion.start[i] + (int16_t)d);
+    }
+    servo_write(ticks);
+
+    motion.frame = frame;
+    if(frame >= motion.frames){
+        motion.active = 0;
+        motion_start_next(1);       //chain straight into the next segment, no stop frame
+    }
+    PROF_EXIT(PROF_MOTION);
+}
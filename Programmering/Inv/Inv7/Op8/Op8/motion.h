@@ -0,0 +1,51 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+#include <stdint.h>
+#include "servo.h"
+
+//Servo trajectory interpolation, stepped once per 20 ms PWM period by the
+//motion task that the TCA0 overflow interrupt releases (main.c).
+//The host sends one move, the firmware sends the in-between positions.
+//
+//Moves are segments in a fixed queue. The host can keep the queue topped
+//up and the segments run back-to-back, without a stop at each waypoint.
+
+#define MOTION_QUEUE_LEN    16      //power of two, one slot is kept free
+
+//Easing profiles
+enum {
+    MOTION_LINEAR   = 0,
+    MOTION_SMOOTH   = 1,    //smoothstep t*t*(3-2t), zero speed at both ends
+    MOTION_EASE_IN  = 2,    //t*t
+    MOTION_EASE_OUT = 3,    //1-(1-t)^2
+    MOTION_AUTO     = 4,    //picked per segment: ease in from rest, ease out before an empty queue,
+                            //linear in between so a path keeps its speed through the waypoints
+    MOTION_PROFILE_COUNT
+};
+
+void motion_init(void);                 //enables the TCA0 overflow interrupt
+
+//Compute and write the next frame, must finish before the next overflow
+void motion_step(void);
+
+//Move all channels from where they are to target over duration_ms.
+//Returns 0 if the profile is unknown. Running and queued moves are dropped.
+uint8_t motion_move(const uint16_t target[SERVO_COUNT], uint16_t duration_ms, uint8_t profile);
+
+//Append a segment that starts where the previous one ends.
+//Returns 0 if the queue is full or the profile is unknown.
+uint8_t motion_queue(const uint16_t target[SERVO_COUNT], uint16_t duration_ms, uint8_t profile);
+
+uint8_t motion_queue_count(void);       //segments waiting, not counting the running one
+uint8_t motion_queue_free(void);
+
+//Stop where the servos are now and empty the queue
+void motion_stop(void);
+
+//Where channel ch will be once everything queued has run
+uint16_t motion_end_position(uint8_t ch);
+
+uint8_t motion_busy(void);              //running or queued
+
+#endif
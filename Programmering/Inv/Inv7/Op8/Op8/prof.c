@@ -0,0 +1,108 @@
+#include "prof.h"
+#include <avr/io.h>
+#include <util/atomic.h>
+
+static prof_stat_t prof_stats[PROF_COUNT];
+static uint16_t prof_overhead = 0;          //cycles of an empty ENTER/EXIT pair
+
+static const char *const prof_names[PROF_COUNT] = {
+    [PROF_RX]           = "rx",
+    [PROF_DISPATCH]     = "dispatch",
+    [PROF_FORMAT]       = "format",
+    [PROF_MOTION]       = "motion",
+    [PROF_ADC_ISR]      = "adc_isr",
+    [PROF_BUZZER_ISR]   = "buzz_isr",
+    [PROF_USART_RX_ISR] = "rx_isr",
+    [PROF_LED_ISR]      = "led_isr",
+};
+
+//CNT is read through the shared TEMP register: an ISR probe between the low
+//and high byte of a main context read would hand it the wrong high byte
+static uint16_t prof_now(void){
+    uint16_t t;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){ t = TCB2.CNT; }
+    return t;
+}
+
+void prof_init(void){
+    //Free-running 16 bit counter: periodic mode with TOP at 0xFFFF, no interrupt
+    TCB2.CTRLA = 0;
+    TCB2.CTRLB = TCB_CNTMODE_INT_gc;
+    TCB2.CCMP = 0xFFFF;
+    TCB2.CNT = 0;
+    TCB2.CTRLA = TCB_CLKSEL_DIV1_gc | TCB_ENABLE_bm;
+#if PROF_GPIO
+    PORTD.DIRSET = PIN0_bm | PIN1_bm | PIN2_bm | PIN3_bm;
+    PORTD.OUTCLR = PIN0_bm | PIN1_bm | PIN2_bm | PIN3_bm;
+#endif
+
+    //Calibrate the probe cost away: prof_enter() plus the counter read in prof_exit()
+    uint16_t best = 0xFFFF;
+    for(uint8_t i = 0; i < 4; i++){
+        uint16_t c;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+            uint16_t t0 = prof_enter(0xFF);
+            c = prof_now() - t0;
+        }
+        if(c < best) best = c;
+    }
+    prof_overhead = best;
+    prof_reset();
+}
+
+void prof_reset(void){
+    for(uint8_t i = 0; i < PROF_COUNT; i++){
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+            prof_stat_t *s = &prof_stats[i];
+            s->count = 0;
+            s->sum = 0;
+            s->min = 0xFFFF;
+            s->max = 0;
+            for(uint8_t b = 0; b < PROF_HIST_BINS; b++) s->hist[b] = 0;
+        }
+    }
+}
+
+const char *prof_name(uint8_t id){
+    return id < PROF_COUNT ? prof_names[id] : "?";
+}
+
+void prof_get(uint8_t id, prof_stat_t *out){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){ *out = prof_stats[id]; }
+}
+
+uint16_t prof_enter(uint8_t id){
+#if PROF_GPIO
+    if(id < 4) PORTD.OUTSET = (uint8_t)(1 << id);
+#endif
+    return prof_now();
+}
+
+//floor(log2(c)), 0 for 0 and 1
+static uint8_t prof_bin(uint16_t c){
+    uint8_t b = 0;
+    if(c >= 0x100){ c >>= 8; b += 8; }
+    if(c >= 0x10) { c >>= 4; b += 4; }
+    if(c >= 0x4)  { c >>= 2; b += 2; }
+    if(c >= 0x2)  { b += 1; }
+    return b;
+}
+
+void prof_exit(uint8_t id, uint16_t t0){
+    uint16_t c = prof_now() - t0;
+#if PROF_GPIO
+    if(id < 4) PORTD.OUTCLR = (uint8_t)(1 << id);
+#endif
+    c = (c > prof_overhead) ? c - prof_overhead : 0;
+
+    //only this probe's context writes these, but the reader copies with interrupts off
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        prof_stat_t *s = &prof_stats[id];
+        s->count++;
+        s->sum += c;
+        if(c < s->min) s->min = c;
+        if(c > s->max) s->max = c;
+        uint16_t *h = &s->hist[prof_bin(c)];
+        if(*h != 0xFFFF) (*h)++;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+
+//Cycle counting on hot paths.
+//TCB2 free-runs at F_CPU (16 MHz, 62.5 ns per count, wraps after 4.1 ms).
+//PROF_ENTER/PROF_EXIT around a block record its cycles in the probe's
+//min/max/sum and a log2 histogram, dumped by the STATS command.
+//Each probe must be used from one context only (main or one ISR).
+//Blocks longer than 65535 cycles wrap and read short.
+
+#ifndef PROF_ENABLE
+#define PROF_ENABLE     1
+#endif
+
+//Set to 1 to also drive PORTD PD0..PD3 high while probes 0..3 run,
+//for a logic analyzer
+#ifndef PROF_GPIO
+#define PROF_GPIO       0
+#endif
+
+#define PROF_HIST_BINS  16          //bin n counts runs of 2^n .. 2^(n+1)-1 cycles
+
+enum {
+    PROF_RX = 0,                    //rx_pump(), line/frame assembly and dispatch
+    PROF_DISPATCH,                  //one ASCII or binary command
+    PROF_FORMAT,                    //reply number conversion (reply.c) and the COMMAND_ECHO printf
+    PROF_MOTION,                    //motion_step()
+    PROF_ADC_ISR,
+    PROF_BUZZER_ISR,
+    PROF_USART_RX_ISR,
+    PROF_LED_ISR,
+    PROF_COUNT
+};
+
+typedef struct {
+    uint32_t count;
+    uint32_t sum;
+    uint16_t min;
+    uint16_t max;
+    uint16_t hist[PROF_HIST_BINS];
+} prof_stat_t;
+
+void prof_init(void);
+void prof_reset(void);
+
+const char *prof_name(uint8_t id);
+void prof_get(uint8_t id, prof_stat_t *out);    //consistent copy, safe against the ISRs
+
+uint16_t prof_enter(uint8_t id);
+void prof_exit(uint8_t id, uint16_t t0);
+
+#if PROF_ENABLE
+#define PROF_ENTER(id)  uint16_t prof_t0_##id = prof_enter(id)
+#define PROF_EXIT(id)   prof_exit(id, prof_t0_##id)
+#else
+#define PROF_ENTER(id)
+#define PROF_EXIT(id)
+#endif
+
+#endif
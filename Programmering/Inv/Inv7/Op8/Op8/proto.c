@@ -0,0 +1,97 @@
+#include "proto.h"
+
+enum {
+    RX_IDLE = 0,
+    RX_OPCODE,
+    RX_LEN,
+    RX_PAYLOAD,
+    RX_CRC,
+};
+
+//CRC-8/ATM, MSB first, 4 bits at a time from a 16 entry table
+static const uint8_t crc8_nibble[16] = {
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+    0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+};
+
+uint8_t proto_crc8_update(uint8_t crc, uint8_t c){
+    crc ^= c;
+    crc = (uint8_t)(crc << 4) ^ crc8_nibble[crc >> 4];
+    crc = (uint8_t)(crc << 4) ^ crc8_nibble[crc >> 4];
+    return crc;
+}
+
+uint8_t proto_crc8(const uint8_t *data, uint8_t len){
+    uint8_t crc = 0;
+    while(len--) crc = proto_crc8_update(crc, *data++);
+    return crc;
+}
+
+void proto_rx_reset(proto_rx_t *rx){
+    rx->state = RX_IDLE;
+    rx->error = PROTO_ERR_NONE;
+}
+
+uint8_t proto_rx_busy(const proto_rx_t *rx){
+    return rx->state != RX_IDLE;
+}
+
+uint8_t proto_rx_feed(proto_rx_t *rx, uint8_t c){
+    switch(rx->state){
+    case RX_IDLE:
+        if(c == PROTO_SYNC){
+            rx->crc = 0;
+            rx->error = PROTO_ERR_NONE;
+            rx->state = RX_OPCODE;
+        }
+        return PROTO_RX_NONE;
+
+    case RX_OPCODE:
+        rx->opcode = c;
+        rx->crc = proto_crc8_update(rx->crc, c);
+        rx->state = RX_LEN;
+        return PROTO_RX_NONE;
+
+    case RX_LEN:
+        if(c > PROTO_MAX_PAYLOAD){
+            rx->error = PROTO_ERR_LENGTH;
+            rx->state = RX_IDLE;        //hunt for the next SYNC
+            return PROTO_RX_ERROR;
+        }
+        rx->len = c;
+        rx->idx = 0;
+        rx->crc = proto_crc8_update(rx->crc, c);
+        rx->state = c ? RX_PAYLOAD : RX_CRC;
+        return PROTO_RX_NONE;
+
+    case RX_PAYLOAD:
+        rx->payload[rx->idx++] = c;
+        rx->crc = proto_crc8_update(rx->crc, c);
+        if(rx->idx == rx->len) rx->state = RX_CRC;
+        return PROTO_RX_NONE;
+
+    case RX_CRC:
+    default:
+        rx->state = RX_IDLE;
+        if(c != rx->crc){
+            rx->error = PROTO_ERR_CRC;
+            return PROTO_RX_ERROR;
+        }
+        return PROTO_RX_FRAME;
+    }
+}
+
+uint8_t proto_encode(uint8_t *out, uint8_t opcode, const uint8_t *payload, uint8_t len){
+    uint8_t crc = 0;
+    out[0] = PROTO_SYNC;
+    out[1] = opcode;
+    out[2] = len;
+    crc = proto_crc8_update(crc, opcode);
+    crc = proto_crc8_update(crc, len);
+    for(uint8_t i = 0; i < len; i++){
+        out[3 + i] = payload[i];
+        crc = proto_crc8_update(crc, payload[i]);
+    }
+    out[3 + len] = crc;
+    return (uint8_t)(len + PROTO_OVERHEAD);
+}
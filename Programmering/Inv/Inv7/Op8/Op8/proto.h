@@ -0,0 +1,115 @@
+#ifndef PROTO_H
+#define PROTO_H
+
+#include <stdint.h>
+
+//Binary framed command protocol (RPi <-> IO board)
+//
+//  frame:  SYNC  OP  LEN  PAYLOAD[LEN]  CRC
+//  CRC-8 (poly 0x07, init 0x00) over OP, LEN and PAYLOAD
+//  multi-byte payload fields are little-endian
+//
+//Replies carry the request opcode with PROTO_REPLY_bm set, errors come back
+//as PROTO_OP_NAK with payload { request opcode, PROTO_ERR_x }.
+//Plain C with no AVR dependencies so the host tools can build it too.
+
+#define PROTO_SYNC          0xA5
+#define PROTO_MAX_PAYLOAD   32
+#define PROTO_OVERHEAD      4               //SYNC + OP + LEN + CRC
+#define PROTO_MAX_FRAME     (PROTO_MAX_PAYLOAD + PROTO_OVERHEAD)
+#define PROTO_REPLY_bm      0x80
+
+//Request opcodes, also the index into the firmware dispatch table
+enum {
+    PROTO_OP_ASCII       = 0x00,    //leave binary mode, reply is sent before switching
+    PROTO_OP_ADC         = 0x01,    //-> u16 raw, resolution set by OVS
+    PROTO_OP_TMP         = 0x02,    //-> i16 deg C
+    PROTO_OP_LED         = 0x03,    //u8 n toggles [, u8 level [, u16 fade ms]] (led.h)
+    PROTO_OP_SERVO       = 0x04,    //u8 deg
+    PROTO_OP_BUZZ        = 0x05,    //u16 freq, 0 = stop
+    PROTO_OP_SERVO_MULTI = 0x06,    //u8 deg[1..3], channel 0 first
+    PROTO_OP_MOVE        = 0x07,    //u16 ms, u8 profile, u8 deg[1..3]
+    PROTO_OP_SEG         = 0x08,    //same as MOVE but queued -> u8 free slots
+    PROTO_OP_QLEN        = 0x09,    //-> u8 queued, u8 free, u8 busy
+    PROTO_OP_IK          = 0x0A,    //i16 x, y, z mm, i16 phi deg [, u16 ms queued AUTO segment]
+    PROTO_OP_IK_CFG      = 0x0B,    //i16 l1, l2, l3, z_base mm, i16 mount[4] deg, empty = read -> same
+    PROTO_OP_CAL         = 0x0C,    //u8 ch [, u16 min, center, max ticks, i8 dir] -> u8 ch, same fields
+    PROTO_OP_CAL_SAVE    = 0x0D,    //write all channel calibrations to EEPROM
+    PROTO_OP_ITMP        = 0x0E,    //-> i16 deg C, internal temperature sensor
+    PROTO_OP_OVS         = 0x0F,    //u8 ch [, u8 samplenum, u8 shift] -> u8 ch, samplenum, shift, bits
+    PROTO_OP_WATCH       = 0x10,    //u8 ch, u16 lo, u16 hi = watch, u8 ch alone = stop
+    PROTO_OP_NOTE        = 0x11,    //u16 freq (0 = rest), u16 ms, queued -> u8 free slots
+    PROTO_OP_SWEEP       = 0x12,    //u16 f_start, u16 f_end, u8 steps, u16 step_ms, queued
+    PROTO_OP_TASKS       = 0x13,    //u8 id -> scheduler statistics (command.c), 0xFF clears them
+    PROTO_OP_STATS       = 0x14,    //u8 probe -> u8 id, u32 count, u16 min, avg, max cycles, 0xFF clears
+    PROTO_OP_HIST        = 0x15,    //u8 probe -> u16 hist[16], log2 cycle bins
+    PROTO_OP_PING        = 0x16,    //any payload -> same payload
+    PROTO_OP_BURST       = 0x17,    //u8 n, u8 len -> n PROTO_EVT_BURST events of len filler bytes
+    PROTO_OP_BAUD        = 0x18,    //[u32 baud] -> u32 baud, switches after the reply, PING within 1 s confirms
+    PROTO_OP_STREAM      = 0x19,    //[u16 rate_hz, u8 mask] -> u16 rate, u8 mask, u16 skipped (stream.h)
+    PROTO_OP_WEIGHT      = 0x1A,    //-> u8 valid mask, i16 weight[3] in 0.1 g
+    PROTO_OP_TARE        = 0x1B,    //[u8 ch], empty = every load cell
+    PROTO_OP_HX_CAL      = 0x1C,    //u8 ch, u16 grams on the cell -> i32 counts per gram << 8
+    PROTO_OP_HX_RAW      = 0x1D,    //u8 ch -> i32 raw, i32 filtered, u16 reads, errors, u8 present, u16 read_us
+    PROTO_OP_SLEEP       = 0x1E,    //[u8 mode] -> u8 mode, u16 idle permille, u16 max_wake_us, u32 sleeps, standby
+    PROTO_OP_LED_PULSE   = 0x1F,    //u8 n, u8 lo, u8 hi, u16 ms per ramp, runs until the next LED
+    PROTO_OP_DUMP        = 0x20,    //[u8 0xFF clears] -> u16 count, u16 boots, u16 lost, then count PROTO_EVT_DUMP
+    PROTO_OP_COUNT
+};
+
+#define PROTO_OP_NAK        0x7F
+#define PROTO_OP_EVENT      0x7E    //unsolicited, payload starts with a PROTO_EVT_x kind
+
+enum {
+    PROTO_EVT_WATCH  = 0x01,        //u8 ch, u8 outside, u16 value
+    PROTO_EVT_BURST  = 0x02,        //u8 seq, filler bytes seq, seq+1, ...
+    PROTO_EVT_STREAM = 0x03,        //u16 seq, u32 t_us, u8 mask, fields (stream.h)
+    PROTO_EVT_DUMP   = 0x04,        //u16 index, flight_rec_t (flight.h)
+};
+
+enum {
+    PROTO_ERR_NONE   = 0,
+    PROTO_ERR_OPCODE = 1,           //unknown opcode
+    PROTO_ERR_LENGTH = 2,           //payload length not valid for this opcode
+    PROTO_ERR_CRC    = 3,
+    PROTO_ERR_ARG    = 4,           //argument out of range
+    PROTO_ERR_FULL   = 5,           //queue full, try again later
+};
+
+//Result of proto_rx_feed()
+#define PROTO_RX_NONE       0       //need more bytes
+#define PROTO_RX_FRAME      1       //frame complete and CRC good
+#define PROTO_RX_ERROR      2       //bad length or CRC, rx->error says which
+
+typedef struct {
+    uint8_t state;
+    uint8_t opcode;
+    uint8_t len;
+    uint8_t idx;
+    uint8_t crc;
+    uint8_t error;
+    uint8_t payload[PROTO_MAX_PAYLOAD];
+} proto_rx_t;
+
+uint8_t proto_crc8_update(uint8_t crc, uint8_t c);
+uint8_t proto_crc8(const uint8_t *data, uint8_t len);
+
+void proto_rx_reset(proto_rx_t *rx);
+uint8_t proto_rx_busy(const proto_rx_t *rx);        //1 while inside a frame
+
+//Feed one received byte. Bytes outside a frame are skipped until SYNC.
+uint8_t proto_rx_feed(proto_rx_t *rx, uint8_t c);
+
+//Build a frame into out (at least len + PROTO_OVERHEAD bytes), returns its size
+uint8_t proto_encode(uint8_t *out, uint8_t opcode, const uint8_t *payload, uint8_t len);
+
+static inline uint16_t proto_get_u16(const uint8_t *p){
+    return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static inline void proto_put_u16(uint8_t *p, uint16_t v){
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+#endif
@@ -10,7 +10,8 @@ void pwm_1_servo_init(){
 	PORTE.PIN0CTRL |= PORT_INVEN_bm; // transistors invert output
 	// pwm_frequency should be 50 Hz
 	// 16MHz / DIV8 = 2MHz timer clock -> 1ms=2000 ticks, PER=40000 -> 50Hz
-	TCA0.SINGLE.CTRLA = TCA_SINGLE_CLKSEL_DIV8_gc | TCA_SINGLE_ENABLE_bm;
+	// RUNSTDBY: the servos keep their pulses while the CPU is in standby
+	TCA0.SINGLE.CTRLA = TCA_SINGLE_CLKSEL_DIV8_gc | TCA_SINGLE_RUNSTDBY_bm | TCA_SINGLE_ENABLE_bm;
 	// enabling output pins on compare channels and setting wave generation mode to single-slope pwm
 	TCA0.SINGLE.CTRLB = TCA_SINGLE_CMP0_bm  | TCA_SINGLE_WGMODE_SINGLESLOPE_gc;
 	// interrupts not necessary in this mode
@@ -24,9 +25,10 @@ void pwm_3_servo_init(){
 	PORTE.DIR |= (1<<0) | (1<<1) | (1<<2);
 	PORTE.PINCONFIG |= PORT_INVEN_bm;
 	PORTE.PINCTRLSET |= (1<<0) | (1<<1) | (1<<2);
-	// pwm_frequency should be 50 Hz. 4M/(1*50) > 2^16 -> DIV2
-	// starting timer and selecting DIV 2 division:
-	TCA0.SINGLE.CTRLA = TCA_SINGLE_CLKSEL_DIV2_gc | TCA_SINGLE_ENABLE_bm;
+	// pwm_frequency should be 50 Hz, same timing as pwm_1_servo_init()
+	// 16MHz / DIV8 = 2MHz timer clock -> 1ms=2000 ticks, PER=40000 -> 50Hz
+	// RUNSTDBY: the servos keep their pulses while the CPU is in standby
+	TCA0.SINGLE.CTRLA = TCA_SINGLE_CLKSEL_DIV8_gc | TCA_SINGLE_RUNSTDBY_bm | TCA_SINGLE_ENABLE_bm;
 	// enabling output pins on compare channels and setting wave generation mode to single-slope pwm
 	TCA0.SINGLE.CTRLB = TCA_SINGLE_CMP0_bm | TCA_SINGLE_CMP1_bm | TCA_SINGLE_CMP2_bm | TCA_SINGLE_WGMODE_SINGLESLOPE_gc;
 	// interrupts not necessary in this mode
@@ -40,10 +42,15 @@ void pwm_1_servo_set_pos(uint16_t pos){
 		TCA0.SINGLE.CMP0BUF = pos;
 }
 
+// all three channels change on the same PWM period:
+// LUPD holds the BUF -> CMP transfer until every buffer is written,
+// so an UPDATE in the middle can not latch a mix of old and new positions
 void pwm_3_servo_set_pos(uint16_t pos1, uint16_t pos2, uint16_t pos3){
+		TCA0.SINGLE.CTRLESET = TCA_SINGLE_LUPD_bm;
 		TCA0.SINGLE.CMP0BUF = pos1;
 		TCA0.SINGLE.CMP1BUF = pos2;
 		TCA0.SINGLE.CMP2BUF = pos3;
+		TCA0.SINGLE.CTRLECLR = TCA_SINGLE_LUPD_bm;
 }
 
 /* LEDS */
@@ -0,0 +1,105 @@
+#include "reply.h"
+#include "usart.h"
+#include "prof.h"
+
+//v / 10 as a fixed-point multiply by 0.8 * 2^-3, exact for every 16-bit v.
+//Much cheaper than the __udivmodhi4 loop behind utoa and printf.
+static inline uint16_t div10(uint16_t v){
+    return (uint16_t)(((uint32_t)v * 0xCCCDu) >> 19);
+}
+
+//Digits least significant first into rev[], returns the count (1..5)
+static uint8_t u16_rev(char *rev, uint16_t v){
+    uint8_t n = 0;
+    do {
+        uint16_t q = div10(v);
+        rev[n++] = (char)('0' + (v - q * 10u));
+        v = q;
+    } while(v);
+    return n;
+}
+
+static void put_rev(const char *rev, uint8_t n){
+    while(n) usart2_putc(rev[--n]);
+}
+
+void reply_str(const char *s){
+    usart2_puts(s);
+}
+
+void reply_char(char c){
+    usart2_putc(c);
+}
+
+void reply_end(void){
+    usart2_putc('\n');
+}
+
+void reply_u16(uint16_t v){
+    char rev[5];
+    PROF_ENTER(PROF_FORMAT);
+    uint8_t n = u16_rev(rev, v);
+    put_rev(rev, n);
+    PROF_EXIT(PROF_FORMAT);
+}
+
+void reply_i16(int16_t v){
+    char rev[5];
+    PROF_ENTER(PROF_FORMAT);
+    if(v < 0) usart2_putc('-');
+    uint8_t n = u16_rev(rev, v < 0 ? (uint16_t)(0u - (uint16_t)v) : (uint16_t)v);
+    put_rev(rev, n);
+    PROF_EXIT(PROF_FORMAT);
+}
+
+void reply_u32(uint32_t v){
+    char rev[10];
+    uint8_t n = 0;
+    PROF_ENTER(PROF_FORMAT);
+    //peel off 4 low digits at a time until the rest fits the 16-bit path
+    while(v > 0xFFFF){
+        uint32_t q = v / 10000u;
+        uint16_t low = (uint16_t)(v - q * 10000u);
+        for(uint8_t i = 0; i < 4; i++){
+            uint16_t d = div10(low);
+            rev[n++] = (char)('0' + (low - d * 10u));
+            low = d;
+        }
+        v = q;
+    }
+    n += u16_rev(rev + n, (uint16_t)v);
+    put_rev(rev, n);
+    PROF_EXIT(PROF_FORMAT);
+}
+
+void reply_i32(int32_t v){
+    if(v < 0) usart2_putc('-');
+    reply_u32(v < 0 ? -(uint32_t)v : (uint32_t)v);
+}
+
+static const char hex_digit[16] = "0123456789ABCDEF";
+
+void reply_hex8(uint8_t v){
+    usart2_putc(hex_digit[v >> 4]);
+    usart2_putc(hex_digit[v & 0x0F]);
+}
+
+void reply_hex16(uint16_t v){
+    reply_hex8((uint8_t)(v >> 8));
+    reply_hex8((uint8_t)v);
+}
+
+void reply_fixed(int16_t v, uint8_t decimals){
+    char rev[6];
+    PROF_ENTER(PROF_FORMAT);
+    if(v < 0) usart2_putc('-');
+    uint8_t n = u16_rev(rev, v < 0 ? (uint16_t)(0u - (uint16_t)v) : (uint16_t)v);
+    if(decimals > 5) decimals = 5;
+    while(n <= decimals) rev[n++] = '0';    //at least one digit before the point
+    while(n > decimals) usart2_putc(rev[--n]);
+    if(decimals){
+        usart2_putc('.');
+        put_rev(rev, n);
+    }
+    PROF_EXIT(PROF_FORMAT);
+}
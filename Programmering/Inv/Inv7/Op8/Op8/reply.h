@@ -0,0 +1,30 @@
+#ifndef REPLY_H
+#define REPLY_H
+
+#include <stdint.h>
+
+//Reply builder for the RPi link. Text and numbers go straight into the
+//USART2 TX ring, no format string, no stack buffer, no stdio.
+//A reply is a sequence of calls ending in reply_end():
+//
+//  reply_str("ADC:"); reply_u16(raw); reply_end();
+//
+//Number conversion is timed as PROF_FORMAT, together with the printf echo
+//in COMMAND_ECHO builds. PROF_DISPATCH has the whole command.
+
+void reply_str(const char *s);
+void reply_char(char c);
+void reply_end(void);                   //'\n'
+
+void reply_u16(uint16_t v);
+void reply_i16(int16_t v);
+void reply_u32(uint32_t v);
+void reply_i32(int32_t v);
+void reply_hex8(uint8_t v);             //two digits, upper case
+void reply_hex16(uint16_t v);           //four digits
+
+//v / 10^decimals with exactly `decimals` digits after the point,
+//reply_fixed(-25, 1) -> "-2.5", reply_fixed(7, 2) -> "0.07"
+void reply_fixed(int16_t v, uint8_t decimals);
+
+#endif
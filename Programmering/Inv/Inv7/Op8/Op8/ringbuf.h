@@ -0,0 +1,46 @@
+#ifndef RINGBUF_H
+#define RINGBUF_H
+
+#include <stdint.h>
+
+//Lock-free single-producer/single-consumer byte ring.
+//The producer only writes head and the consumer only writes tail, so one side
+//may live in an ISR and the other in main without disabling interrupts.
+//Storage size must be a power of two, max 256.
+typedef struct {
+    uint8_t *buf;
+    uint8_t mask;
+    volatile uint8_t head;      //next slot to write
+    volatile uint8_t tail;      //next slot to read
+} ringbuf_t;
+
+#define RINGBUF_INIT(storage) { (storage), (uint8_t)(sizeof(storage) - 1u), 0, 0 }
+
+static inline uint8_t ringbuf_count(const ringbuf_t *rb){
+    return (uint8_t)(rb->head - rb->tail) & rb->mask;
+}
+
+static inline uint8_t ringbuf_free(const ringbuf_t *rb){
+    return rb->mask - ringbuf_count(rb);
+}
+
+//returns 0 if the ring was full and the byte was not stored
+static inline uint8_t ringbuf_put(ringbuf_t *rb, uint8_t c){
+    uint8_t head = rb->head;
+    uint8_t next = (uint8_t)(head + 1u) & rb->mask;
+    if(next == rb->tail) return 0;
+    rb->buf[head] = c;
+    rb->head = next;                //publish after the data is written
+    return 1;
+}
+
+//returns -1 if the ring is empty
+static inline int16_t ringbuf_get(ringbuf_t *rb){
+    uint8_t tail = rb->tail;
+    if(tail == rb->head) return -1;
+    uint8_t c = rb->buf[tail];
+    rb->tail = (uint8_t)(tail + 1u) & rb->mask;
+    return c;
+}
+
+#endif
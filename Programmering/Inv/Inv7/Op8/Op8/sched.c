@@ -0,0 +1,299 @@
+#include "sched.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define SCHED_TICKS_PER_MS  ((F_CPU / 2u) / SCHED_TICK_HZ)     //TCB1 at F_CPU / 2
+#define SCHED_TICKS_PER_US  ((F_CPU / 2u) / 1000000u)
+#define SCHED_STRETCH_MAX   (0xFFFFu / SCHED_TICKS_PER_MS)     //longest tick period in ms
+#define SCHED_STRETCH_MARGIN 64u    //ticks, CCMP is not moved closer to CNT than this
+
+static sched_task_t *sched_tasks;
+static uint8_t sched_count;
+static volatile uint32_t sched_ticks = 0;     //ms at the start of the running tick period
+static volatile uint8_t sched_tick_ms = 1;      //length of that period, more than 1 in standby
+
+static uint8_t sched_sleep = SCHED_SLEEP_DEFAULT;
+static uint8_t (*sched_standby_ok)(void);
+static void (*sched_standby_enter)(void);
+static void (*sched_standby_leave)(void);
+static sched_sleep_stats_t sched_sleep_st;
+static uint8_t sched_woke;              //slept since the last task run
+
+void sched_init(sched_task_t *tasks, uint8_t count){
+    sched_tasks = tasks;
+    sched_count = count;
+    for(uint8_t i = 0; i < count; i++){
+        tasks[i].released = 0;
+        tasks[i].next_ms = tasks[i].period_ms;
+    }
+    sched_reset_stats();
+
+    //TCB1 periodic interrupt, also the sub-ms time base
+    TCB1.CTRLA = 0;
+    TCB1.CTRLB = TCB_CNTMODE_INT_gc;
+    TCB1.CCMP = SCHED_TICKS_PER_MS - 1;
+    TCB1.CNT = 0;
+    TCB1.INTFLAGS = TCB_CAPT_bm;
+    TCB1.INTCTRL = TCB_CAPT_bm;
+    TCB1.CTRLA = TCB_CLKSEL_DIV2_gc | TCB_RUNSTDBY_bm | TCB_ENABLE_bm;    //ticks on in standby
+}
+
+ISR(TCB1_INT_vect){
+    TCB1.INTFLAGS = TCB_CAPT_bm;
+    sched_ticks += sched_tick_ms;
+    if(sched_tick_ms != 1){             //end of a stretched standby period
+        sched_tick_ms = 1;
+        TCB1.CCMP = SCHED_TICKS_PER_MS - 1;
+    }
+}
+
+//Whole ms, also in the middle of a stretched period. Interrupts off.
+static uint32_t sched_now_ms(void){
+    uint32_t ms = sched_ticks;
+    uint16_t cnt = TCB1.CNT;
+    if((TCB1.INTFLAGS & TCB_CAPT_bm) && cnt < SCHED_TICKS_PER_MS / 2) return ms + sched_tick_ms;
+    return ms + cnt / SCHED_TICKS_PER_MS;
+}
+
+uint32_t sched_ms(void){
+    uint32_t t;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){ t = sched_now_ms(); }
+    return t;
+}
+
+uint32_t sched_time_us(void){
+    uint32_t ms;
+    uint16_t cnt;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        ms = sched_ticks;
+        cnt = TCB1.CNT;
+        //the tick may have wrapped after interrupts went off
+        if((TCB1.INTFLAGS & TCB_CAPT_bm) && cnt < SCHED_TICKS_PER_MS / 2) ms += sched_tick_ms;
+    }
+    return ms * 1000u + cnt / SCHED_TICKS_PER_US;
+}
+
+void sched_release(uint8_t id){
+    sched_task_t *t = &sched_tasks[id];
+    uint32_t now = sched_time_us();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        if(t->released) t->misses++;    //the previous release was never served
+        t->released = 1;
+        t->release_us = now;
+    }
+}
+
+void sched_wake(uint8_t id){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        if(!sched_tasks[id].released) sched_release(id);
+    }
+}
+
+void sched_set_period(uint8_t id, uint16_t period_ms){
+    sched_task_t *t = &sched_tasks[id];
+    t->period_ms = period_ms;
+    t->next_ms = sched_ms();
+}
+
+//misses is also counted by sched_release() from interrupts
+static void sched_miss(sched_task_t *t){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){ t->misses++; }
+}
+
+static uint16_t sched_sat16(uint32_t v){
+    return v > 0xFFFF ? 0xFFFF : (uint16_t)v;
+}
+
+//Release periodic tasks whose time has come
+static void sched_release_due(uint32_t now_ms){
+    for(uint8_t i = 0; i < sched_count; i++){
+        sched_task_t *t = &sched_tasks[i];
+        if(!t->period_ms || (int32_t)(now_ms - t->next_ms) < 0) continue;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+            t->released = 1;
+            t->release_us = t->next_ms * 1000u;
+        }
+        t->next_ms += t->period_ms;
+        if((int32_t)(now_ms - t->next_ms) >= 0){    //a whole period behind, skip ahead
+            sched_miss(t);
+            t->next_ms = now_ms + t->period_ms;
+        }
+    }
+}
+
+static void sched_execute(sched_task_t *t){
+    uint32_t release;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        release = t->release_us;
+        t->released = 0;
+    }
+    uint32_t start = sched_time_us();
+    t->run();
+    uint32_t end = sched_time_us();
+
+    uint16_t run = sched_sat16(end - start);
+    uint16_t latency = sched_sat16(start - release);
+    t->runs++;
+    t->last_us = run;
+    if(run > t->wcet_us) t->wcet_us = run;
+    if(latency > t->max_latency_us) t->max_latency_us = latency;
+    if(sched_woke){
+        sched_woke = 0;
+        if(latency > sched_sleep_st.max_wake_us) sched_sleep_st.max_wake_us = latency;
+    }
+    if(t->deadline_us && end - release > t->deadline_us) sched_miss(t);
+}
+
+//Whole ms from now_ms until the first periodic task is due
+static uint16_t sched_next_due(uint32_t now_ms){
+    uint16_t ahead = SCHED_STRETCH_MAX;
+    for(uint8_t i = 0; i < sched_count; i++){
+        const sched_task_t *t = &sched_tasks[i];
+        if(!t->period_ms) continue;
+        int32_t d = (int32_t)(t->next_ms - now_ms);
+        if(d < 1) return 1;
+        if(d < ahead) ahead = (uint16_t)d;
+    }
+    return ahead;
+}
+
+//Move the end of the running tick period to the ms boundary ahead_ms from
+//now, 1 puts it back on the next one. Interrupts off. Left alone when the
+//period is about to end, CCMP could be passed while it is written.
+static void sched_stretch(uint16_t ahead_ms){
+    uint16_t cnt = TCB1.CNT;
+    if(TCB1.INTFLAGS & TCB_CAPT_bm) return;
+    if(cnt + SCHED_STRETCH_MARGIN > sched_tick_ms * SCHED_TICKS_PER_MS - 1) return;
+    uint16_t end = cnt / SCHED_TICKS_PER_MS + ahead_ms;
+    if(end > SCHED_STRETCH_MAX) end = SCHED_STRETCH_MAX;
+    if(cnt + SCHED_STRETCH_MARGIN > end * SCHED_TICKS_PER_MS - 1) end++;
+    if(end > SCHED_STRETCH_MAX) return;
+    TCB1.CCMP = end * SCHED_TICKS_PER_MS - 1;
+    sched_tick_ms = (uint8_t)end;
+}
+
+//Sleep until the next interrupt unless a task is ready or a tick came
+//after now_ms was read. Interrupts stay off from the check to SLEEP, the
+//instruction after SEI always runs first, so a release cannot be missed.
+//STANDBY skips the ticks nothing is due on and pauses what the hooks pause.
+static void sched_idle(uint32_t now_ms){
+    if(sched_sleep == SCHED_SLEEP_OFF) return;
+    uint32_t t0 = sched_time_us();
+    cli();
+    if(sched_now_ms() != now_ms){
+        sei();
+        return;
+    }
+    for(uint8_t i = 0; i < sched_count; i++){
+        if(sched_tasks[i].released){
+            sei();
+            return;
+        }
+    }
+    uint8_t standby = sched_sleep == SCHED_SLEEP_STANDBY &&
+                      (!sched_standby_ok || sched_standby_ok());
+    if(standby){
+        sched_stretch(sched_next_due(now_ms));
+        if(sched_standby_enter) sched_standby_enter();
+    }
+    set_sleep_mode(standby ? SLEEP_MODE_STANDBY : SLEEP_MODE_IDLE);
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();                    //the waking ISR has run by now
+    if(standby){
+        cli();
+        sched_stretch(1);               //woken early: back to 1 ms ticks
+        if(sched_standby_leave) sched_standby_leave();
+        sei();
+    }
+
+    sched_sleep_st.sleeps++;
+    if(standby) sched_sleep_st.standby++;
+    sched_sleep_st.asleep_us += sched_time_us() - t0;
+    sched_woke = 1;
+}
+
+void sched_run(void){
+    for(;;){
+        uint32_t now_ms = sched_ms();
+        uint8_t ran = 0;
+        sched_release_due(now_ms);
+        for(uint8_t i = 0; i < sched_count; i++){
+            if(sched_tasks[i].released){
+                sched_execute(&sched_tasks[i]);
+                ran = 1;
+                break;                  //back to the highest priority task
+            }
+        }
+        if(!ran) sched_idle(now_ms);
+    }
+}
+
+uint8_t sched_set_sleep(uint8_t mode){
+    if(mode >= SCHED_SLEEP_COUNT) return 0;
+    sched_sleep = mode;
+    return 1;
+}
+
+uint8_t sched_sleep_mode(void){
+    return sched_sleep;
+}
+
+void sched_set_standby_check(uint8_t (*ok)(void)){
+    sched_standby_ok = ok;
+}
+
+void sched_set_standby_hooks(void (*enter)(void), void (*leave)(void)){
+    sched_standby_enter = enter;
+    sched_standby_leave = leave;
+}
+
+const sched_sleep_stats_t *sched_sleep_stats(void){
+    return &sched_sleep_st;
+}
+
+uint16_t sched_idle_permille(void){
+    uint32_t elapsed_ms = (sched_time_us() - sched_sleep_st.since_us) / 1000u;
+    if(!elapsed_ms) return 0;
+    uint32_t p = sched_sleep_st.asleep_us / elapsed_ms;
+    return p > 1000 ? 1000 : (uint16_t)p;
+}
+
+uint8_t sched_task_count(void){
+    return sched_count;
+}
+
+const sched_task_t *sched_task(uint8_t id){
+    return &sched_tasks[id];
+}
+
+uint16_t sched_misses(uint8_t id){
+    uint16_t n;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){ n = sched_tasks[id].misses; }
+    return n;
+}
+
+void sched_reset_stats(void){
+    for(uint8_t i = 0; i < sched_count; i++){
+        sched_task_t *t = &sched_tasks[i];
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+            t->runs = 0;
+            t->misses = 0;
+        }
+        t->wcet_us = 0;
+        t->last_us = 0;
+        t->max_latency_us = 0;
+    }
+    sched_sleep_st.sleeps = 0;
+    sched_sleep_st.standby = 0;
+    sched_sleep_st.asleep_us = 0;
+    sched_sleep_st.max_wake_us = 0;
+    sched_sleep_st.since_us = sched_time_us();
+}
@@ -0,0 +1,106 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+//Cooperative scheduler on a 1 kHz TCB1 tick.
+//The task table is static and owned by the application, earlier entries
+//have priority: after every task run the scan starts again at the top.
+//Tasks are periodic (period_ms) or released from an interrupt with
+//sched_release(). Each run is timed so the worst case can be checked
+//against its deadline, which is measured from the release.
+//With nothing ready the CPU sleeps until the next interrupt: the tick,
+//an RX byte, an ADC result or any other source can release a task.
+//In STANDBY the tick period is stretched to the next periodic task, up to
+//8 ms, and put back to 1 ms on any other wake. sched_ms() stays exact.
+
+#define SCHED_TICK_HZ       1000
+
+//Sleep between tasks.
+//IDLE only stops the CPU clock. Everything else runs, so every interrupt
+//wakes it: the 1 kHz tick, each ADC scan result, RX bytes, the servo frame.
+//It saves the CPU core's current and nothing else, wake-up is immediate.
+//STANDBY also stops the peripheral clocks except for RUNSTDBY peripherals
+//(tick, servo PWM, buzzer, LED timer) and USART2 start-of-frame detection.
+//The 16 MHz crystal keeps running for those, so most of the gain over IDLE
+//is fewer wakes: the standby hooks pause the ADC scan and ticks that release
+//nothing are skipped, the CPU wakes for due work and real events only.
+//max_wake_us shows what a wake costs. Only used while the standby check
+//passes, e.g. no TX left to drain.
+enum {
+    SCHED_SLEEP_OFF = 0,        //busy scan, as before
+    SCHED_SLEEP_IDLE,
+    SCHED_SLEEP_STANDBY,
+    SCHED_SLEEP_COUNT
+};
+
+#ifndef SCHED_SLEEP_DEFAULT
+#define SCHED_SLEEP_DEFAULT SCHED_SLEEP_IDLE
+#endif
+
+typedef struct {
+    const char *name;
+    void     (*run)(void);
+    uint16_t period_ms;         //0 = runs only when released
+    uint16_t deadline_us;       //release -> finished, 0 = no deadline
+
+    //filled in by the scheduler
+    volatile uint8_t  released;
+    volatile uint32_t release_us;
+    uint32_t next_ms;
+    uint16_t runs;
+    volatile uint16_t misses;   //finished after the deadline, or released again before it ran
+    uint16_t wcet_us;           //longest run
+    uint16_t last_us;
+    uint16_t max_latency_us;    //longest release -> start
+} sched_task_t;
+
+typedef struct {
+    uint32_t sleeps;
+    uint32_t standby;           //sleeps that went to STANDBY instead of IDLE
+    uint32_t asleep_us;         //since the last reset, wraps with sched_time_us()
+    uint32_t since_us;          //time of the last reset
+    uint16_t max_wake_us;       //longest release -> start of the first task after a wake
+} sched_sleep_stats_t;
+
+void sched_init(sched_task_t *tasks, uint8_t count);
+
+//Never returns
+void sched_run(void);
+
+//Mark a task ready, safe from interrupts
+void sched_release(uint8_t id);
+
+//Same, but a task that is already released is left alone rather than
+//counted as a miss. For sources that fire many times per run (RX bytes,
+//TX space), also from tasks.
+void sched_wake(uint8_t id);
+
+//Change a periodic task's period from a task, 0 stops it.
+//The first run with the new period is due at once.
+void sched_set_period(uint8_t id, uint16_t period_ms);
+
+uint32_t sched_ms(void);
+uint32_t sched_time_us(void);   //wraps after ~71 minutes
+
+uint8_t sched_task_count(void);
+const sched_task_t *sched_task(uint8_t id);
+uint16_t sched_misses(uint8_t id);     //read this rather than misses, interrupts count it too
+void sched_reset_stats(void);          //also the sleep statistics
+
+//0 if mode is not a SCHED_SLEEP_x
+uint8_t sched_set_sleep(uint8_t mode);
+uint8_t sched_sleep_mode(void);
+
+//STANDBY is only entered while ok() returns nonzero, IDLE otherwise.
+//Called with interrupts off just before sleeping.
+void sched_set_standby_check(uint8_t (*ok)(void));
+
+//Called with interrupts off right before STANDBY and right after the wake,
+//for what would otherwise wake the CPU for nothing (the ADC scan). May be NULL.
+void sched_set_standby_hooks(void (*enter)(void), void (*leave)(void));
+
+const sched_sleep_stats_t *sched_sleep_stats(void);
+uint16_t sched_idle_permille(void);    //time asleep since the last reset
+
+#endif
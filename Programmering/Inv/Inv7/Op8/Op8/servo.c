@@ -0,0 +1,108 @@
+#include "servo.h"
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include "pwm.h"
+
+#define SERVO_CAL_MAGIC     0x5C41
+
+typedef struct {
+    uint16_t    magic;
+    servo_cal_t cal[SERVO_COUNT];
+    uint8_t     sum;            //two's complement of the byte sum, whole block sums to 0
+} servo_cal_block_t;
+
+static servo_cal_block_t EEMEM servo_cal_eeprom;
+
+static servo_cal_t servo_cal[SERVO_COUNT];
+static uint16_t servo_table[SERVO_COUNT][181];     //ticks for every whole degree
+static volatile uint16_t servo_ticks[SERVO_COUNT];
+
+static uint8_t servo_cal_sum(const servo_cal_block_t *b){
+    const uint8_t *p = (const uint8_t *)b;
+    uint8_t sum = 0;
+    for(uint8_t i = 0; i < sizeof(*b) - 1; i++) sum += p[i];
+    return (uint8_t)-sum;
+}
+
+static uint8_t servo_cal_valid(const servo_cal_t *c){
+    return c->min >= SERVO_TICKS_LOW && c->max <= SERVO_TICKS_HIGH &&
+           c->min < c->center && c->center < c->max &&
+           (c->dir == 1 || c->dir == -1);
+}
+
+//The only divisions in the servo path, done once per calibration change
+static void servo_table_build(uint8_t ch){
+    const servo_cal_t *c = &servo_cal[ch];
+    for(uint8_t deg = 0; deg <= 180; deg++){
+        uint8_t a = (c->dir < 0) ? 180 - deg : deg;
+        uint16_t t;
+        if(a <= 90) t = c->min + (uint16_t)(((uint32_t)(c->center - c->min) * a + 45) / 90);
+        else        t = c->center + (uint16_t)(((uint32_t)(c->max - c->center) * (a - 90) + 45) / 90);
+        servo_table[ch][deg] = t;
+    }
+}
+
+void servo_init(void){
+    static const servo_cal_t def = SERVO_CAL_DEFAULT;
+    servo_cal_block_t b;
+    eeprom_read_block(&b, &servo_cal_eeprom, sizeof(b));
+    uint8_t ok = (b.magic == SERVO_CAL_MAGIC && b.sum == servo_cal_sum(&b));
+    for(uint8_t i = 0; i < SERVO_COUNT; i++){
+        servo_cal[i] = (ok && servo_cal_valid(&b.cal[i])) ? b.cal[i] : def;
+        servo_table_build(i);
+    }
+    pwm_3_servo_init();
+}
+
+uint16_t servo_angle_to_ticks(uint8_t ch, uint8_t deg){
+    if(deg > 180) deg = 180;
+    return servo_table[ch][deg];
+}
+
+uint16_t servo_cdeg_to_ticks(uint8_t ch, uint16_t cdeg){
+    if(cdeg > 18000) cdeg = 18000;
+    //centidegrees -> degrees in Q8: * 256/100 = * 5243/2048
+    uint32_t q8 = ((uint32_t)cdeg * 5243u) >> 11;
+    uint8_t deg = (uint8_t)(q8 >> 8);
+    uint8_t frac = (uint8_t)q8;
+    const uint16_t *t = servo_table[ch];
+    if(deg >= 180) return t[180];
+    int16_t span = (int16_t)(t[deg + 1] - t[deg]);     //negative for dir = -1
+    return (uint16_t)(t[deg] + (int16_t)(((int32_t)span * frac) >> 8));
+}
+
+void servo_write(const uint16_t ticks[SERVO_COUNT]){
+    for(uint8_t i = 0; i < SERVO_COUNT; i++) servo_ticks[i] = ticks[i];
+    pwm_3_servo_set_pos(ticks[0], ticks[1], ticks[2]);
+}
+
+void servo_set_multi(const uint8_t *deg, uint8_t n){
+    uint16_t ticks[SERVO_COUNT];
+    for(uint8_t i = 0; i < SERVO_COUNT; i++){
+        ticks[i] = (i < n) ? servo_angle_to_ticks(i, deg[i]) : servo_ticks[i];
+    }
+    servo_write(ticks);
+}
+
+uint16_t servo_get(uint8_t ch){
+    return servo_ticks[ch];
+}
+
+uint8_t servo_cal_set(uint8_t ch, const servo_cal_t *cal){
+    if(ch >= SERVO_COUNT || !servo_cal_valid(cal)) return 0;
+    servo_cal[ch] = *cal;
+    servo_table_build(ch);
+    return 1;
+}
+
+void servo_cal_get(uint8_t ch, servo_cal_t *cal){
+    *cal = servo_cal[ch];
+}
+
+void servo_cal_save(void){
+    servo_cal_block_t b;
+    b.magic = SERVO_CAL_MAGIC;
+    for(uint8_t i = 0; i < SERVO_COUNT; i++) b.cal[i] = servo_cal[i];
+    b.sum = servo_cal_sum(&b);
+    eeprom_update_block(&b, &servo_cal_eeprom, sizeof(b));     //only rewrites changed bytes
+}
@@ -0,0 +1,47 @@
+#ifndef SERVO_H
+#define SERVO_H
+
+#include <stdint.h>
+
+//Servo outputs on TCA0 CMP0..CMP2 (PE0..PE2), 50 Hz
+//16MHz / DIV8 = 2MHz timer clock, 1000..5000 ticks = 0.5..2.5 ms
+#define SERVO_COUNT         3
+#define SERVO_FRAME_MS      20
+
+//Per-channel calibration, kept in EEPROM.
+//0 deg -> min, 90 deg -> center, 180 deg -> max, dir = -1 mirrors the servo.
+//min/max are also the hard travel limits of the channel.
+typedef struct {
+    uint16_t min;
+    uint16_t center;
+    uint16_t max;
+    int8_t   dir;
+} servo_cal_t;
+
+#define SERVO_CAL_DEFAULT   { 1000, 3000, 5000, 1 }
+#define SERVO_TICKS_LOW     500         //sanity range for calibration values, 0.25..2.75 ms
+#define SERVO_TICKS_HIGH    5500
+
+//Loads calibration from EEPROM (defaults if it is blank or corrupt) and builds the tables
+void servo_init(void);
+
+//Table lookups, no division
+uint16_t servo_angle_to_ticks(uint8_t ch, uint8_t deg);
+uint16_t servo_cdeg_to_ticks(uint8_t ch, uint16_t cdeg);    //0..18000 centidegrees, for IK output
+
+//Write all channels, they latch together on the next PWM period
+void servo_write(const uint16_t ticks[SERVO_COUNT]);
+
+//Set the first n channels to deg[], the others keep their position
+void servo_set_multi(const uint8_t *deg, uint8_t n);
+
+//Last written position, 0 if the channel was never set
+uint16_t servo_get(uint8_t ch);
+
+//Calibration, servo_cal_set() rebuilds the channel table but only
+//servo_cal_save() makes it survive a reset
+uint8_t servo_cal_set(uint8_t ch, const servo_cal_t *cal);  //0 if cal is not valid
+void servo_cal_get(uint8_t ch, servo_cal_t *cal);
+void servo_cal_save(void);
+
+#endif
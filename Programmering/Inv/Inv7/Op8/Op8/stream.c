@@ -0,0 +1,156 @@
+#include "stream.h"
+#include <avr/io.h>
+#include "adc.h"
+#include "servo.h"
+#include "sched.h"
+#include "proto.h"
+#include "usart.h"
+#include "command.h"
+#include "reply.h"
+#include "hx711.h"
+#include "led.h"
+#include "flight.h"
+
+#define STREAM_FIELDS_MAX   (ADC_CH_COUNT + 2 + SERVO_COUNT + 1 + HX711_CH_COUNT)
+
+//Longest "TLM:" line: seq, t_us, mask, every field at up to 6 chars, separators
+#define STREAM_ASCII_MAX    (4 + 5 + 1 + 10 + 1 + 2 + STREAM_FIELDS_MAX * 7 + 1)
+
+static uint8_t stream_task_id;
+static uint16_t stream_period_ms = 0;
+static uint8_t stream_fields = 0;
+static uint16_t stream_seq = 0;
+static uint16_t stream_skips = 0;
+
+static void stream_skip(void){
+    stream_skips++;
+    flight_log(FLIGHT_EVENT, PROTO_EVT_STREAM, PROTO_ERR_FULL, &stream_seq, 2, sched_time_us(), 0);
+}
+
+void stream_init(uint8_t task){
+    stream_task_id = task;
+}
+
+uint8_t stream_set(uint16_t rate_hz, uint8_t mask){
+    if(rate_hz > STREAM_RATE_MAX || (mask & ~STREAM_ALL)) return 0;
+    if(rate_hz && !mask) return 0;
+    stream_period_ms = rate_hz ? (uint16_t)((1000u + rate_hz / 2) / rate_hz) : 0;
+    stream_fields = rate_hz ? mask : 0;
+    stream_seq = 0;
+    stream_skips = 0;
+    sched_set_period(stream_task_id, stream_period_ms);
+    return 1;
+}
+
+uint16_t stream_rate(void){
+    return stream_period_ms ? (uint16_t)(1000u / stream_period_ms) : 0;
+}
+
+uint8_t stream_mask(void){
+    return stream_fields;
+}
+
+uint16_t stream_skipped(void){
+    return stream_skips;
+}
+
+//Sample everything selected at one instant, in mask bit order.
+//is_signed / is_byte get a bit per field that is sent as i16 / u8.
+typedef struct {
+    uint16_t v[STREAM_FIELDS_MAX];
+    uint16_t is_signed;
+    uint16_t is_byte;
+    uint8_t  n;
+} stream_sample_t;
+
+static void stream_add(stream_sample_t *s, uint16_t v, uint8_t is_signed, uint8_t is_byte){
+    if(is_signed) s->is_signed |= (uint16_t)(1u << s->n);
+    if(is_byte) s->is_byte |= (uint16_t)(1u << s->n);
+    s->v[s->n++] = v;
+}
+
+static void stream_sample(stream_sample_t *s){
+    s->n = 0;
+    s->is_signed = 0;
+    s->is_byte = 0;
+    if(stream_fields & STREAM_ADC){
+        for(uint8_t ch = 0; ch < ADC_CH_COUNT; ch++) stream_add(s, adc_scan_get(ch), 0, 0);
+    }
+    if(stream_fields & STREAM_TEMP){
+        stream_add(s, (uint16_t)tmp235_C_from_mV(adc_to_mV_2048(adc_scan_get12(ADC_CH_TMP))), 1, 0);
+        stream_add(s, (uint16_t)adc_itemp_C(adc_scan_get12(ADC_CH_ITEMP)), 1, 0);
+    }
+    if(stream_fields & STREAM_SERVO){
+        for(uint8_t ch = 0; ch < SERVO_COUNT; ch++) stream_add(s, servo_get(ch), 0, 0);
+    }
+    if(stream_fields & STREAM_LED){
+        stream_add(s, led_lit(), 0, 1);
+    }
+    if(stream_fields & STREAM_WEIGHT){
+        for(uint8_t ch = 0; ch < HX711_CH_COUNT; ch++) stream_add(s, (uint16_t)hx711_weight(ch), 1, 0);
+    }
+}
+
+static void stream_send_binary(uint32_t t, const stream_sample_t *s){
+    uint8_t payload[PROTO_MAX_PAYLOAD];
+    uint8_t frame[PROTO_MAX_FRAME];
+    uint8_t len = 0;
+    payload[len++] = PROTO_EVT_STREAM;
+    proto_put_u16(payload + len, stream_seq);
+    proto_put_u16(payload + len + 2, (uint16_t)t);
+    proto_put_u16(payload + len + 4, (uint16_t)(t >> 16));
+    len += 6;
+    payload[len++] = stream_fields;
+    for(uint8_t i = 0; i < s->n; i++){
+        if(s->is_byte & (1u << i)){
+            payload[len++] = (uint8_t)s->v[i];
+        } else {
+            proto_put_u16(payload + len, s->v[i]);
+            len += 2;
+        }
+    }
+
+    len = proto_encode(frame, PROTO_OP_EVENT, payload, len);
+    if(usart2_tx_free() < len){
+        stream_skip();
+        return;
+    }
+    for(uint8_t i = 0; i < len; i++) usart2_putc((char)frame[i]);
+}
+
+static void stream_send_ascii(uint32_t t, const stream_sample_t *s){
+    if(usart2_tx_free() < STREAM_ASCII_MAX){
+        stream_skip();
+        return;
+    }
+    reply_str("TLM:");
+    reply_u16(stream_seq);
+    reply_char(',');
+    reply_u32(t);
+    reply_char(',');
+    reply_u16(stream_fields);
+    for(uint8_t i = 0; i < s->n; i++){
+        reply_char(',');
+        if(s->is_signed & (1u << i)){
+            reply_i16((int16_t)s->v[i]);
+        } else {
+            reply_u16(s->v[i]);
+        }
+    }
+    reply_end();
+}
+
+void stream_task(void){
+    stream_sample_t s;
+    if(!stream_fields) return;
+    uint32_t t = sched_time_us();
+    stream_sample(&s);
+    if(command_tx_held()){
+        stream_skip();                      //a TLM line would land inside the dump
+    } else if(command_binary_mode()){
+        stream_send_binary(t, &s);
+    } else {
+        stream_send_ascii(t, &s);
+    }
+    stream_seq++;
+}
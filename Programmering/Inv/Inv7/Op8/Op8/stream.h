@@ -0,0 +1,37 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+
+//Telemetry stream: the board pushes the selected values at a fixed rate
+//instead of the host asking for each one. Sent by its own scheduler task.
+//
+//  binary: PROTO_OP_EVENT { PROTO_EVT_STREAM, u16 seq, u32 t_us, u8 mask, fields }
+//  ASCII:  "TLM:seq,t_us,mask,fields..." comma separated
+//
+//Fields follow in mask bit order. A frame that does not fit in the TX
+//ring, or falls during an ASCII DUMP, is skipped rather than blocking,
+//the host sees a gap in seq.
+
+#define STREAM_ADC      0x01    //u16 per ADC scan channel, raw at the OVS resolution
+#define STREAM_TEMP     0x02    //i16 TMP235 deg C, i16 internal sensor deg C
+#define STREAM_SERVO    0x04    //u16 PWM ticks per servo channel
+#define STREAM_LED      0x08    //u8, bit n = LED n lit
+#define STREAM_WEIGHT   0x10    //i16 per load cell, 0.1 g (hx711.h), 0 while not valid
+#define STREAM_ALL      0x1F
+
+#define STREAM_RATE_MAX 1000    //Hz, one frame per scheduler tick
+
+//task is the scheduler id of the task that runs stream_task()
+void stream_init(uint8_t task);
+
+//rate 0 stops. Returns 0 for a bad rate or mask, the real rate is
+//1000 / round(1000 / rate_hz), see stream_rate().
+uint8_t stream_set(uint16_t rate_hz, uint8_t mask);
+uint16_t stream_rate(void);
+uint8_t stream_mask(void);
+uint16_t stream_skipped(void);          //frames dropped for lack of TX space
+
+void stream_task(void);
+
+#endif
@@ -1,35 +1,300 @@
 #include "usart.h"
+#include "ringbuf.h"
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "prof.h"
+#include "sched.h"
+
+static uint8_t usart2_rx_buf[USART2_RX_SIZE];
+static ringbuf_t usart2_rx = RINGBUF_INIT(usart2_rx_buf);
+static volatile uint16_t usart2_rx_drops = 0;
+static volatile uint16_t usart2_rx_ovf = 0;
+static uint8_t usart2_rx_task;
+
+//One TX queue per port, drained by that port's DRE interrupt
+typedef struct {
+    USART_t   *usart;
+    ringbuf_t  ring;
+    uint8_t    policy;
+    volatile uint8_t sending;   //a byte went to TXDATAL since the last flush
+    uint16_t   dropped;
+    uint8_t    wake_task;
+    volatile uint8_t wake_free; //release wake_task once this much is free, 0 = off
+} usart_tx_t;
+
+static uint8_t usart2_tx_buf[USART2_TX_SIZE];
+static uint8_t usart3_tx_buf[USART3_TX_SIZE];
+static usart_tx_t usart2_tx = { &USART2, RINGBUF_INIT(usart2_tx_buf), USART2_TX_POLICY, 0, 0, 0, 0 };
+static usart_tx_t usart3_tx = { &USART3, RINGBUF_INIT(usart3_tx_buf), USART3_TX_POLICY, 0, 0, 0, 0 };
+
+//Rates "BAUD:n" can pick, each one is checked at compile time
+#define USART2_BAUD_LIST(X) \
+    X(9600) X(19200) X(38400) X(57600) X(115200) X(230400) X(250000) \
+    X(460800) X(500000) X(921600) X(1000000) X(1500000) X(2000000)
+
+USART_BAUD_CHECK(USART2_BAUD)
+USART_BAUD_CHECK(USART3_BAUD)
+USART2_BAUD_LIST(USART_BAUD_CHECK)
+
+typedef struct {
+    uint32_t baud;
+    uint16_t reg;
+    uint8_t  clk2x;
+} usart_baud_t;
+
+#define USART_BAUD_ENTRY(baud) { baud, USART_BAUD_VAL(baud), USART_BAUD_CLK2X(baud) },
+static const usart_baud_t usart2_bauds[] = { USART2_BAUD_LIST(USART_BAUD_ENTRY) };
+#define USART2_BAUD_COUNT (sizeof(usart2_bauds) / sizeof(usart2_bauds[0]))
+
+static uint32_t usart2_rate = USART2_BAUD;
+
+static void usart_tx_write(usart_tx_t *tx, uint8_t c){
+    tx->usart->STATUS = USART_TXCIF_bm;     //TXCIF now means "this byte is out"
+    tx->usart->TXDATAL = c;
+    tx->sending = 1;
+}
+
+static uint8_t usart_tx_put(usart_tx_t *tx, uint8_t c){
+    while(!ringbuf_put(&tx->ring, c)){
+        if(tx->policy == USART_TX_DROP){
+            tx->dropped++;
+            return 0;
+        }
+        if(!(SREG & CPU_I_bm)){
+            //interrupts are off (called from an ISR), the DRE ISR cannot run: drain one byte by hand
+            while(!(tx->usart->STATUS & USART_DREIF_bm)){}
+            usart_tx_write(tx, (uint8_t)ringbuf_get(&tx->ring));
+        }
+    }
+    tx->usart->CTRLA |= USART_DREIE_bm;     //(re)start draining
+    return 1;
+}
+
+static void usart_tx_isr(usart_tx_t *tx){
+    int16_t c = ringbuf_get(&tx->ring);
+    if(c < 0){
+        tx->usart->CTRLA &= ~USART_DREIE_bm;    //ring empty, stop until the next put
+    } else {
+        usart_tx_write(tx, (uint8_t)c);
+    }
+    if(tx->wake_free && ringbuf_free(&tx->ring) >= tx->wake_free){
+        tx->wake_free = 0;
+        sched_wake(tx->wake_task);
+    }
+}
+
+static void usart_tx_flush(usart_tx_t *tx){
+    while(ringbuf_count(&tx->ring)){}
+    while(tx->usart->CTRLA & USART_DREIE_bm){}  //last byte handed to the USART
+    if(tx->sending){
+        while(!(tx->usart->STATUS & USART_TXCIF_bm)){}
+        tx->sending = 0;
+    }
+}
+
+//Nothing queued and the last byte has left the shift register
+static uint8_t usart_tx_done(const usart_tx_t *tx){
+    return !ringbuf_count(&tx->ring) && !(tx->usart->CTRLA & USART_DREIE_bm) &&
+           (!tx->sending || (tx->usart->STATUS & USART_TXCIF_bm));
+}
+
+static uint16_t usart_tx_dropped(const usart_tx_t *tx){
+    uint16_t n;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){ n = tx->dropped; }
+    return n;
+}
 
 //USART3 PC terminal
 static int usart3_putchar(char c, FILE *stream){
-    while(!(USART3.STATUS & USART_DREIF_bm)){}
-    USART3.TXDATAL = c;
+    usart_tx_put(&usart3_tx, c);
     return 0;
 }
 
 // USART2 RPI
 static int usart2_putchar(char c, FILE *stream){
-    while(!(USART2.STATUS & USART_DREIF_bm)){}
-    USART2.TXDATAL = c;
+    usart_tx_put(&usart2_tx, c);
     return 0;
 }
 
 FILE usart3_stdout = FDEV_SETUP_STREAM(usart3_putchar, NULL, _FDEV_SETUP_WRITE);
 FILE usart2_stdout = FDEV_SETUP_STREAM(usart2_putchar, NULL, _FDEV_SETUP_WRITE);
 
-void usart_init(void){
+void usart_init(uint8_t rx_task){
+    usart2_rx_task = rx_task;
+
     // USART3 - PORTB PC terminal
-    USART3.BAUD  = 1667;
-    USART3.CTRLB = USART_TXEN_bm;
-    PORTB.DIRSET = PIN0_bm; 
+    USART3.BAUD  = USART_BAUD_VAL(USART3_BAUD);
+    USART3.CTRLB = USART_TXEN_bm | (USART_BAUD_CLK2X(USART3_BAUD) ? USART_RXMODE_CLK2X_gc : USART_RXMODE_NORMAL_gc);
+    PORTB.DIRSET = PIN0_bm;
 
     // USART2 - PORTF RPI
     PORTMUX.USARTROUTEA = PORTMUX_USART2_ALT1_gc;
-    USART2.BAUD  = 1667;
-    USART2.CTRLB = USART_TXEN_bm | USART_RXEN_bm;
+    USART2.BAUD  = USART_BAUD_VAL(USART2_BAUD);
+    USART2.CTRLA = USART_RXCIE_bm;      //receive complete interrupt feeds the ring
+    USART2.CTRLB = USART_TXEN_bm | USART_RXEN_bm | USART_SFDEN_bm |     //a start bit wakes from standby
+                   (USART_BAUD_CLK2X(USART2_BAUD) ? USART_RXMODE_CLK2X_gc : USART_RXMODE_NORMAL_gc);
     PORTF.DIRSET = PIN4_bm;
-    PORTF.DIRCLR = PIN5_bm;    
+    PORTF.DIRCLR = PIN5_bm;
 
     stdout = &usart3_stdout;
 }
+
+static const usart_baud_t *usart2_find_baud(uint32_t baud){
+    for(uint8_t i = 0; i < USART2_BAUD_COUNT; i++){
+        if(usart2_bauds[i].baud == baud) return &usart2_bauds[i];
+    }
+    return NULL;
+}
+
+uint8_t usart2_baud_supported(uint32_t baud){
+    return usart2_find_baud(baud) != NULL;
+}
+
+uint8_t usart2_set_baud(uint32_t baud){
+    const usart_baud_t *b = usart2_find_baud(baud);
+    if(b == NULL) return 0;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        USART2.BAUD = b->reg;
+        USART2.CTRLB = USART_TXEN_bm | USART_RXEN_bm | USART_SFDEN_bm |
+                       (b->clk2x ? USART_RXMODE_CLK2X_gc : USART_RXMODE_NORMAL_gc);
+        while(ringbuf_get(&usart2_rx) >= 0){}  //bytes around the switch are garbage
+    }
+    usart2_rate = baud;
+    return 1;
+}
+
+uint32_t usart2_baud(void){
+    return usart2_rate;
+}
+
+ISR(USART2_DRE_vect){
+    usart_tx_isr(&usart2_tx);
+}
+
+ISR(USART3_DRE_vect){
+    usart_tx_isr(&usart3_tx);
+}
+
+uint8_t usart2_putc(char c){
+    return usart_tx_put(&usart2_tx, c);
+}
+
+uint8_t usart3_putc(char c){
+    return usart_tx_put(&usart3_tx, c);
+}
+
+void usart2_puts(const char *s){
+    while(*s) usart_tx_put(&usart2_tx, *s++);
+}
+
+void usart3_puts(const char *s){
+    while(*s) usart_tx_put(&usart3_tx, *s++);
+}
+
+void usart2_tx_flush(void){
+    usart_tx_flush(&usart2_tx);
+}
+
+void usart3_tx_flush(void){
+    usart_tx_flush(&usart3_tx);
+}
+
+void usart2_tx_wake(uint8_t task, uint8_t n){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        if(ringbuf_free(&usart2_tx.ring) >= n){
+            usart2_tx.wake_free = 0;
+            sched_wake(task);           //the DRE interrupt may already have stopped
+        } else {
+            usart2_tx.wake_task = task;
+            usart2_tx.wake_free = n;
+        }
+    }
+}
+
+uint8_t usart2_tx_idle(void){
+    return usart_tx_done(&usart2_tx);
+}
+
+uint8_t usart_tx_idle(void){
+    return usart_tx_done(&usart2_tx) && usart_tx_done(&usart3_tx);
+}
+
+uint8_t usart2_tx_free(void){
+    return ringbuf_free(&usart2_tx.ring);
+}
+
+void usart2_set_tx_policy(uint8_t policy){
+    usart2_tx.policy = policy;
+}
+
+void usart3_set_tx_policy(uint8_t policy){
+    usart3_tx.policy = policy;
+}
+
+uint16_t usart2_tx_dropped(void){
+    return usart_tx_dropped(&usart2_tx);
+}
+
+uint16_t usart3_tx_dropped(void){
+    return usart_tx_dropped(&usart3_tx);
+}
+
+//Every received byte goes straight into the ring and wakes the RX task
+ISR(USART2_RXC_vect){
+    PROF_ENTER(PROF_USART_RX_ISR);
+    uint8_t status = USART2.RXDATAH;    //must be read before RXDATAL
+    uint8_t c = USART2.RXDATAL;
+    if(status & USART_BUFOVF_bm) usart2_rx_ovf++;
+    if(!ringbuf_put(&usart2_rx, c)) usart2_rx_drops++;
+    sched_wake(usart2_rx_task);
+    PROF_EXIT(PROF_USART_RX_ISR);
+}
+
+int16_t usart2_getc(void){
+    return ringbuf_get(&usart2_rx);
+}
+
+uint8_t usart2_rx_count(void){
+    return ringbuf_count(&usart2_rx);
+}
+
+uint16_t usart2_rx_dropped(void){
+    uint16_t n;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){ n = usart2_rx_drops; }
+    return n;
+}
+
+uint16_t usart2_rx_overruns(void){
+    uint16_t n;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){ n = usart2_rx_ovf; }
+    return n;
+}
+
+uint8_t usart_line_feed(usart_line_t *line, char c){
+    if(line->complete){                 //previous line has been consumed
+        line->len = 0;
+        line->complete = 0;
+        line->overflow = 0;
+    }
+    if(c == '\n' || c == '\r'){
+        if(line->len == 0 && !line->overflow) return 0;    //skip empty lines, e.g. "\r\n"
+        line->buf[line->len] = '\0';
+        line->complete = 1;
+        return 1;
+    }
+    if(line->len < USART_LINE_MAX - 1){
+        line->buf[line->len++] = c;
+    } else {
+        line->overflow = 1;             //keep the head, drop the rest
+    }
+    return 0;
+}
+
+uint8_t usart2_poll_line(usart_line_t *line){
+    int16_t c;
+    while((c = usart2_getc()) >= 0){
+        if(usart_line_feed(line, (char)c)) return 1;
+    }
+    return 0;
+}
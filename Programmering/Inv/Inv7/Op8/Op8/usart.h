@@ -1,10 +1,108 @@
 #ifndef USART_H
 #define USART_H
 #include <stdio.h>
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+//Baud rates are worked out by the preprocessor. BAUD is 64 * F_CPU / (S * baud),
+//the low 6 bits are a fraction, S = 16 samples per bit or 8 with CLK2X.
+//CLK2X only where S = 16 would need BAUD < 64, it halves the receiver's
+//noise margin. Error is the real rate against the asked one in 0.01 %.
+#define USART_BAUD_CLK2X(baud)  ((baud) > F_CPU / 16)
+#define USART_BAUD_K(baud)      (USART_BAUD_CLK2X(baud) ? 8ull * F_CPU : 4ull * F_CPU)
+#define USART_BAUD_RAW(baud)    ((USART_BAUD_K(baud) + (baud) / 2) / (baud))
+#define USART_BAUD_VAL(baud)    ((uint16_t)USART_BAUD_RAW(baud))
+#define USART_BAUD_ERR(baud)    ((int32_t)(((long long)USART_BAUD_K(baud) - (long long)USART_BAUD_RAW(baud) * (baud)) \
+                                           * 10000 / ((long long)USART_BAUD_RAW(baud) * (baud))))
+
+#define USART_BAUD_ERR_MAX      200     //2.0 %, leaves the other end some margin
+#define USART_BAUD_ERR_MAX_2X   150     //1.5 % with 8 samples per bit
+
+#define USART_BAUD_OK(baud)     (USART_BAUD_RAW(baud) >= 64 && USART_BAUD_RAW(baud) <= 0xFFFF && \
+                                 USART_BAUD_ERR(baud) <= (USART_BAUD_CLK2X(baud) ? USART_BAUD_ERR_MAX_2X : USART_BAUD_ERR_MAX) && \
+                                 -USART_BAUD_ERR(baud) <= (USART_BAUD_CLK2X(baud) ? USART_BAUD_ERR_MAX_2X : USART_BAUD_ERR_MAX))
+
+#define USART_BAUD_CHECK(baud)  _Static_assert(USART_BAUD_OK(baud), "baud " #baud " not reachable from F_CPU");
+
+#ifndef USART2_BAUD
+#define USART2_BAUD     38400   //RPi link after reset, "BAUD:n" changes it at runtime
+#endif
+#ifndef USART3_BAUD
+#define USART3_BAUD     38400   //debug terminal
+#endif
+
+#define USART2_RX_SIZE  128     //power of two, holds ~130 ms of input at 38400 baud
+#define USART2_TX_SIZE  128     //replies to the RPi
+#define USART3_TX_SIZE  256     //debug terminal
+#define USART_LINE_MAX  32
+
+//What a writer does when its TX ring is full
+#define USART_TX_DROP   0       //discard the byte and count it
+#define USART_TX_BLOCK  1       //wait for the DRE interrupt to make room
+
+#ifndef USART2_TX_POLICY
+#define USART2_TX_POLICY USART_TX_BLOCK     //RPi replies must not be lost
+#endif
+#ifndef USART3_TX_POLICY
+#define USART3_TX_POLICY USART_TX_DROP      //debug echo must never stall commands
+#endif
 
 extern FILE usart2_stdout;
 extern FILE usart3_stdout;
 
-void usart_init(void);
+//Line assembly state, owned by the caller
+typedef struct {
+    char    buf[USART_LINE_MAX];
+    uint8_t len;
+    uint8_t complete;           //buf holds a finished line
+    uint8_t overflow;           //line was longer than USART_LINE_MAX-1 and got truncated
+} usart_line_t;
+
+//rx_task is the scheduler task that drains USART2 RX, released by each byte
+void usart_init(uint8_t rx_task);
+
+//Move USART2 to another rate from the table in usart.c and throw away
+//anything received so far. 0 if baud is not listed. Does not wait: call it
+//once usart2_tx_idle(), a byte still on the wire would be cut.
+uint8_t usart2_set_baud(uint32_t baud);
+uint8_t usart2_baud_supported(uint32_t baud);
+uint32_t usart2_baud(void);
+
+//Transmit, queued and drained by the DRE interrupt.
+//usart2_stdout/usart3_stdout go through the same rings.
+uint8_t usart2_putc(char c);                    //0 if the byte was dropped
+uint8_t usart3_putc(char c);
+void usart2_puts(const char *s);
+void usart3_puts(const char *s);
+void usart2_tx_flush(void);                     //block until everything has left the wire
+void usart3_tx_flush(void);
+uint8_t usart2_tx_free(void);                   //bytes that fit without waiting
+uint8_t usart2_tx_idle(void);                   //USART2 ring empty and the last byte on the wire
+
+//Release a scheduler task from the DRE interrupt once n bytes of the USART2
+//TX ring are free, at once if they already are. For output that is queued
+//as the ring drains (BURST, DUMP), it keeps the link busy without polling.
+//One request at a time, the latest wins.
+void usart2_tx_wake(uint8_t task, uint8_t n);
+uint8_t usart_tx_idle(void);                    //both TX rings empty and on the wire, standby is safe
+void usart2_set_tx_policy(uint8_t policy);
+void usart3_set_tx_policy(uint8_t policy);
+uint16_t usart2_tx_dropped(void);
+uint16_t usart3_tx_dropped(void);
+
+//USART2 (RPi) receive, filled by the RXC interrupt
+int16_t usart2_getc(void);                      //-1 if nothing received
+uint8_t usart2_rx_count(void);
+uint16_t usart2_rx_dropped(void);               //bytes lost because the ring was full
+uint16_t usart2_rx_overruns(void);              //bytes lost in the USART itself (BUFOVF)
+
+//Feed one character, returns 1 when '\n' or '\r' finished a non-empty line
+uint8_t usart_line_feed(usart_line_t *line, char c);
+
+//Non-blocking: drain received bytes into line, returns 1 when a line is ready
+uint8_t usart2_poll_line(usart_line_t *line);
 
-#endif
\ No newline at end of file
+#endif
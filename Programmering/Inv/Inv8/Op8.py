@@ -3,36 +3,137 @@ from tkinter import ttk
 import serial
 import threading
 import time
+from concurrent.futures import Future
 
 #Serieport
 PORT  = '/dev/ttyAMA0'
-BAUD  = 38400
+BAUD  = 38400           #kortet starter alltid på denne
+FAST_BAUD = 500000      #forsøkes etter tilkobling, 38400 beholdes hvis det feiler
 
 ser = None
+client = None
+
+import proto
+from client import Client
+
+#Hendelser fra kortet ("EVT:ch,utenfor,verdi") og telemetri ("TLM:...")
+#kommer uten at vi spør, også midt mellom en kommando og svaret.
+#Klientens lesetråd sender dem hit.
+_event_handlers = []
+_tlm_handlers = []
+
+def on_event(fn):
+    _event_handlers.append(fn)
+
+def on_telemetry(fn):
+    _tlm_handlers.append(fn)
+
+def _handle_tlm(line: str):
+    try:
+        frame = proto.parse_tlm(line)
+    except (ValueError, IndexError):
+        log(f"[FEIL] Ugyldig telemetri: {line}")
+        return
+    for fn in _tlm_handlers:
+        fn(frame)
+
+def _handle_event(line: str):
+    try:
+        ch, outside, value = (int(v) for v in line[4:].split(","))
+    except ValueError:
+        log(f"[FEIL] Ugyldig hendelse: {line}")
+        return
+    for fn in _event_handlers:
+        fn(ch, bool(outside), value)
 
 def connect_serial():
-    global ser
+    global ser, client
     try:
-        ser = serial.Serial(PORT, BAUD, timeout=2)
+        ser = serial.Serial(PORT, BAUD, timeout=2, exclusive=True)   #én eier av linken
         time.sleep(0.5)
         log(f"Tilkoblet {PORT} @ {BAUD}")
     except Exception as e:
         log(f"[FEIL] Kan ikke åpne {PORT}: {e}")
-
-def send_command(cmd: str) -> str:
-    #Send en kommando og returner svaret.
-    if ser is None or not ser.is_open:
-        log(f"[IKKE TILKOBLET] {cmd}")
-        return ""
+        return
+    client = Client(ser)
+    client.subscribe("EVT:", _handle_event)
+    client.subscribe("TLM:", _handle_tlm)
+    client.on_lost = _link_lost
+    if FAST_BAUD != BAUD:
+        set_link_baud(FAST_BAUD)
+
+def _link_lost():
+    #Ingen PONG. Har kortet startet på nytt, går det på BAUD igjen: prøv den,
+    #og forhandl opp igjen når den svarer. Kalles fra lesetråden, så
+    #forhandlingen (som venter på svar) får sin egen tråd.
+    if ser.baudrate == BAUD:
+        return
+    log(f"[FEIL] Ingen PONG på {ser.baudrate}, prøver {BAUD}")
+    ser.baudrate = BAUD
+
+    def done(f):
+        try:
+            ok = f.result() == "PONG"
+        except Exception:
+            return
+        if not ok:
+            return
+        log(f"Svar på {BAUD}, kortet har trolig startet på nytt")
+        if FAST_BAUD != BAUD:
+            threading.Thread(target=set_link_baud, args=(FAST_BAUD,), daemon=True).start()
+    client.resync().add_done_callback(done)
+
+def set_link_baud(baud: int) -> bool:
+    #Kortet svarer på gammel hastighet og venter 1 s på PING på den nye,
+    #uten PING går det tilbake. Vi gir opp litt før, så begge ender havner likt.
+    #Kalles når ingen andre kommandoer er ute.
+    old = ser.baudrate
     try:
-        ser.write((cmd + '\n').encode())
-        response = ser.readline().decode().strip()
+        if send_async(f"BAUD:{baud}").result(2) != f"OK:{baud}":
+            return False
+    except Exception:
+        return False
+    ser.baudrate = baud
+    ok = False
+    deadline = time.monotonic() + 0.7
+    while not ok and time.monotonic() < deadline:
+        try:
+            ok = client.resync().result(0.1) == "PONG"  #ny PING for hvert forsøk
+        except Exception:
+            pass
+    if not ok:
+        ser.baudrate = old
+        time.sleep(0.4)                 #til kortet har gått tilbake
+        ser.reset_input_buffer()
+        client.resync()
+    log(f"Hastighet {baud}: {'OK' if ok else 'feilet, beholder ' + str(old)}")
+    return ok
+
+def send_async(cmd: str) -> Future:
+    #Send en kommando uten å vente, futuren får svaret ("" ved feil).
+    #Flere kommandoer kan være ute samtidig, svarene kommer i rekkefølge.
+    fut = Future()
+    if client is None:
+        log(f"[IKKE TILKOBLET] {cmd}")
+        fut.set_result("")
+        return fut
+
+    def done(f):
+        try:
+            response = f.result()
+        except Exception as e:
+            log(f"[FEIL] {cmd}: {e!r}")
+            fut.set_result("")
+            return
         log(f">>> {cmd}   <<< {response}")
-        return response
-    except Exception as e:
-        log(f"[FEIL] {e}")
-        return ""
+        fut.set_result(response)
+
+    client.request(cmd).add_done_callback(done)
+    return fut
 
+def on_reply(fut: Future, widget, fn):
+    #Kall fn(svar) i Tk-tråden når svaret er kommet
+    fut.add_done_callback(lambda f: widget.after(0, fn, f.result()))
 
 #LED
 class LED:
@@ -46,32 +147,36 @@ class LED:
     def state(self) -> bool:
         return self._state
 
-    def turn_on(self):
-        if not self._state:
-            resp = send_command(f"LED:{self.index}")
-            if resp == "OK":
-                self._state = True
-
-    def turn_off(self):
-        if self._state:
-            resp = send_command(f"LED:{self.index}")
-            if resp == "OK":
-                self._state = False
-
-    def toggle(self):
-        if self._state:
-            self.turn_off()
-        else:
-            self.turn_on()
+    def _set(self, on: bool) -> Future:
+        #LED:n bytter LED-en. Tilstanden settes med en gang så flere
+        #kommandoer kan være ute, og rulles tilbake hvis kortet ikke svarer OK.
+        if self._state == on:
+            fut = Future()
+            fut.set_result("OK")
+            return fut
+        self._state = on
+        fut = send_async(f"LED:{self.index}")
+
+        def done(f):
+            if f.result() != "OK":
+                self._state = not on
+        fut.add_done_callback(done)
+        return fut
+
+    def turn_on(self) -> Future:
+        return self._set(True)
 
+    def turn_off(self) -> Future:
+        return self._set(False)
 
-#Hjelper: tråd for polling
+    def toggle(self) -> Future:
+        return self._set(not self._state)
+
+
+#Hjelper: sensoravlesning
 def poll_sensor(cmd: str, label: tk.Label, prefix: str):
-    #Spør om sensor i bakgrunnstråd og oppdater label.
-    def task():
-        resp = send_command(cmd)
-        label.config(text=f"{prefix}{resp}")
-    threading.Thread(target=task, daemon=True).start()
+    #Spør om sensor og oppdater label når svaret kommer.
+    on_reply(send_async(cmd), label, lambda resp: label.config(text=f"{prefix}{resp}"))
 
 
 #Logg
@@ -116,7 +221,7 @@ def build_gui():
 
     def make_toggle(i: int):
         def cb():
-            leds[i].toggle()
+            on_reply(leds[i].toggle(), root, lambda _: refresh_led(i))
             refresh_led(i)
         return cb
 
@@ -142,21 +247,14 @@ def build_gui():
     ctrl_row = tk.Frame(led_frame)
     ctrl_row.pack(pady=(8, 0))
 
+    #Alle fire går ut med en gang, svarene kommer etter hverandre
     def all_on():
-        def task():
-            for i in range(4):
-                leds[i].turn_on()
-                root.after(0, refresh_led, i)
-                time.sleep(0.1)
-        threading.Thread(target=task, daemon=True).start()
+        for i in range(4):
+            on_reply(leds[i].turn_on(), root, lambda _, i=i: refresh_led(i))
 
     def all_off():
-        def task():
-            for i in range(4):
-                leds[i].turn_off()
-                root.after(0, refresh_led, i)
-                time.sleep(0.1)
-        threading.Thread(target=task, daemon=True).start()
+        for i in range(4):
+            on_reply(leds[i].turn_off(), root, lambda _, i=i: refresh_led(i))
 
     tk.Button(ctrl_row, text="Alle PÅ",  width=10, command=all_on).pack(side=tk.LEFT, padx=4)
     tk.Button(ctrl_row, text="Alle AV", width=10, command=all_off).pack(side=tk.LEFT, padx=4)
@@ -172,6 +270,32 @@ def build_gui():
               command=lambda: poll_sensor("ADC", adc_label, "ADC: ")
               ).pack(anchor="w", pady=(2, 6))
 
+    #Varsling: kortet sier fra når ADC forlater vinduet rundt siste verdi
+    WATCH_BAND = 200
+    watch_var = tk.BooleanVar(value=False)
+
+    def on_adc_event(ch, outside, value):
+        if ch != 0:
+            return
+        root.after(0, adc_label.config, {"text": f"ADC: {value}"})
+        if outside and watch_var.get():
+            #flytt vinduet til den nye verdien, neste hendelse kommer ved neste endring
+            send_async(f"WATCH:0,{max(0, value - WATCH_BAND)},{value + WATCH_BAND}")
+
+    def toggle_watch():
+        if watch_var.get():
+            def start(f):
+                resp = f.result()
+                value = int(resp[4:]) if resp.startswith("ADC:") else 0
+                send_async(f"WATCH:0,{max(0, value - WATCH_BAND)},{value + WATCH_BAND}")
+            send_async("ADC").add_done_callback(start)
+        else:
+            send_async("WATCH:0")
+
+    on_event(on_adc_event)
+    tk.Checkbutton(sens_frame, text="Varsle ved endring", variable=watch_var,
+                   command=toggle_watch).pack(anchor="w", pady=(0, 6))
+
     tmp_label = tk.Label(sens_frame, text="Temperatur: -", font=("Courier", 11),
                          anchor="w", width=28)
     tmp_label.pack(anchor="w")
@@ -179,6 +303,25 @@ def build_gui():
               command=lambda: poll_sensor("TMP", tmp_label, "Temperatur: ")
               ).pack(anchor="w", pady=2)
 
+    #Telemetri: kortet sender ADC og temperatur selv, to ganger i sekundet
+    STREAM_RATE = 2
+    stream_var = tk.BooleanVar(value=False)
+
+    def on_tlm(frame):
+        if "adc" in frame:
+            root.after(0, adc_label.config, {"text": f"ADC: {frame['adc'][0]}"})
+        if "tmp" in frame:
+            root.after(0, tmp_label.config, {"text": f"Temperatur: {frame['tmp']}"})
+
+    def toggle_stream():
+        rate = STREAM_RATE if stream_var.get() else 0
+        mask = proto.STREAM_ADC | proto.STREAM_TEMP
+        send_async(f"STREAM:{rate},{mask}")
+
+    on_telemetry(on_tlm)
+    tk.Checkbutton(sens_frame, text="Oppdater automatisk", variable=stream_var,
+                   command=toggle_stream).pack(anchor="w", pady=(6, 0))
+
     #Servo-seksjon
     servo_frame = ttk.LabelFrame(root, text="Servo", padding=10)
     servo_frame.grid(row=1, column=1, padx=10, pady=6, sticky="nsew")
@@ -189,7 +332,7 @@ def build_gui():
     def on_servo_change(val):
         angle = int(float(val))
         servo_label.config(text=f"Vinkel: {angle}°")
-        send_command(f"SERVO:{angle}")
+        send_async(f"SERVO:{angle}")
 
     servo_scale = tk.Scale(servo_frame, from_=0, to=180,
                            orient=tk.HORIZONTAL, length=200,
@@ -219,11 +362,11 @@ def build_gui():
 
     def send_buzz():
         freq = buzz_scale.get()
-        send_command(f"BUZZ:{freq}")
+        send_async(f"BUZZ:{freq}")
 
     def stop_buzz():
         buzz_scale.set(0)
-        send_command("BUZZ:0")
+        send_async("BUZZ:0")
 
     tk.Button(btn_row, text="Spill av", command=send_buzz,  width=10).pack(side=tk.LEFT, padx=3)
     tk.Button(btn_row, text="Stopp",    command=stop_buzz,  width=10).pack(side=tk.LEFT, padx=3)
@@ -234,5 +377,7 @@ def build_gui():
 if __name__ == "__main__":
     connect_serial()
     build_gui()
+    if client:
+        client.close()
     if ser and ser.is_open:
         ser.close()
@@ -0,0 +1,183 @@
+#Rørlagt (pipelined) ASCII-klient mot IO-kortet
+#
+#Kortet leser linjer fra RX-ringen og svarer på dem i rekkefølge, én linje
+#per kommando, så flere kommandoer kan ligge ute samtidig og svarene pares
+#med forespørslene i samme rekkefølge (FIFO). Hver forespørsel får et
+#løpenummer og en Future. Linjer med et abonnert prefiks ("EVT:", "TLM:")
+#er ikke svar og går til abonnentene.
+#
+#En lesetråd tar imot alt. Ingen kaller venter på linken med mindre de
+#selv kaller .result() på futuren.
+
+import collections
+import threading
+import time
+from concurrent.futures import Future
+
+WINDOW       = 6        #kommandoer ute samtidig
+WINDOW_BYTES = 96       #og bytes ute, under USART2_RX_SIZE (128) på kortet
+TIMEOUT      = 2.0      #s fra sending til svar
+POLL         = 0.05     #s, lesetrådens readline-timeout
+STALE_PONG   = 0.3      #s etter en resync der ekstra PONG kastes
+
+
+class Request:
+    def __init__(self, seq: int, cmd: str, until: str = None):
+        self.seq = seq
+        self.cmd = cmd
+        self.until = until          #resync: kast linjer til denne kommer
+        self.future = Future()
+        self.future.seq = seq
+        self.sent = 0.0
+
+
+class Client:
+    def __init__(self, ser, window: int = WINDOW, timeout: float = TIMEOUT):
+        self.ser = ser
+        self.window = window
+        self.timeout = timeout
+        self._lock = threading.Lock()
+        self._backlog = collections.deque()     #ikke sendt ennå
+        self._flight = collections.deque()      #sendt, venter på svar
+        self._flight_bytes = 0
+        self._seq = 0
+        self._subs = {}                         #prefiks -> [fn(line)]
+        self._stale = 0                         #ekstra PING sendt i en resync
+        self._stale_until = 0.0
+        self.timeouts = 0
+        self.dropped = 0                        #linjer uten noen som ventet
+        self.on_lost = None                     #fn() fra lesetråden når en resync-PING er uten svar
+        self._stop = threading.Event()
+        self.ser.timeout = POLL
+        self._thread = threading.Thread(target=self._reader, daemon=True)
+        self._thread.start()
+
+    def subscribe(self, prefix: str, fn):
+        #fn(line) kalles fra lesetråden
+        self._subs.setdefault(prefix, []).append(fn)
+
+    def request(self, cmd: str) -> Future:
+        #Legg kommandoen i kø, futuren får svarlinjen eller et unntak
+        return self._submit(cmd)
+
+    def resync(self) -> Future:
+        #PING og kast alt fram til PONG, f.eks. etter timeout eller ny baudrate.
+        #Linjeskift først avslutter en eventuell halv linje på kortet.
+        #Venter en resync allerede, sendes bare PING på nytt.
+        with self._lock:
+            for r in self._flight:
+                if r.until is not None:
+                    self.ser.write(b"\nPING\n")
+                    r.sent = time.monotonic()
+                    self._stale += 1
+                    return r.future
+            for r in self._backlog:
+                if r.until is not None:
+                    return r.future
+        return self._submit("\nPING", until="PONG")
+
+    def in_flight(self) -> int:
+        with self._lock:
+            return len(self._flight) + len(self._backlog)
+
+    def close(self):
+        self._stop.set()
+        self._thread.join()
+        with self._lock:
+            pending = list(self._flight) + list(self._backlog)
+            self._flight.clear()
+            self._backlog.clear()
+        for r in pending:
+            r.future.set_exception(ConnectionError("lukket"))
+
+    def _submit(self, cmd: str, until: str = None) -> Future:
+        with self._lock:
+            self._seq = (self._seq + 1) & 0xFFFF
+            req = Request(self._seq, cmd, until)
+            self._backlog.append(req)
+            self._pump()
+        return req.future
+
+    def _pump(self):
+        #Send fra køen så lenge vinduet har plass, kalles med _lock holdt
+        while self._backlog:
+            req = self._backlog[0]
+            size = len(req.cmd) + 1
+            if self._flight and (len(self._flight) >= self.window or
+                                 self._flight_bytes + size > WINDOW_BYTES):
+                break
+            self._backlog.popleft()
+            try:
+                self.ser.write((req.cmd + "\n").encode())
+            except Exception as e:
+                req.future.set_exception(e)
+                continue
+            req.sent = time.monotonic()
+            self._flight.append(req)
+            self._flight_bytes += size
+
+    def _reader(self):
+        while not self._stop.is_set():
+            try:
+                raw = self.ser.readline()
+            except Exception as e:
+                self._fail_all(e)
+                time.sleep(POLL)
+                continue
+            if raw:
+                self._line(raw.decode(errors="replace").strip())
+            self._check_timeout()
+
+    def _line(self, line: str):
+        for prefix, fns in self._subs.items():
+            if line.startswith(prefix):
+                for fn in fns:
+                    fn(line)
+                return
+        with self._lock:
+            if not self._flight:
+                self.dropped += 1
+                return
+            req = self._flight[0]
+            if req.until is not None and line != req.until:
+                return                  #rester fra før resync
+            if req.until is None and line == "PONG" and self._stale:
+                if time.monotonic() < self._stale_until:
+                    self._stale -= 1    #svar på en resync-PING som ble sendt flere ganger
+                    return
+                self._stale = 0
+            if req.until is not None:
+                self._stale_until = time.monotonic() + STALE_PONG
+            self._flight.popleft()
+            self._flight_bytes -= len(req.cmd) + 1
+            self._pump()
+        req.future.set_result(line)
+
+    def _check_timeout(self):
+        with self._lock:
+            if not self._flight or time.monotonic() - self._flight[0].sent < self.timeout:
+                return
+            #Svar kan ha gått tapt, da er paringen bak ikke til å stole på:
+            #alle som er ute feiler, og en resync går foran resten av køen
+            failed = list(self._flight)
+            self._flight.clear()
+            self._flight_bytes = 0
+            self.timeouts += 1
+            lost = any(r.until for r in failed)
+            if not lost:
+                self._seq = (self._seq + 1) & 0xFFFF
+                self._backlog.appendleft(Request(self._seq, "\nPING", until="PONG"))
+            self._pump()
+        for r in failed:
+            r.future.set_exception(TimeoutError(r.cmd.strip()))
+        if lost and self.on_lost:
+            self.on_lost()
+
+    def _fail_all(self, e):
+        with self._lock:
+            failed = list(self._flight) + list(self._backlog)
+            self._flight.clear()
+            self._backlog.clear()
+            self._flight_bytes = 0
+        for r in failed:
+            r.future.set_exception(e)
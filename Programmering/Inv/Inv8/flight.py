@@ -0,0 +1,144 @@
+#Ferdskriver på IO-kortet (flight.h i firmware): les og dekod loggen
+#
+#  python3 flight.py --port /dev/ttyAMA0 --baud 38400 [--clear] [--raw dump.bin]
+#
+#"DUMP" svarer "DUMP:count,size,boots,lost" og sender så count poster à
+#16 byte rett etter linjen, til slutt én CRC-8 over postene. Kortet holder
+#TLM/EVT/BURST tilbake så lenge, men ingenting annet skal sendes til kortet
+#før CRC-en er kommet.
+#
+#  post: u32 t_us, u16 latency_us, u8 kind, u8 op, u8 result, u8 len, u8 arg[6]
+
+import argparse
+import struct
+import time
+
+import proto
+
+REC = struct.Struct("<IHBBBB6s")
+
+BOOT, ASCII, BINARY, RX_ERROR, EVENT, BAUD = range(1, 7)
+KIND_NAMES = {BOOT: "BOOT", ASCII: "ASCII", BINARY: "BIN", RX_ERROR: "RXERR",
+              EVENT: "EVT", BAUD: "BAUD"}
+
+#Opkode -> navn, fra OP_*-konstantene i proto.py
+OP_NAMES = {v: k[3:] for k, v in vars(proto).items() if k.startswith("OP_")}
+EVT_NAMES = {proto.EVT_WATCH: "WATCH", proto.EVT_BURST: "BURST", proto.EVT_STREAM: "STREAM",
+             proto.EVT_DUMP: "DUMP"}
+BAUD_RESULT = {0: "byttet", 1: "bekreftet", 2: "tilbake"}
+
+#RSTCTRL.RSTFR
+RESET_FLAGS = [(0x01, "POR"), (0x02, "BOR"), (0x04, "EXT"), (0x08, "WDT"),
+               (0x10, "SW"), (0x20, "UPDI")]
+
+
+def decode(blob: bytes) -> list:
+    #Rå poster -> liste med dict, eldste først
+    recs = []
+    for off in range(0, len(blob) - REC.size + 1, REC.size):
+        t_us, lat, kind, op, result, length, arg = REC.unpack_from(blob, off)
+        recs.append({"t_us": t_us, "latency_us": lat, "kind": kind, "op": op,
+                     "result": result, "len": length, "arg": arg[:min(length, len(arg))]})
+    return recs
+
+
+def describe(r: dict) -> str:
+    kind, op, arg = r["kind"], r["op"], r["arg"]
+    err = proto.ERR_NAMES.get(r["result"], str(r["result"]))
+    if kind == BOOT:
+        flags = "+".join(n for bit, n in RESET_FLAGS if op & bit) or "?"
+        boots = int.from_bytes(arg[:2], "little")
+        return f"BOOT {flags}, omstart {boots} siden strøm på"
+    if kind == ASCII:
+        text = arg.decode(errors="replace") + ("…" if r["len"] > len(arg) else "")
+        return f'ASCII "{text}" -> {err}'
+    if kind in (BINARY, RX_ERROR):
+        name = OP_NAMES.get(op, f"0x{op:02X}")
+        return f"{KIND_NAMES[kind]} {name} [{arg.hex(' ')}] ({r['len']} B) -> {err}"
+    if kind == EVENT:
+        name = EVT_NAMES.get(op, f"0x{op:02X}")
+        if op == proto.EVT_WATCH and len(arg) >= 4:
+            ch, outside, value = arg[0], arg[1], int.from_bytes(arg[2:4], "little")
+            return f"EVT WATCH ch{ch} {'ute' if outside else 'inne'} {value}"
+        if op == proto.EVT_STREAM:
+            return f"EVT STREAM seq {int.from_bytes(arg[:2], 'little')} hoppet over (TX full eller DUMP)"
+        return f"EVT {name} [{arg.hex(' ')}] -> {err}"
+    if kind == BAUD:
+        return f"BAUD {int.from_bytes(arg[:4], 'little')} {BAUD_RESULT.get(r['result'], '?')}"
+    return f"kind {kind} op 0x{op:02X} [{arg.hex(' ')}]"
+
+
+def timeline(recs: list) -> list:
+    #Én linje per post. Tiden starter på 0 ved hver BOOT, så den vises
+    #per oppstart, med tid siden forrige post i samme oppstart.
+    lines, prev = [], None
+    for r in recs:
+        if r["kind"] == BOOT:
+            prev = None
+        dt = "" if prev is None else f"+{(r['t_us'] - prev) & 0xFFFFFFFF:>9} us"
+        lat = f"{r['latency_us']:>5} us" if r["kind"] in (ASCII, BINARY, RX_ERROR) else " " * 8
+        lines.append(f"{r['t_us'] / 1e6:12.6f} s {dt:>13}  {lat}  {describe(r)}")
+        prev = r["t_us"]
+    return lines
+
+
+def read_dump(ser, timeout: float = 5.0):
+    #ASCII-modus: send DUMP, les hode, poster og CRC. Gir (hode, rå poster).
+    ser.reset_input_buffer()
+    ser.write(b"DUMP\n")
+    deadline = time.monotonic() + timeout
+    while True:
+        if time.monotonic() > deadline:
+            raise TimeoutError("ingen DUMP-hode")
+        line = ser.readline().decode(errors="replace").strip()
+        if line.startswith("DUMP:"):
+            break
+    count, size, boots, lost = (int(x) for x in line[5:].split(","))
+    if size != REC.size:
+        raise ValueError(f"poststørrelse {size}, forventet {REC.size}")
+    want = count * size + 1
+    data = bytearray()
+    while len(data) < want:
+        if time.monotonic() > deadline:
+            raise TimeoutError(f"fikk {len(data)} av {want} byte")
+        data += ser.read(want - len(data))
+    blob, crc = bytes(data[:-1]), data[-1]
+    if proto.crc8(blob) != crc:
+        raise ValueError("CRC stemmer ikke")
+    return {"count": count, "boots": boots, "lost": lost}, blob
+
+
+def main():
+    import serial
+    ap = argparse.ArgumentParser(description="Les ferdskriveren på IO-kortet")
+    ap.add_argument("--port", default="/dev/ttyAMA0")
+    ap.add_argument("--baud", type=int, default=38400)
+    ap.add_argument("--raw", help="lagre rå poster her")
+    ap.add_argument("--file", help="dekod en lagret --raw-fil i stedet for kortet")
+    ap.add_argument("--clear", action="store_true", help="tøm loggen etter lesing")
+    args = ap.parse_args()
+
+    if args.file:
+        with open(args.file, "rb") as f:
+            blob = f.read()
+        print("\n".join(timeline(decode(blob))))
+        return
+
+    ser = serial.Serial(args.port, args.baud, timeout=0.5)
+    try:
+        #128 poster à 16 byte, 10 bit per byte, pluss litt
+        head, blob = read_dump(ser, timeout=2.0 + 128 * REC.size * 10 / args.baud)
+        if args.raw:
+            with open(args.raw, "wb") as f:
+                f.write(blob)
+        print(f"{head['count']} poster, {head['boots']} omstarter, {head['lost']} tapt under dump")
+        print("\n".join(timeline(decode(blob))))
+        if args.clear:
+            ser.write(b"DUMP:CLEAR\n")
+            print(ser.readline().decode(errors="replace").strip())
+    finally:
+        ser.close()
+
+
+if __name__ == "__main__":
+    main()
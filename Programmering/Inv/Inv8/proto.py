@@ -0,0 +1,187 @@
+#Binært rammeformat mot IO-kortet, samme som proto.h i firmware
+#
+#  ramme:  SYNC  OP  LEN  PAYLOAD[LEN]  CRC
+#  CRC-8 (poly 0x07, init 0x00) over OP, LEN og PAYLOAD
+#  felter over én byte er little-endian
+
+import struct
+
+try:
+    import armext       #native/, bygget fra proto.c i firmware
+except ImportError:
+    armext = None
+
+SYNC        = 0xA5
+MAX_PAYLOAD = 32
+OVERHEAD    = 4
+REPLY       = 0x80
+
+#Opkoder (må holdes lik proto.h)
+OP_ASCII       = 0x00
+OP_ADC         = 0x01
+OP_TMP         = 0x02
+OP_LED         = 0x03
+OP_SERVO       = 0x04
+OP_BUZZ        = 0x05
+OP_SERVO_MULTI = 0x06
+OP_MOVE        = 0x07
+OP_SEG         = 0x08
+OP_QLEN        = 0x09
+OP_IK          = 0x0A
+OP_IK_CFG      = 0x0B
+OP_CAL         = 0x0C
+OP_CAL_SAVE    = 0x0D
+OP_ITMP        = 0x0E
+OP_OVS         = 0x0F
+OP_WATCH       = 0x10
+OP_NOTE        = 0x11
+OP_SWEEP       = 0x12
+OP_TASKS       = 0x13
+OP_STATS       = 0x14
+OP_HIST        = 0x15
+OP_PING        = 0x16
+OP_BURST       = 0x17
+OP_BAUD        = 0x18
+OP_STREAM      = 0x19
+OP_WEIGHT      = 0x1A
+OP_TARE        = 0x1B
+OP_HX_CAL      = 0x1C
+OP_HX_RAW      = 0x1D
+OP_SLEEP       = 0x1E
+OP_LED_PULSE   = 0x1F
+OP_DUMP        = 0x20
+OP_EVENT       = 0x7E
+OP_NAK         = 0x7F
+
+EVT_WATCH = 0x01
+EVT_BURST = 0x02
+EVT_STREAM = 0x03
+EVT_DUMP = 0x04
+
+#Telemetri-felt (stream.h), i denne rekkefølgen i rammen
+STREAM_ADC   = 0x01     #u16 per ADC-kanal (pot, tmp, itemp)
+STREAM_TEMP  = 0x02     #i16 TMP235 °C, i16 intern °C
+STREAM_SERVO = 0x04     #u16 ticks per servo
+STREAM_LED   = 0x08     #u8, bit n = LED n på
+STREAM_WEIGHT = 0x10    #i16 per veiecelle, 0.1 g
+STREAM_ALL   = 0x1F
+
+ERR_NAMES = {0: "NONE", 1: "OPCODE", 2: "LENGTH", 3: "CRC", 4: "ARG", 5: "FULL"}
+
+
+def _crc_table():
+    table = []
+    for i in range(256):
+        c = i
+        for _ in range(8):
+            c = ((c << 1) ^ 0x07) & 0xFF if c & 0x80 else (c << 1) & 0xFF
+        table.append(c)
+    return table
+
+_CRC = _crc_table()
+
+def crc8(data: bytes, crc: int = 0) -> int:
+    for b in data:
+        crc = _CRC[crc ^ b]
+    return crc
+
+
+def encode(op: int, payload: bytes = b"") -> bytes:
+    if len(payload) > MAX_PAYLOAD:
+        raise ValueError(f"payload {len(payload)} > {MAX_PAYLOAD}")
+    body = bytes((op, len(payload))) + bytes(payload)
+    return bytes((SYNC,)) + body + bytes((crc8(body),))
+
+
+class Decoder:
+    #Tar imot bytes i vilkårlige biter og gir hele rammer som (op, payload).
+    #Ødelagte rammer telles i .errors og hoppes over.
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.errors = 0
+
+    def reset(self):
+        #Kast en halv ramme, f.eks. etter timeout
+        self.buf.clear()
+
+    def feed(self, data: bytes):
+        self.buf += data
+        frames = []
+        while True:
+            start = self.buf.find(SYNC)
+            if start < 0:
+                self.buf.clear()
+                break
+            del self.buf[:start]
+            if len(self.buf) < 3:
+                break
+            length = self.buf[2]
+            if length > MAX_PAYLOAD:
+                self.errors += 1
+                del self.buf[:1]
+                continue
+            if len(self.buf) < length + OVERHEAD:
+                break
+            body = bytes(self.buf[1:3 + length])
+            if crc8(body) != self.buf[3 + length]:
+                self.errors += 1
+                del self.buf[:1]        #let etter neste SYNC
+                continue
+            frames.append((body[0], body[2:]))
+            del self.buf[:length + OVERHEAD]
+        return frames
+
+
+if armext is not None:
+    #Samme ramme og CRC i C, Decoder er proto_rx_feed() fra kortet selv.
+    #Hele rammer blir de samme, .errors kan telle litt annerledes på støy.
+    crc8    = armext.crc8
+    encode  = armext.encode
+    Decoder = armext.Decoder
+
+
+def u16(v: int) -> bytes:
+    return struct.pack("<H", v & 0xFFFF)
+
+def i16(v: int) -> bytes:
+    return struct.pack("<h", v)
+
+def get_u16(p: bytes, off: int = 0) -> int:
+    return struct.unpack_from("<H", p, off)[0]
+
+def get_i16(p: bytes, off: int = 0) -> int:
+    return struct.unpack_from("<h", p, off)[0]
+
+def stream_fields(mask: int, values: list) -> dict:
+    #Felt fra en telemetriramme, values i maskens rekkefølge
+    out, i = {}, 0
+    if mask & STREAM_ADC:
+        out["adc"] = values[i:i + 3]; i += 3
+    if mask & STREAM_TEMP:
+        out["tmp"], out["itmp"] = values[i], values[i + 1]; i += 2
+    if mask & STREAM_SERVO:
+        out["servo"] = values[i:i + 3]; i += 3
+    if mask & STREAM_LED:
+        out["led"] = values[i]; i += 1
+    if mask & STREAM_WEIGHT:
+        out["weight"] = [v / 10 for v in values[i:i + 3]]
+    return out
+
+def decode_stream(payload: bytes) -> dict:
+    #PROTO_EVT_STREAM-hendelse -> {"seq", "t_us", "mask", felt...}
+    seq, t_us, mask = struct.unpack_from("<HIB", payload, 1)
+    #(bit, antall, format) i maskens rekkefølge
+    layout = [(STREAM_ADC, 3, "H"), (STREAM_TEMP, 2, "h"), (STREAM_SERVO, 3, "H"),
+              (STREAM_LED, 1, "B"), (STREAM_WEIGHT, 3, "h")]
+    off, values = 8, []
+    for bit, n, fmt in layout:
+        if mask & bit:
+            values += struct.unpack_from("<" + fmt * n, payload, off)
+            off += struct.calcsize("<" + fmt * n)
+    return {"seq": seq, "t_us": t_us, "mask": mask, **stream_fields(mask, values)}
+
+def parse_tlm(line: str) -> dict:
+    #"TLM:seq,t_us,mask,..." -> samme som decode_stream
+    v = [int(x) for x in line[4:].split(",")]
+    return {"seq": v[0], "t_us": v[1], "mask": v[2], **stream_fields(v[2], v[3:])}
@@ -0,0 +1,174 @@
+"""Batched kinematics for the N-joint arm in test_gui_servo.py.
+
+Same chain as the DH model the GUI used to build with roboticstoolbox:
+joint 0 yaws the arm plane about Z at height base_h, joints 1..N-1 pitch
+in that plane, link i has length a[i-1].  Every function takes q with
+shape (B, N) in radians, so a batch of IK seeds costs one NumPy call
+instead of one Python-level solve per seed.
+"""
+
+import numpy as np
+
+
+def _planar(q, a):
+    """Per-link (dr, dz) in the arm plane, shape (B, N-1) each."""
+    phi = np.cumsum(q[:, 1:], axis=1)          # absolute pitch of every link
+    return a * np.cos(phi), a * np.sin(phi)
+
+
+def fk_points(q, a, base_h):
+    """Joint positions (B, N+1, 3): floor origin, base top, then each pitch joint -> EE."""
+    q  = np.atleast_2d(q)
+    n  = q.shape[0]
+    lr, lz = _planar(q, a)
+    r  = np.concatenate([np.zeros((n, 2)), np.cumsum(lr, axis=1)], axis=1)
+    z  = np.concatenate([np.zeros((n, 1)), base_h + np.zeros((n, 1)),
+                         base_h + np.cumsum(lz, axis=1)], axis=1)
+    c, s = np.cos(q[:, :1]), np.sin(q[:, :1])
+    return np.stack([r * c, r * s, z], axis=-1)
+
+
+def fk_ee(q, a, base_h):
+    """End-effector positions (B, 3)."""
+    q  = np.atleast_2d(q)
+    lr, lz = _planar(q, a)
+    r  = lr.sum(axis=1)
+    return np.stack([r * np.cos(q[:, 0]), r * np.sin(q[:, 0]),
+                     base_h + lz.sum(axis=1)], axis=-1)
+
+
+def jacobian(q, a, base_h):
+    """Position Jacobian (B, 3, N), same rows as jacob0(q)[:3]."""
+    q  = np.atleast_2d(q)
+    lr, lz = _planar(q, a)
+    # a pitch joint moves every link from itself out to the EE
+    dr = -np.cumsum(lz[:, ::-1], axis=1)[:, ::-1]
+    dz =  np.cumsum(lr[:, ::-1], axis=1)[:, ::-1]
+    r  = lr.sum(axis=1)
+    c, s = np.cos(q[:, 0]), np.sin(q[:, 0])
+    J = np.zeros((q.shape[0], 3, q.shape[1]))
+    J[:, 0, 0]  = -r * s
+    J[:, 1, 0]  =  r * c
+    J[:, 0, 1:] = dr * c[:, None]
+    J[:, 1, 1:] = dr * s[:, None]
+    J[:, 2, 1:] = dz
+    return J
+
+
+def dls_ik(target, q0, a, base_h, lo, hi, steps, damping, step_scale, tol=1e-4):
+    """Damped least squares from every seed row of q0 at once.
+
+    Position only, each row stops moving once it is within tol.  Returns
+    (q, err) with q clamped to [lo, hi] and err the remaining distance.
+    """
+    q    = np.array(q0, dtype=float, ndmin=2)
+    t    = np.asarray(target, dtype=float)
+    lam2 = damping ** 2 * np.eye(3)
+    err  = t - fk_ee(q, a, base_h)
+    for _ in range(steps):
+        live = np.linalg.norm(err, axis=1) >= tol
+        if not live.any():
+            break
+        J  = jacobian(q, a, base_h)
+        Jt = J.transpose(0, 2, 1)
+        dq = (Jt @ np.linalg.solve(J @ Jt + lam2, err[..., None]))[..., 0]
+        # scale each step so its largest joint change is <= step_scale rad
+        m  = np.abs(dq).max(axis=1)
+        dq *= np.minimum(1.0, step_scale / np.maximum(m, 1e-12))[:, None]
+        dq[~live] = 0.0
+        q   = np.clip(q + dq, lo, hi)
+        err = t - fk_ee(q, a, base_h)
+    return q, np.linalg.norm(err, axis=1)
+
+
+def _wrap(x):
+    return (x + np.pi) % (2 * np.pi) - np.pi
+
+
+def planar_pitches(r, h, a, phi):
+    """Closed-form pitch angles for 2 or 3 links, the derivation of solve_ik() in main.py.
+
+    r (reach), h (height above the base) and phi (absolute pitch of the last
+    link, ignored for 2 links) broadcast together.  Returns pitches with
+    shape (..., 2, N-1), axis -2 elbow up / elbow down, and the reach mask
+    (..., 2).
+    """
+    a1, a2 = a[0], a[1]
+    a3  = a[2] if len(a) == 3 else 0.0
+    xw  = r - a3 * np.cos(phi)
+    yw  = h - a3 * np.sin(phi)
+    phi = np.broadcast_to(phi, xw.shape)
+
+    c2 = (xw ** 2 + yw ** 2 - a1 ** 2 - a2 ** 2) / (2 * a1 * a2)
+    ok = np.abs(c2) <= 1.0
+    s2 = np.sqrt(np.clip(1.0 - c2 ** 2, 0.0, 1.0))
+    s2 = np.stack([s2, -s2], axis=-1)
+    c2, xw, yw, phi = (v[..., None] for v in (c2, xw, yw, phi))
+
+    t2 = np.arctan2(s2, c2)
+    t1 = np.arctan2(yw, xw) - np.arctan2(a2 * s2, a1 + a2 * c2)
+    cols = [_wrap(t1), t2]
+    if len(a) == 3:
+        cols.append(_wrap(phi - t1 - t2))
+    return np.stack(cols, axis=-1), np.repeat(ok[..., None], 2, axis=-1)
+
+
+def planar_ik(target, a, base_h, phis, yaw=0.0):
+    """Closed-form solutions for one target, or None if the chain has none.
+
+    With 3 links the chain is redundant, every wrist angle in phis gives an
+    elbow-up and an elbow-down solution.  Returns q (M, N) and a mask of
+    the rows that reach the target.  yaw is kept when the target is on
+    the Z axis.
+    """
+    if len(a) not in (2, 3):
+        return None
+    tx, ty, tz = target
+    r   = np.hypot(tx, ty)
+    yaw = np.arctan2(ty, tx) if r > 1e-9 else yaw
+    phi = np.asarray(phis, dtype=float) if len(a) == 3 else np.zeros(1)
+    p, ok = planar_pitches(r, tz - base_h, a, phi)
+    p  = p.reshape(-1, len(a))
+    q  = np.concatenate([np.full((len(p), 1), yaw), p], axis=1)
+    return q, ok.reshape(-1)
+
+
+def closest_planar(target, q_ref, a, base_h, lo, hi, phis=()):
+    """Closed-form solution inside [lo, hi] closest to q_ref, or None.
+
+    q_ref's own wrist angle is always a candidate, so dragging keeps the
+    wrist steady as long as it can.
+    """
+    q_ref = np.asarray(q_ref, dtype=float)
+    res = planar_ik(target, a, base_h,
+                    np.concatenate([[q_ref[1:].sum()], np.asarray(phis, float)]),
+                    yaw=q_ref[0])
+    if res is None:
+        return None
+    q, ok = res
+    ok &= np.all((q >= lo) & (q <= hi), axis=1)
+    if not ok.any():
+        return None
+    q = q[ok]
+    return q[np.argmin(np.linalg.norm(q - q_ref, axis=1))]
+
+
+def solve(target, q_ref, a, base_h, lo, hi, seeds=(), phis=(),
+          steps=30, damping=0.06, step_scale=0.55, tol=1e-3):
+    """Best joint vector for a position target, closest to q_ref.
+
+    Tries the closed form over phis first, then runs DLS from q_ref and
+    every extra seed in one batch.  Returns (q, reached).
+    """
+    q_ref = np.asarray(q_ref, dtype=float)
+    q = closest_planar(target, q_ref, a, base_h, lo, hi, phis)
+    if q is not None:
+        return q, True
+
+    q0 = np.vstack([q_ref] + [np.asarray(s, dtype=float) for s in seeds])
+    q, err = dls_ik(target, q0, a, base_h, lo, hi, steps, damping, step_scale, tol / 10)
+    hit = err < tol
+    if hit.any():
+        d = np.where(hit, np.linalg.norm(q - q_ref, axis=1), np.inf)
+        return q[np.argmin(d)], True
+    return q[np.argmin(err)], False
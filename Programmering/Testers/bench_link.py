@@ -0,0 +1,286 @@
+#Headless link benchmark against the IO board firmware (Inv7/Op8)
+#Uses the firmware PING / ECHO / BURST commands, ASCII and binary framing.
+#
+#  python3 bench_link.py --port /dev/ttyAMA0 --baud 38400 --n 500 --csv link.csv
+#
+#Every baud in --baud is tested in turn. With --negotiate the board is
+#asked to switch with "BAUD:n" from --boot-baud, otherwise the firmware
+#must already run at that rate. Results go to stdout and, with --csv, to a CSV file so runs
+#before and after a firmware change can be compared.
+#
+#link_pct is the share of the wire a test used (10 bits per byte). A burst far
+#below 100% is limited by the board, not the link: firmware from before the
+#events task was woken by TX space refilled the ring once per 5 ms (~25 kB/s),
+#so burst rows from it are no baseline.
+
+import sys, os
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "Inv", "Inv8"))
+
+import argparse
+import csv
+import statistics
+import time
+
+import serial
+import proto
+
+CSV_FIELDS = ["baud", "framing", "test", "size", "n", "ok", "drops",
+              "min_ms", "p50_ms", "p95_ms", "p99_ms", "max_ms",
+              "rate_per_s", "bytes_per_s", "link_pct"]
+
+
+class Link:
+    #One serial port, ASCII lines or binary frames
+
+    def __init__(self, port, baud, timeout=0.5):
+        self.ser = serial.Serial(port, baud, timeout=0)
+        self.timeout = timeout
+        self.binary = False
+        self.dec = proto.Decoder()
+        self.rx = bytearray()
+        time.sleep(0.2)
+        self.ser.reset_input_buffer()
+
+    def close(self):
+        if self.binary:
+            self.set_binary(False)
+        self.ser.close()
+
+    def _read(self):
+        data = self.ser.read(self.ser.in_waiting or 1)
+        if not data:
+            time.sleep(0.0002)
+        return data
+
+    #ASCII
+    def send_line(self, line):
+        self.ser.write((line + "\n").encode())
+
+    def read_line(self, timeout=None):
+        deadline = time.perf_counter() + (timeout or self.timeout)
+        while True:
+            nl = self.rx.find(b"\n")
+            if nl >= 0:
+                line = self.rx[:nl].decode(errors="replace").strip()
+                del self.rx[:nl + 1]
+                if line:
+                    return line
+                continue
+            if time.perf_counter() > deadline:
+                return None
+            self.rx += self._read()
+
+    #Binary
+    def send_frame(self, op, payload=b""):
+        self.ser.write(proto.encode(op, payload))
+
+    def read_frame(self, timeout=None):
+        deadline = time.perf_counter() + (timeout or self.timeout)
+        pending = []
+        while not pending:
+            if time.perf_counter() > deadline:
+                self.dec.reset()
+                return None
+            pending = self.dec.feed(self._read())
+        #keep extra frames for the next call
+        self._frames = getattr(self, "_frames", []) + pending[1:]
+        return pending[0]
+
+    def next_frame(self, timeout=None):
+        frames = getattr(self, "_frames", [])
+        if frames:
+            return frames.pop(0)
+        return self.read_frame(timeout)
+
+    def switch_baud(self, baud):
+        #"OK:n" comes at the old rate, then PING must get through within 1 s
+        self.set_binary(False)
+        self.send_line(f"BAUD:{baud}")
+        if self.read_line() != f"OK:{baud}":
+            return False
+        self.ser.baudrate = baud
+        deadline = time.perf_counter() + 0.7
+        while time.perf_counter() < deadline:
+            self.ser.reset_input_buffer()
+            self.rx.clear()
+            self.ser.write(b"\nPING\n")
+            if self.read_line(0.1) == "PONG":
+                return True
+        return False
+
+    def set_binary(self, on):
+        if on and not self.binary:
+            self.send_line("BIN")
+            if self.read_line() != "OK":
+                raise RuntimeError("firmware did not enter binary mode")
+            self.binary = True
+        elif not on and self.binary:
+            self.send_frame(proto.OP_ASCII)
+            self.next_frame()
+            self.binary = False
+            self.rx.clear()
+
+    #One request/reply, returns RTT in s or None on timeout
+    def ping(self, size=0, seq=0):
+        if self.binary:
+            payload = bytes(((seq + i) & 0xFF for i in range(size)))
+            t0 = time.perf_counter()
+            self.send_frame(proto.OP_PING, payload)
+            f = self.next_frame()
+            ok = f is not None and f[0] == proto.OP_PING | proto.REPLY and f[1] == payload
+        else:
+            cmd = "PING" if size == 0 else "ECHO:" + "x" * size
+            want = "PONG" if size == 0 else cmd
+            t0 = time.perf_counter()
+            self.send_line(cmd)
+            ok = self.read_line() == want
+        return time.perf_counter() - t0 if ok else None
+
+
+def percentile(sorted_v, q):
+    if not sorted_v:
+        return float("nan")
+    i = min(len(sorted_v) - 1, int(round(q * (len(sorted_v) - 1))))
+    return sorted_v[i]
+
+
+def row(baud, framing, test, size, n, rtts, drops, elapsed=None, nbytes=None):
+    ms = sorted(r * 1000.0 for r in rtts)
+    r = {"baud": baud, "framing": framing, "test": test, "size": size, "n": n,
+         "ok": len(rtts) if rtts else n - drops, "drops": drops,
+         "min_ms": ms[0] if ms else "", "p50_ms": percentile(ms, 0.5) if ms else "",
+         "p95_ms": percentile(ms, 0.95) if ms else "", "p99_ms": percentile(ms, 0.99) if ms else "",
+         "max_ms": ms[-1] if ms else "",
+         "rate_per_s": (n - drops) / elapsed if elapsed else "",
+         "bytes_per_s": nbytes / elapsed if elapsed and nbytes else "",
+         "link_pct": 100.0 * nbytes * 10 / baud / elapsed if elapsed and nbytes else ""}
+    return r
+
+
+def bench_rtt(link, n, size):
+    rtts, drops = [], 0
+    for i in range(n):
+        r = link.ping(size, i)
+        if r is None:
+            drops += 1
+            link.rx.clear()
+        else:
+            rtts.append(r)
+    return rtts, drops
+
+
+def bench_rate(link, n, window):
+    #Keep `window` requests in flight, replies are matched in order
+    sent = done = drops = 0
+    t0 = time.perf_counter()
+    while done + drops < n:
+        while sent < n and sent - done - drops < window:
+            if link.binary:
+                link.send_frame(proto.OP_PING, bytes((sent & 0xFF,)))
+            else:
+                link.send_line("PING")
+            sent += 1
+        if link.binary:
+            f = link.next_frame()
+            ok = f is not None and f[0] == proto.OP_PING | proto.REPLY
+        else:
+            ok = link.read_line() == "PONG"
+        if ok:
+            done += 1
+        else:
+            drops += sent - done - drops    #timed out: everything in flight is lost
+    return time.perf_counter() - t0, drops
+
+
+def bench_burst(link, count, size):
+    #Device -> host throughput, counts missing sequence numbers
+    seen = set()
+    if link.binary:
+        link.send_frame(proto.OP_BURST, bytes((count, size)))
+        if link.next_frame() is None:
+            return None, count, 0
+    else:
+        link.send_line(f"BURST:{count},{size}")
+        if link.read_line() != "OK":
+            return None, count, 0
+    t0 = time.perf_counter()
+    nbytes = 0
+    while len(seen) < count:
+        if link.binary:
+            f = link.next_frame()
+            if f is None:
+                break
+            if f[0] == proto.OP_EVENT and f[1][0] == proto.EVT_BURST:
+                seen.add(f[1][1])
+                nbytes += len(f[1]) + proto.OVERHEAD
+        else:
+            line = link.read_line()
+            if line is None:
+                break
+            if line.startswith("B:"):
+                seen.add(int(line[2:].split(",")[0]))
+                nbytes += len(line) + 1
+    return time.perf_counter() - t0, count - len(seen), nbytes
+
+
+def run(args):
+    rows = []
+    for baud in args.baud:
+        if args.negotiate:
+            link = Link(args.port, args.boot_baud, args.timeout)
+            if baud != args.boot_baud and not link.switch_baud(baud):
+                print(f"{baud}: switch failed, skipped", file=sys.stderr)
+                link.ser.baudrate = args.boot_baud
+                time.sleep(0.5)                 #let the board fall back
+                link.close()
+                continue
+        else:
+            link = Link(args.port, baud, args.timeout)
+        try:
+            for framing in args.framing:
+                link.set_binary(framing == "binary")
+                for size in args.sizes:
+                    rtts, drops = bench_rtt(link, args.n, size)
+                    rows.append(row(baud, framing, "rtt", size, args.n, rtts, drops))
+                elapsed, drops = bench_rate(link, args.n, args.window)
+                rows.append(row(baud, framing, f"rate_w{args.window}", 0, args.n, [], drops, elapsed))
+                elapsed, drops, nbytes = bench_burst(link, args.burst, args.burst_size)
+                rows.append(row(baud, framing, "burst", args.burst_size, args.burst, [], drops,
+                                elapsed, nbytes))
+            link.set_binary(False)
+            if args.negotiate and baud != args.boot_baud:
+                link.switch_baud(args.boot_baud)
+        finally:
+            link.close()
+    return rows
+
+
+def main():
+    ap = argparse.ArgumentParser(description="IO board link benchmark")
+    ap.add_argument("--port", default="/dev/ttyAMA0")
+    ap.add_argument("--baud", type=int, nargs="+", default=[38400])
+    ap.add_argument("--negotiate", action="store_true", help="switch rates with BAUD:n")
+    ap.add_argument("--boot-baud", type=int, default=38400, help="rate the board is at when --negotiate starts")
+    ap.add_argument("--framing", nargs="+", choices=["ascii", "binary"], default=["ascii", "binary"])
+    ap.add_argument("--n", type=int, default=200, help="requests per test")
+    ap.add_argument("--sizes", type=int, nargs="+", default=[0, 8, 24], help="echo payload sizes")
+    ap.add_argument("--window", type=int, default=4, help="requests in flight for the rate test")
+    ap.add_argument("--burst", type=int, default=200, help="messages in the burst test")
+    ap.add_argument("--burst-size", type=int, default=24)
+    ap.add_argument("--timeout", type=float, default=0.5)
+    ap.add_argument("--csv", help="write results here")
+    args = ap.parse_args()
+
+    rows = run(args)
+    w = csv.DictWriter(sys.stdout, CSV_FIELDS)
+    w.writeheader()
+    w.writerows(rows)
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            w = csv.DictWriter(f, CSV_FIELDS)
+            w.writeheader()
+            w.writerows(rows)
+
+
+if __name__ == "__main__":
+    main()
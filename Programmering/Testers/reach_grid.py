@@ -0,0 +1,144 @@
+"""Reachable-workspace grid for test_gui_servo.py.
+
+Every (r, z) cell of the arm plane holds the pitch angles that reach its
+centre and a flag, built once per chain (link lengths, base height, joint
+limits) and kept on disk as memory-mapped .npy files keyed by those
+parameters.  Only the CACHE_KEEP most recently used chains stay on disk.
+Yaw is no grid axis: it only turns the arm plane, so a lookup
+puts the requested yaw in front of the cell's pitches.
+
+The grid builds a few rows at a time with build_rows(), lookups in rows
+not built yet return None and the caller solves cold as before.
+"""
+
+import hashlib
+import os
+
+import numpy as np
+
+import arm_kin as kin
+
+CACHE_DIR = os.path.join(os.path.expanduser("~"), ".cache", "arm_reach")
+CACHE_KEEP = 8          # grids on disk, the least recently used go first
+
+UNBUILT, REACHABLE, UNREACHABLE = 0, 1, 2
+
+
+def _prune_cache(cache_dir, keep):
+    """Delete all but the keep most recently used grids, by file mtime."""
+    used = {}
+    for name in os.listdir(cache_dir):
+        key, _, kind = name.partition(".")
+        if kind not in ("q.npy", "flag.npy"):
+            continue
+        try:
+            t = os.path.getmtime(os.path.join(cache_dir, name))
+        except OSError:
+            continue
+        used[key] = max(used.get(key, 0.0), t)
+    for key in sorted(used, key=used.get, reverse=True)[keep:]:
+        for kind in ("q.npy", "flag.npy"):
+            try:
+                os.remove(os.path.join(cache_dir, f"{key}.{kind}"))
+            except OSError:
+                pass
+
+
+class ReachGrid:
+    def __init__(self, a, base_h, lo, hi, cells=160, phis=None, cache_dir=CACHE_DIR):
+        self.a      = np.asarray(a, dtype=float)
+        self.base_h = float(base_h)
+        self.lo     = np.asarray(lo, dtype=float)
+        self.hi     = np.asarray(hi, dtype=float)
+        self.phis   = np.deg2rad(np.arange(-180, 180, 5)) if phis is None else np.asarray(phis)
+        reach       = float(self.a.sum())
+        self.step   = reach / cells
+        self.nr     = cells + 1                                 # r in [0, reach]
+        self.nz     = int(np.ceil((self.base_h + reach) / self.step)) + 1   # z in [0, base_h + reach]
+
+        key = hashlib.sha1(np.concatenate(
+            [self.a, [self.base_h, cells], self.lo[1:], self.hi[1:], self.phis]
+        ).astype(np.float64).tobytes()).hexdigest()[:16]
+        os.makedirs(cache_dir, exist_ok=True)
+        q_path = os.path.join(cache_dir, f"{key}.q.npy")
+        f_path = os.path.join(cache_dir, f"{key}.flag.npy")
+        try:
+            self.q    = np.load(q_path, mmap_mode="r+")
+            self.flag = np.load(f_path, mmap_mode="r+")
+        except (OSError, ValueError):
+            self.q    = np.lib.format.open_memmap(q_path, mode="w+", dtype=np.float32,
+                                                  shape=(self.nz, self.nr, len(self.a)))
+            self.flag = np.lib.format.open_memmap(f_path, mode="w+", dtype=np.uint8,
+                                                  shape=(self.nz, self.nr))
+        for path in (q_path, f_path):
+            os.utime(path)                                      # mark as used for the pruning
+        _prune_cache(cache_dir, CACHE_KEEP)
+        # a row is written before its flags, an interrupted build redoes it
+        self._todo = [i for i in range(self.nz) if self.flag[i, 0] == UNBUILT]
+        self.version = 0                                         # bumped when rows land
+
+    def build_rows(self, n):
+        """Solve the next n unbuilt rows, returns how many are left."""
+        rows, self._todo = self._todo[:n], self._todo[n:]
+        for i in rows:
+            self._build_row(i)
+        if rows:
+            self.q.flush()
+            self.flag.flush()
+            self.version += 1
+        return len(self._todo)
+
+    def _build_row(self, i):
+        r   = np.arange(self.nr) * self.step
+        z   = i * self.step
+        mid = (self.lo[1:] + self.hi[1:]) / 2                   # prefer room on every joint
+        if len(self.a) in (2, 3):
+            phi = self.phis if len(self.a) == 3 else np.zeros(1)
+            p, ok = kin.planar_pitches(r[:, None], z - self.base_h, self.a, phi[None, :])
+            p  = p.reshape(self.nr, -1, len(self.a))
+            ok = ok.reshape(self.nr, -1) & np.all(
+                (p >= self.lo[1:]) & (p <= self.hi[1:]), axis=2)
+            d  = np.where(ok, np.linalg.norm(p - mid, axis=2), np.inf)
+            best  = np.argmin(d, axis=1)
+            pitch = p[np.arange(self.nr), best]
+            hit   = ok.any(axis=1)
+        else:
+            targets = np.stack([r, np.zeros_like(r), np.full_like(r, z)], axis=1)
+            q0 = np.concatenate([np.zeros((self.nr, 1)), np.tile(mid, (self.nr, 1))], axis=1)
+            lo, hi = self.lo.copy(), self.hi.copy()
+            lo[0] = hi[0] = 0.0
+            q, err = kin.dls_ik(targets, q0, self.a, self.base_h, lo, hi,
+                                steps=60, damping=0.06, step_scale=0.55)
+            pitch, hit = q[:, 1:], err < self.step / 4
+        self.q[i]    = pitch
+        self.flag[i] = np.where(hit, REACHABLE, UNREACHABLE)
+
+    def lookup(self, r, z, yaw):
+        """q of the nearest cell with yaw in front, None if unreachable or not built."""
+        j = int(round(r / self.step))
+        i = int(round(z / self.step))
+        if not (0 <= i < self.nz and 0 <= j < self.nr) or self.flag[i, j] != REACHABLE:
+            return None
+        if not (self.lo[0] <= yaw <= self.hi[0]):
+            return None
+        return np.concatenate([[yaw], self.q[i, j].astype(float)])
+
+    def side_mask(self):
+        """(nz, nr) True where the side view is certainly unreachable."""
+        return np.asarray(self.flag) == UNREACHABLE
+
+    def top_mask(self, n=121):
+        """(n, n) True where no height reaches (x, y) over [-reach, reach]^2."""
+        reach = (self.nr - 1) * self.step
+        x  = np.linspace(-reach, reach, n)
+        X, Y = np.meshgrid(x, x)
+        col_ok = np.any(np.asarray(self.flag) != UNREACHABLE, axis=0)
+        R  = np.hypot(X, Y)
+        j  = np.minimum(np.rint(R / self.step).astype(int), self.nr - 1)
+        yaw = np.arctan2(Y, X)
+        return ~col_ok[j] | (R > reach) | (yaw < self.lo[0]) | (yaw > self.hi[0])
+
+    def extent(self):
+        """imshow extent (left, right, bottom, top) of the side mask."""
+        h = self.step / 2
+        return (-h, (self.nr - 1) * self.step + h, -h, (self.nz - 1) * self.step + h)
@@ -3,8 +3,8 @@
 from tkinter import *
 import math
 import numpy as np
-from spatialmath import SE3
-import roboticstoolbox as rtb
+import arm_kin as kin
+import reach_grid
 
 import matplotlib
 matplotlib.use("TkAgg")
@@ -27,7 +27,7 @@ PIT_MIN, PIT_MAX = -45,  45    # shoulder / elbow / wrist / …
 
 REACH_WARN_PCT = 93
 NUDGE_STEP     = 0.05
-REDRAW_MS      = 30
+FRAME_MS       = 16     # ~60 Hz display rate, redraws are coalesced to this
 ANIM_STEPS     = 40
 ANIM_MS        = 20
 
@@ -35,6 +35,13 @@ ANIM_MS        = 20
 DLS_DAMPING     = 0.06   # λ in (JJᵀ + λ²I)⁻¹  — raise to trade accuracy for smoothness
 DLS_STEPS       = 6      # Jacobian iterations per drag event
 DLS_STEP_SCALE  = 0.55   # step-size limiter per iteration (prevents overshoot)
+ACC_STEPS       = 30     # iterations per seed for the accurate (multi-seed) solve
+WRIST_PHIS      = np.deg2rad(np.arange(-180, 180, 5))   # closed-form wrist candidates
+
+# Reachable-workspace grid
+GRID_CELLS         = 160    # cells along the full reach
+GRID_ROWS_PER_TICK = 6      # rows built per idle tick while the GUI runs
+GRID_SHADE_ALPHA   = 0.12
 
 SEG_COLORS   = ["#2196F3", "#4CAF50", "#FF9800", "#E91E63",
                 "#9C27B0", "#00BCD4", "#FF5722", "#8BC34A",
@@ -51,9 +58,6 @@ def wrap180(deg):
     while deg <  -180: deg += 360
     return deg
 
-def point_from_T(T):
-    return (float(T.t[0]), float(T.t[1]), float(T.t[2]))
-
 # Dynamic link-length store
 _link_lengths = [DEFAULT_LINK] * N_JOINTS   # one entry per joint
 
@@ -63,40 +67,17 @@ def get_link_lengths():
 def current_reach():
     return sum(_link_lengths)
 
-# Build / rebuild the DH robot
-robot = None   # initialised by rebuild_robot()
-
-def _make_dh_links(lengths):
-    """Return a DH link list for N_JOINTS joints.
+# Build / rebuild the chain
+# Joint 0 is base yaw at height BOX_H, joints 1…N-1 pitch in the arm plane
+# with link lengths _link_lengths[1:], the yaw joint has no length.
+# All kinematics go through arm_kin.
+chain_a = None   # initialised by rebuild_chain()
 
-    Joint 0  : base yaw  (α = π/2 to lift the arm plane out of XY)
-    Joints 1…N-2 : pitch joints in the arm plane (α = 0)
-    Joint N-1 : final pitch / wrist (α = π/2 for tool orientation)
-    """
-    n = len(lengths)
-    links = []
-    for i, l in enumerate(lengths):
-        if i == 0:
-            # Base yaw — no link length on this joint; length contributed by link 1
-            links.append(rtb.RevoluteDH(
-                d=BOX_H, a=0, alpha=np.pi/2,
-                qlim=np.deg2rad([YAW_MIN, YAW_MAX])))
-        elif i == n - 1:
-            # Last joint — α=π/2 so end-effector frame points forward
-            links.append(rtb.RevoluteDH(
-                d=0, a=l, alpha=np.pi/2,
-                qlim=np.deg2rad([PIT_MIN, PIT_MAX])))
-        else:
-            links.append(rtb.RevoluteDH(
-                d=0, a=l, alpha=0,
-                qlim=np.deg2rad([PIT_MIN, PIT_MAX])))
-    return links
+def rebuild_chain():
+    global chain_a
+    chain_a = np.array(get_link_lengths()[1:], dtype=float)
 
-def rebuild_robot():
-    global robot
-    robot = rtb.DHRobot(_make_dh_links(get_link_lengths()), name="ArmBot")
-
-rebuild_robot()
+rebuild_chain()
 
 # ─────────────────────────────────────────
 # Offsets helpers
@@ -117,19 +98,23 @@ def _q_from_sliders():
     q = np.deg2rad([yaw] + [-p for p in pitches])
     return q
 
+def _q_limits():
+    """DH joint limits (rad) the sliders can show with the current offsets."""
+    offs = get_offsets()
+    lo = np.deg2rad([YAW_MIN] + [-(PIT_MAX + o) for o in offs])
+    hi = np.deg2rad([YAW_MAX] + [-(PIT_MIN + o) for o in offs])
+    return lo, hi
+
 # ─────────────────────────────────────────
 # Forward kinematics
 # ─────────────────────────────────────────
 def fk_chain():
-    """Return list of SE3 transforms: [T_base, T_j0, T_j1, …, T_EE]"""
-    q = _q_from_sliders()
-    T_all = robot.fkine_all(q)
-    return [SE3()] + list(T_all)
+    """Return joint points [(x, y, z), …]: floor, base top, J1 … EE"""
+    pts = kin.fk_points(_q_from_sliders(), chain_a, BOX_H)[0]
+    return [tuple(p) for p in pts.tolist()]
 
 def current_EE():
-    q = _q_from_sliders()
-    T = robot.fkine(q)
-    return point_from_T(T)
+    return tuple(kin.fk_ee(_q_from_sliders(), chain_a, BOX_H)[0].tolist())
 
 def get_EE_screen_xy():
     Ex, Ey, Ez = current_EE()
@@ -143,29 +128,18 @@ def get_EE_screen_xy():
 def jacobian_dls_ik(tx, ty, tz, q0, steps=DLS_STEPS):
     """Fast Jacobian damped-least-squares IK for position only.
 
-    Uses the 3-row position Jacobian (rows 0-2 of jacob0).
-    Returns q (rad) clamped to joint limits.
+    The closed-form planar solution is used when the chain has one and the
+    target is reachable within the slider limits, otherwise DLS steps on the
+    3-row position Jacobian.  Returns q (rad) clamped to joint limits.
     """
-    q = q0.copy()
-    t_target = np.array([tx, ty, tz])
-    lims = np.array([[lnk.qlim[0], lnk.qlim[1]] for lnk in robot.links])
-
-    for _ in range(steps):
-        T_cur = robot.fkine(q)
-        err   = t_target - T_cur.t          # 3-vector position error
-        if np.linalg.norm(err) < 1e-4:
-            break
-        J3 = robot.jacob0(q)[:3, :]         # 3 × N position Jacobian
-        lam2 = DLS_DAMPING ** 2
-        dq   = J3.T @ np.linalg.solve(J3 @ J3.T + lam2 * np.eye(3), err)
-        # scale step so max joint change ≤ DLS_STEP_SCALE rad
-        max_dq = np.max(np.abs(dq))
-        if max_dq > DLS_STEP_SCALE:
-            dq *= DLS_STEP_SCALE / max_dq
-        q = q + dq
-        # clamp to joint limits
-        q = np.clip(q, lims[:, 0], lims[:, 1])
-    return q
+    lo, hi = _q_limits()
+    t = (tx, ty, tz)
+    q = kin.closest_planar(t, q0, chain_a, BOX_H, lo, hi)
+    if q is not None:
+        return q
+    q, _ = kin.dls_ik(t, q0, chain_a, BOX_H, lo, hi,
+                      steps, DLS_DAMPING, DLS_STEP_SCALE)
+    return q[0]
 
 def apply_q_to_sliders(q):
     """Push a raw DH q-vector back into the UI sliders."""
@@ -198,35 +172,46 @@ def _geometric_seed(r_forward, z_world, yaw_deg):
         neutral[1] = -(el_seed + (offs[1] if len(offs) > 1 else 0))
     return np.deg2rad([yaw_deg] + neutral)
 
-def _best_sol(candidates, q0_ref):
-    best, best_dist = None, float("inf")
-    for sol in candidates:
-        if sol.success:
-            d = np.linalg.norm(sol.q - q0_ref)
-            if d < best_dist:
-                best, best_dist = sol, d
-    return best
-
-def ik_solve_accurate(r_forward, z_world):
-    """Multi-seed Levenberg-Marquardt IK — used for Go-to-POI animation."""
+def ik_solve_accurate(r_forward, z_world, q0_cur=None):
+    """Multi-seed IK — used for Go-to-POI animation and the accurate drag mode.
+
+    Every closed-form wrist angle in WRIST_PHIS is tried first, then DLS runs
+    from the current, geometric and neutral seeds in one batch.
+    """
     r_forward = max(0.0, r_forward)
     yaw = joint_scales[0].get()
     tx = r_forward * math.cos(deg2rad(yaw))
     ty = r_forward * math.sin(deg2rad(yaw))
     tz = clamp(z_world, 0.0, BOX_H + current_reach())
-    T_target = SE3(tx, ty, tz)
 
-    q0_cur = _q_from_sliders()
+    if q0_cur is None:
+        q0_cur = _q_from_sliders()
     q0_geo = _geometric_seed(r_forward, z_world, yaw)
     offs   = get_offsets()
     q0_neu = np.deg2rad([yaw] + [-(offs[i] if i < len(offs) else 0)
                                   for i in range(N_JOINTS - 1)])
 
-    sols = [robot.ikine_LM(T_target, q0=q, mask=[1, 1, 1, 0, 0, 0])
-            for q in (q0_cur, q0_geo, q0_neu)]
-    sol = _best_sol(sols, q0_cur)
-    if sol is not None:
-        return sol.q
+    lo, hi = _q_limits()
+    t = (tx, ty, tz)
+
+    # Table fetch, then the closed form at the cell's wrist angle (exact)
+    # or two DLS steps over the last half cell
+    q_grid = grid.lookup(r_forward, tz, deg2rad(yaw)) if grid is not None else None
+    if q_grid is not None:
+        q = kin.closest_planar(t, q_grid, chain_a, BOX_H, lo, hi)
+        if q is not None:
+            return q
+        q, err = kin.dls_ik(t, q_grid, chain_a, BOX_H, lo, hi,
+                            2, DLS_DAMPING, DLS_STEP_SCALE)
+        if err[0] < 1e-3:
+            return q[0]
+
+    q, reached = kin.solve(t, q0_cur, chain_a, BOX_H, lo, hi,
+                           seeds=(q0_geo, q0_neu), phis=WRIST_PHIS,
+                           steps=ACC_STEPS, damping=DLS_DAMPING,
+                           step_scale=DLS_STEP_SCALE)
+    if reached:
+        return q
     return q0_cur   # fallback: stay put
 
 # ─────────────────────────────────────────
@@ -406,12 +391,17 @@ def on_length_change(_=None):
     for i, sp in enumerate(len_spinboxes):
         try:    _link_lengths[i] = max(0.05, float(sp.get()))
         except: pass
-    rebuild_robot()
+    rebuild_chain()
+    rebuild_grid()
     on_slider()
 
 for sp in len_spinboxes:
     sp.config(command=on_length_change)
 
+def on_offset_change(_=None):
+    rebuild_grid()       # offsets move the joint limits
+    on_slider()
+
 # ─────────────────────────────────────────
 # Point of Interest
 # ─────────────────────────────────────────
@@ -446,7 +436,7 @@ Label(controls, text="Drag IK mode", font=("TkDefaultFont", 9, "bold")).pack()
 ik_mode = StringVar(value="jacobian")
 Radiobutton(controls, text="Jacobian DLS  (fast, smooth)",
             variable=ik_mode, value="jacobian").pack(anchor="w")
-Radiobutton(controls, text="Levenberg-Marquardt  (accurate)",
+Radiobutton(controls, text="Multi-seed  (accurate)",
             variable=ik_mode, value="lm").pack(anchor="w")
 
 Frame(controls, height=2, bd=1, relief=SUNKEN).pack(fill="x", pady=5)
@@ -472,70 +462,166 @@ target = {"r": DEFAULT_LINK, "z": BOX_H + 0.5}
 # ─────────────────────────────────────────
 # Draw
 # ─────────────────────────────────────────
+class BlitView:
+    """One figure drawn retained-mode: a cached static background with
+    animated artists blitted on top.
+
+    Artists are made once and only get new data.  frame() does nothing when
+    neither key changed, a dynamic change restores the background and blits,
+    and only a static change (limits, shading, title) or a resize pays for
+    a full canvas draw.
+    """
+    def __init__(self, canvas, ax):
+        self.canvas  = canvas
+        self.ax      = ax
+        self.artists = []
+        self.bg      = None
+        self.static  = None
+        self.dynamic = None
+        canvas.mpl_connect("draw_event", self._on_draw)
+
+    def add(self, artist):
+        artist.set_animated(True)
+        self.artists.append(artist)
+        return artist
+
+    def _on_draw(self, _):
+        self.bg = self.canvas.copy_from_bbox(self.canvas.figure.bbox)
+        self._blit()
+
+    def _blit(self):
+        for a in self.artists:
+            self.ax.draw_artist(a)
+        self.canvas.blit(self.canvas.figure.bbox)
+
+    def frame(self, static_key, dynamic_key, update_static, update_dynamic):
+        full = static_key != self.static or self.bg is None
+        if not full and dynamic_key == self.dynamic:
+            return
+        if dynamic_key != self.dynamic:
+            self.dynamic = dynamic_key
+            update_dynamic()
+        if full:
+            self.static = static_key
+            update_static()
+            self.canvas.draw()          # background + artists in _on_draw
+        else:
+            self.canvas.restore_region(self.bg)
+            self._blit()
+
+N_PTS = N_JOINTS + 1    # floor, base top, J1 … EE
+
+def _joint_label_list():
+    return [JOINT_LABELS[i] if i < len(JOINT_LABELS) else str(i) for i in range(N_PTS)]
+
+def _no_shade():
+    return np.ma.masked_all((1, 1))
+
+# 3D view
+view3d = BlitView(canvas, ax)
+_reach3d   = ax.plot([0, 0], [0, 0], [0, 0], color="#AAAAAA", lw=0.8,
+                     linestyle=":", alpha=0.6)[0]
+_shadow3d  = view3d.add(ax.plot([0, 0], [0, 0], [0, 0], color="gray", lw=1.5,
+                                alpha=0.3, linestyle="--")[0])
+_segs3d    = [view3d.add(ax.plot([0, 0], [0, 0], [0, 0],
+                                 color=SEG_COLORS[i % len(SEG_COLORS)], linewidth=3,
+                                 solid_capstyle="round")[0]) for i in range(N_PTS - 1)]
+_joints3d  = view3d.add(ax.plot([0], [0], [0], "o", color="cyan", ms=6)[0])
+_ee3d      = view3d.add(ax.plot([0], [0], [0], "o", color="white", mec="black",
+                                mew=0.5, ms=11)[0])
+_labels3d  = [view3d.add(ax.text(0, 0, 0, lbl, fontsize=8, color="dimgray"))
+              for lbl in _joint_label_list()]
+_target3d  = view3d.add(ax.plot([0], [0], [0], "x", color="red", ms=12, mew=2)[0])
+_poi3d     = view3d.add(ax.plot([0], [0], [0], "*", color="lime", ms=15)[0])
+_poistk3d  = view3d.add(ax.plot([0, 0], [0, 0], [0, 0], color="lime", lw=0.8,
+                                linestyle=":", alpha=0.5)[0])
+_err3d     = view3d.add(ax.plot([0, 0], [0, 0], [0, 0], color="red", lw=1.0,
+                                linestyle="--", alpha=0.7)[0])
+ax.set_xlabel("X (m)"); ax.set_ylabel("Y (m)"); ax.set_zlabel("Z (m)")
+
+# Top view
+view2d = BlitView(canvas2, ax2)
+_reach2d  = ax2.plot([0], [0], color="#AAAAAA", lw=0.8, linestyle=":", alpha=0.6)[0]
+_shade2d  = ax2.imshow(_no_shade(), origin="lower", cmap="Greys", vmin=0, vmax=1,
+                       alpha=GRID_SHADE_ALPHA, interpolation="nearest", zorder=0)
+_segs2d   = [view2d.add(ax2.plot([0, 0], [0, 0], color=SEG_COLORS[i % len(SEG_COLORS)],
+                                 lw=2.5, solid_capstyle="round")[0]) for i in range(N_PTS - 1)]
+_joints2d = view2d.add(ax2.plot([0], [0], "o", color="cyan", ms=5.5, zorder=10)[0])
+_poi2d    = view2d.add(ax2.plot([0], [0], "*", color="lime", ms=15, zorder=9)[0])
+ax2.set_xlabel("X (m)"); ax2.set_ylabel("Y (m)")
+ax2.set_title("Top view (XY) — drag ★ to move POI", fontsize=9)
+ax2.grid(True, alpha=0.3)
+
+# Side view
+view_side = BlitView(canvas3, ax3)
+_arc_side   = ax3.plot([0], [0], color="#AAAAAA", lw=0.8, linestyle=":", alpha=0.6)[0]
+_shade_side = ax3.imshow(_no_shade(), origin="lower", cmap="Greys", vmin=0, vmax=1,
+                         alpha=GRID_SHADE_ALPHA, interpolation="nearest", zorder=0)
+ax3.axhline(0, color="brown", lw=0.8, alpha=0.4)                         # ground
+ax3.axhline(BOX_H, color="gray", lw=0.6, linestyle="--", alpha=0.3)      # base box height
+_segs_side   = [view_side.add(ax3.plot([0, 0], [0, 0], color=SEG_COLORS[i % len(SEG_COLORS)],
+                                       lw=2.5, solid_capstyle="round")[0]) for i in range(N_PTS - 1)]
+_joints_side = view_side.add(ax3.plot([0], [0], "o", color="cyan", ms=5.5, zorder=10)[0])
+_ee_side     = view_side.add(ax3.plot([0], [0], "o", color="white", mec="black",
+                                      mew=0.5, ms=11, zorder=10)[0])
+_target_side = view_side.add(ax3.plot([0], [0], "x", color="red", ms=12, mew=2, zorder=8)[0])
+_poi_side    = view_side.add(ax3.plot([0], [0], "*", color="lime", ms=15, zorder=9)[0])
+_poistk_side = view_side.add(ax3.plot([0, 0], [0, 0], color="lime", lw=0.8,
+                                      linestyle=":", alpha=0.5)[0])
+ax3.set_xlabel("r — horizontal reach (m)")
+ax3.set_ylabel("Z (m)")
+ax3.set_title("Side view (r–Z arm plane)", fontsize=9)
+ax3.grid(True, alpha=0.3)
+
+def _target_xyz():
+    yaw = joint_scales[0].get()
+    return (target["r"] * math.cos(deg2rad(yaw)),
+            target["r"] * math.sin(deg2rad(yaw)),
+            target["z"])
+
 def draw():
+    """Render a frame; each view only redraws what its inputs changed."""
     global _redraw_pending
     _redraw_pending = False
-    ax.clear()
-
-    Ts   = fk_chain()
-    pts  = [point_from_T(T) for T in Ts]
-    xs   = [p[0] for p in pts]
-    ys   = [p[1] for p in pts]
-    zs   = [p[2] for p in pts]
-
+    pts   = fk_chain()
     reach = current_reach()
-
-    # Reach circle
-    theta = np.linspace(0, 2 * np.pi, 120)
-    ax.plot(reach * np.cos(theta), reach * np.sin(theta), np.zeros(120),
-            color="#AAAAAA", lw=0.8, linestyle=":", alpha=0.6,
-            label=f"Max reach ({reach:.2f} m)")
-
-    # Shadow
-    ax.plot(xs, ys, [0]*len(zs), color="gray", lw=1.5, alpha=0.3, linestyle="--")
-
-    # Segments
-    n_segs = len(xs) - 1
-    for i in range(n_segs):
-        col = SEG_COLORS[i % len(SEG_COLORS)]
-        ax.plot([xs[i], xs[i+1]], [ys[i], ys[i+1]], [zs[i], zs[i+1]],
-                color=col, linewidth=3, solid_capstyle="round")
-
-    # Joints
-    for i, (jx, jy, jz) in enumerate(zip(xs, ys, zs)):
-        size  = 120 if i == len(xs) - 1 else 40
-        color = "white" if i == len(xs) - 1 else "cyan"
-        ax.scatter([jx], [jy], [jz], s=size, c=color, depthshade=False, zorder=10)
-        lbl = JOINT_LABELS[i] if i < len(JOINT_LABELS) else str(i)
-        ax.text(jx, jy, jz + 0.04, lbl, fontsize=8, color="dimgray")
-
-    # IK target
-    yaw = joint_scales[0].get()
-    tx  = target["r"] * math.cos(deg2rad(yaw))
-    ty  = target["r"] * math.sin(deg2rad(yaw))
-    tz  = target["z"]
-    ax.scatter([tx], [ty], [tz], marker="x", s=140, c="red", zorder=8)
-
-    # POI
-    ax.scatter([poi["x"]], [poi["y"]], [poi["z"]],
-               marker="*", s=220, c="lime", zorder=9, label="POI")
-    ax.plot([poi["x"], poi["x"]], [poi["y"], poi["y"]], [0, poi["z"]],
-            color="lime", lw=0.8, linestyle=":", alpha=0.5)
-
-    # IK error line
+    tgt   = _target_xyz()
+    _draw_3d(pts, reach, tgt)
+    draw_2d(pts)
+    draw_side(pts)
+
+def _draw_3d(pts, reach, tgt):
+    xs, ys, zs = zip(*pts)
+    tx, ty, tz = tgt
     Ex, Ey, Ez = pts[-1]
     err = math.sqrt((Ex-tx)**2 + (Ey-ty)**2 + (Ez-tz)**2)
-    if err > 0.005:
-        ax.plot([Ex, tx], [Ey, ty], [Ez, tz],
-                color="red", lw=1.0, linestyle="--", alpha=0.7)
-
-    ax.set_xlim(-reach, reach)
-    ax.set_ylim(-reach, reach)
-    ax.set_zlim(0, BOX_H + reach)
-    ax.set_xlabel("X (m)"); ax.set_ylabel("Y (m)"); ax.set_zlabel("Z (m)")
-    ik_label = "Jacobian DLS" if ik_mode.get() == "jacobian" else "LM"
-    ax.set_title(f"N={N_JOINTS}-joint Arm — drag EE, click bg, or sliders  [{ik_label}]",
-                 fontsize=9)
+    ik_label = "Jacobian DLS" if ik_mode.get() == "jacobian" else "multi-seed"
+
+    def static():
+        theta = np.linspace(0, 2 * np.pi, 120)
+        _reach3d.set_data_3d(reach * np.cos(theta), reach * np.sin(theta), np.zeros(120))
+        ax.set_xlim(-reach, reach)
+        ax.set_ylim(-reach, reach)
+        ax.set_zlim(0, BOX_H + reach)
+        ax.set_title(f"N={N_JOINTS}-joint Arm — drag EE, click bg, or sliders  [{ik_label}]",
+                     fontsize=9)
+
+    def dynamic():
+        _shadow3d.set_data_3d(xs, ys, [0] * len(zs))
+        for i, seg in enumerate(_segs3d):
+            seg.set_data_3d(xs[i:i+2], ys[i:i+2], zs[i:i+2])
+        _joints3d.set_data_3d(xs[:-1], ys[:-1], zs[:-1])
+        _ee3d.set_data_3d(xs[-1:], ys[-1:], zs[-1:])
+        for t, (jx, jy, jz) in zip(_labels3d, pts):
+            t.set_position_3d((jx, jy, jz + 0.04))
+        _target3d.set_data_3d([tx], [ty], [tz])
+        _poi3d.set_data_3d([poi["x"]], [poi["y"]], [poi["z"]])
+        _poistk3d.set_data_3d([poi["x"]] * 2, [poi["y"]] * 2, [0, poi["z"]])
+        _err3d.set_data_3d([Ex, tx], [Ey, ty], [Ez, tz])
+        _err3d.set_visible(err > 0.005)
+
+    view3d.frame((reach, ik_label), (tuple(pts), tgt, tuple(poi.values())),
+                 static, dynamic)
 
     reach_pct   = math.sqrt(Ex**2 + Ey**2 + Ez**2) / reach * 100
     warn        = "  ⚠ near limit" if reach_pct > REACH_WARN_PCT else ""
@@ -544,7 +630,7 @@ def draw():
     angle_lines = "\n".join(
         [f"  J{i}: {joint_scales[i].get():+.1f}°" for i in range(N_JOINTS)]
     )
-    info.config(fg=warn_color, text=(
+    text = (
         f"Joints:\n{angle_lines}\n\n"
         f"End-effector:\n"
         f"  X={Ex:+.3f}  Y={Ey:+.3f}  Z={Ez:+.3f} m\n"
@@ -554,98 +640,106 @@ def draw():
         f"  err={err*100:.1f} cm\n\n"
         f"Keys: R=reset  Q=quit  ←→↑↓=nudge\n"
         f"3D: drag EE(○) or click bg to aim"
-    ))
-
-    canvas.draw()
-    draw_2d()
-    draw_side()
+    )
+    if info.cget("text") != text or info.cget("fg") != warn_color:
+        info.config(fg=warn_color, text=text)
 
-def draw_2d():
-    ax2.clear()
+def draw_2d(pts=None):
+    if pts is None:
+        pts = fk_chain()
     reach = current_reach()
-
-    theta = np.linspace(0, 2 * np.pi, 120)
-    ax2.plot(reach * np.cos(theta), reach * np.sin(theta),
-             color="#AAAAAA", lw=0.8, linestyle=":", alpha=0.6)
-
-    Ts   = fk_chain()
-    pts  = [point_from_T(T) for T in Ts]
-    xs2  = [p[0] for p in pts]
-    ys2  = [p[1] for p in pts]
-
-    n_segs = len(xs2) - 1
-    for i in range(n_segs):
-        col = SEG_COLORS[i % len(SEG_COLORS)]
-        ax2.plot([xs2[i], xs2[i+1]], [ys2[i], ys2[i+1]], color=col, lw=2.5,
-                 solid_capstyle="round")
-    for jx, jy in zip(xs2, ys2):
-        ax2.scatter([jx], [jy], s=30, c="cyan", zorder=10)
-
-    ax2.scatter([poi["x"]], [poi["y"]], marker="*", s=220, c="lime", zorder=9)
-
-    ax2.set_xlim(-reach, reach); ax2.set_ylim(-reach, reach)
-    ax2.set_aspect("equal")
-    ax2.set_xlabel("X (m)"); ax2.set_ylabel("Y (m)")
-    ax2.set_title("Top view (XY) — drag ★ to move POI", fontsize=9)
-    ax2.grid(True, alpha=0.3)
-    canvas2.draw()
-
-def draw_side():
-    ax3.clear()
+    _, top = _grid_masks()
+    xs, ys, _ = zip(*pts)
+
+    def static():
+        theta = np.linspace(0, 2 * np.pi, 120)
+        _reach2d.set_data(reach * np.cos(theta), reach * np.sin(theta))
+        _shade2d.set_data(top)
+        _shade2d.set_extent((-reach, reach, -reach, reach))
+        ax2.set_xlim(-reach, reach); ax2.set_ylim(-reach, reach)
+        ax2.set_aspect("equal")
+
+    def dynamic():
+        for i, seg in enumerate(_segs2d):
+            seg.set_data(xs[i:i+2], ys[i:i+2])
+        _joints2d.set_data(xs, ys)
+        _poi2d.set_data([poi["x"]], [poi["y"]])
+
+    view2d.frame((reach, _shade["key"]), (xs, ys, poi["x"], poi["y"]), static, dynamic)
+
+def draw_side(pts=None):
+    if pts is None:
+        pts = fk_chain()
     reach = current_reach()
-
-    Ts  = fk_chain()
-    pts = [point_from_T(T) for T in Ts]
+    side, _ = _grid_masks()
     # r = horizontal reach at each joint (signed: negative behind base)
-    rs  = [math.hypot(p[0], p[1]) for p in pts]
-    zs  = [p[2] for p in pts]
-
-    # Max-reach arc (quarter circle in r-z plane)
-    arc_angles = np.linspace(0, np.pi / 2, 80)
-    ax3.plot(reach * np.cos(arc_angles), BOX_H + reach * np.sin(arc_angles),
-             color="#AAAAAA", lw=0.8, linestyle=":", alpha=0.6,
-             label=f"Max reach ({reach:.2f} m)")
-
-    # Ground line
-    ax3.axhline(0, color="brown", lw=0.8, alpha=0.4)
-    # Base box height
-    ax3.axhline(BOX_H, color="gray", lw=0.6, linestyle="--", alpha=0.3)
-
-    # Arm segments
-    n_segs = len(rs) - 1
-    for i in range(n_segs):
-        col = SEG_COLORS[i % len(SEG_COLORS)]
-        ax3.plot([rs[i], rs[i+1]], [zs[i], zs[i+1]], color=col, lw=2.5,
-                 solid_capstyle="round")
-    for idx, (jr, jz) in enumerate(zip(rs, zs)):
-        is_ee = (idx == len(rs) - 1)
-        ax3.scatter([jr], [jz], s=120 if is_ee else 30,
-                    c="white" if is_ee else "cyan", zorder=10)
-
-    # IK target
-    ax3.scatter([target["r"]], [target["z"]], marker="x", s=140, c="red",
-                zorder=8, label="IK target")
-
-    # POI projected onto arm plane
-    poi_r = math.hypot(poi["x"], poi["y"])
-    ax3.scatter([poi_r], [poi["z"]], marker="*", s=220, c="lime",
-                zorder=9, label="POI")
-    ax3.plot([poi_r, poi_r], [0, poi["z"]], color="lime", lw=0.8,
-             linestyle=":", alpha=0.5)
-
-    ax3.set_xlim(0, reach * 1.1)
-    ax3.set_ylim(0, BOX_H + reach * 1.1)
-    ax3.set_xlabel("r — horizontal reach (m)")
-    ax3.set_ylabel("Z (m)")
-    ax3.set_title("Side view (r–Z arm plane)", fontsize=9)
-    ax3.grid(True, alpha=0.3)
-    canvas3.draw()
+    rs = [math.hypot(p[0], p[1]) for p in pts]
+    zs = [p[2] for p in pts]
+    poi_r = math.hypot(poi["x"], poi["y"])      # POI projected onto arm plane
+
+    def static():
+        # Max-reach arc (quarter circle in r-z plane)
+        arc_angles = np.linspace(0, np.pi / 2, 80)
+        _arc_side.set_data(reach * np.cos(arc_angles), BOX_H + reach * np.sin(arc_angles))
+        _shade_side.set_data(side)
+        _shade_side.set_extent(grid.extent())
+        ax3.set_xlim(0, reach * 1.1)
+        ax3.set_ylim(0, BOX_H + reach * 1.1)
+
+    def dynamic():
+        for i, seg in enumerate(_segs_side):
+            seg.set_data(rs[i:i+2], zs[i:i+2])
+        _joints_side.set_data(rs[:-1], zs[:-1])
+        _ee_side.set_data(rs[-1:], zs[-1:])
+        _target_side.set_data([target["r"]], [target["z"]])
+        _poi_side.set_data([poi_r], [poi["z"]])
+        _poistk_side.set_data([poi_r, poi_r], [0, poi["z"]])
+
+    view_side.frame((reach, _shade["key"]),
+                    (tuple(rs), tuple(zs), target["r"], target["z"], poi_r, poi["z"]),
+                    static, dynamic)
 
 def request_draw():
+    """Coalesce redraw requests into at most one frame per FRAME_MS."""
     global _redraw_pending
     if not _redraw_pending:
         _redraw_pending = True
-        root.after(REDRAW_MS, draw)
+        root.after(FRAME_MS, draw)
+
+# ─────────────────────────────────────────
+# Reachable-workspace grid
+# ─────────────────────────────────────────
+grid      = None
+_grid_job = None
+_shade    = {"key": None, "side": None, "top": None}
+
+def rebuild_grid():
+    """Grid for the current chain, from the disk cache or built in the background."""
+    global grid, _grid_job
+    if _grid_job is not None:
+        root.after_cancel(_grid_job)
+        _grid_job = None
+    lo, hi = _q_limits()
+    grid = reach_grid.ReachGrid(chain_a, BOX_H, lo, hi,
+                                cells=GRID_CELLS, phis=WRIST_PHIS)
+    _grow_grid()
+
+def _grow_grid():
+    global _grid_job
+    _grid_job = None
+    if grid.build_rows(GRID_ROWS_PER_TICK):
+        _grid_job = root.after(1, _grow_grid)
+    else:
+        request_draw()
+
+def _grid_masks():
+    """Unreachable masks for the side and top views, redone only when the grid grew."""
+    key = (id(grid), grid.version)
+    if _shade["key"] != key:
+        _shade["key"]  = key
+        _shade["side"] = np.ma.masked_where(~grid.side_mask(), np.ones((grid.nz, grid.nr)))
+        _shade["top"]  = np.ma.masked_where(~grid.top_mask(), np.ones((121, 121)))
+    return _shade["side"], _shade["top"]
 
 # ─────────────────────────────────────────
 # Slider callbacks
@@ -662,7 +756,7 @@ def on_slider(_=None):
 for sc in joint_scales:
     sc.config(command=on_slider)
 for sp in offset_spinboxes:
-    sp.config(command=on_slider)
+    sp.config(command=on_offset_change)
 
 # ─────────────────────────────────────────
 # Reset
@@ -813,11 +907,7 @@ def on_motion(event):
     if ik_mode.get() == "jacobian":
         q_new = jacobian_dls_ik(tx, ty, target["z"], q0)
     else:
-        # LM path (slower, more accurate)
-        from spatialmath import SE3 as _SE3
-        T_tgt = _SE3(tx, ty, target["z"])
-        sol = robot.ikine_LM(T_tgt, q0=q0, mask=[1, 1, 1, 0, 0, 0])
-        q_new = sol.q if sol.success else q0
+        q_new = ik_solve_accurate(target["r"], target["z"], q0)
 
     apply_q_to_sliders(q_new)
     Ex, Ey, Ez = current_EE()
@@ -890,9 +980,7 @@ def on_motion_side(event):
     if ik_mode.get() == "jacobian":
         q_new = jacobian_dls_ik(tx, ty, new_z, q0)
     else:
-        T_tgt = SE3(tx, ty, new_z)
-        sol   = robot.ikine_LM(T_tgt, q0=q0, mask=[1, 1, 1, 0, 0, 0])
-        q_new = sol.q if sol.success else q0
+        q_new = ik_solve_accurate(new_r, new_z, q0)
 
     apply_q_to_sliders(q_new)
     Ex, Ey, Ez = current_EE()
@@ -938,6 +1026,8 @@ root.bind("<KeyPress>", on_key)
 # ─────────────────────────────────────────
 # Boot
 # ─────────────────────────────────────────
+rebuild_grid()
+
 Ex0, Ey0, Ez0 = current_EE()
 target["r"] = math.hypot(Ex0, Ey0)
 target["z"] = Ez0
@@ -0,0 +1,115 @@
+# Fixed-size sample filters, same behaviour as filter.c in the IO board firmware
+# (Inv/Inv7/Op8/Op8). Every update is incremental, value() costs nothing.
+#
+#   med = RunningMedian(5)
+#   for x in samples:
+#       y = med.update(x)
+
+from bisect import bisect_left, insort
+
+
+class RunningMedian:
+    # Median of the last n samples, the window is kept sorted.
+    # An even count gives the mean of the two middle samples.
+
+    def __init__(self, n: int):
+        self.n      = n
+        self._ring  = [0] * n
+        self._sorted = []
+        self._head  = 0
+
+    def update(self, x):
+        if len(self._sorted) == self.n:
+            del self._sorted[bisect_left(self._sorted, self._ring[self._head])]
+        insort(self._sorted, x)
+        self._ring[self._head] = x
+        self._head = (self._head + 1) % self.n
+        return self.value()
+
+    def value(self):
+        s, k = self._sorted, len(self._sorted)
+        if k == 0:
+            return 0
+        if k & 1:
+            return s[k // 2]
+        return (s[k // 2 - 1] + s[k // 2]) / 2
+
+    def reset(self):
+        self._sorted.clear()
+        self._head = 0
+
+
+class Boxcar:
+    # Mean of the last n samples from a running sum
+
+    def __init__(self, n: int):
+        self.n     = n
+        self._ring = [0] * n
+        self._sum  = 0
+        self._count = 0
+        self._head = 0
+
+    def update(self, x):
+        if self._count == self.n:
+            self._sum -= self._ring[self._head]
+        else:
+            self._count += 1
+        self._sum += x
+        self._ring[self._head] = x
+        self._head = (self._head + 1) % self.n
+        return self.value()
+
+    def value(self):
+        return self._sum / self._count if self._count else 0
+
+    def reset(self):
+        self._sum = self._count = self._head = 0
+
+
+class Ema:
+    # Exponential moving average. shift gives alpha = 2^-shift like the
+    # firmware, or pass alpha directly.
+
+    def __init__(self, alpha: float = None, shift: int = None):
+        self.alpha = alpha if alpha is not None else 2.0 ** -(shift or 0)
+        self._value = None
+
+    def update(self, x):
+        if self._value is None:
+            self._value = float(x)      # first sample sets the average
+        else:
+            self._value += self.alpha * (x - self._value)
+        return self._value
+
+    def value(self):
+        return 0 if self._value is None else self._value
+
+    def reset(self):
+        self._value = None
+
+
+class MedianBoxcar:
+    # Running median followed by a boxcar, the chain the board uses per load cell
+
+    def __init__(self, median_len: int = 5, avg_len: int = 4):
+        self.median = RunningMedian(median_len)
+        self.avg    = Boxcar(avg_len)
+
+    def update(self, x):
+        return self.avg.update(self.median.update(x))
+
+    def value(self):
+        return self.avg.value()
+
+    def reset(self):
+        self.median.reset()
+        self.avg.reset()
+
+
+# filter.c itself when the armext module is built (native/): integer samples
+# and integer results exactly as on the board, update() and run() in C.
+# None without it, the classes above are the portable versions.
+try:
+    from armext import Median as BoardMedian, Boxcar as BoardBoxcar, Ema as BoardEma
+except ImportError:
+    BoardMedian = BoardBoxcar = BoardEma = None
@@ -1,114 +1,143 @@
-# HX711 load cell amplifier — multi-sensor
-# Wiring: DT1 → GPIO 6, DT2 → GPIO 13, DT3 → GPIO 19
-#         SCK (shared) → GPIO 5
-
-from gpiozero import InputDevice, OutputDevice
-from collections import deque
-import statistics
-import lgpio
+# HX711 load cell amplifiers — multi-sensor, read by the IO board
+# Wiring (AVR, Inv7/Op8 firmware hx711.c):
+#         DT1 → PA2, DT2 → PA3, DT3 → PA4
+#         SCK (shared) → PA5
+#
+# The board clocks all three in parallel, filters (median + moving average)
+# and keeps tare/calibration. This module only asks, through the shared
+# pipelined client in Inv8/Op8.py: one owner of the link, which also did the
+# BAUD negotiation. Nothing is opened at import, call connect() once.
+#
+# The *_async functions return a Future with the reply line ("" when the
+# board did not answer) and never block; use Op8.on_reply() to get it in the
+# Tk thread. The blocking ones wait for the reply and are for scripts.
+
+import sys, os
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "Inv", "Inv8"))
+
 import time
 
-PIN_DT1     = 6
-PIN_DT2     = 13
-PIN_DT3     = 19
-PIN_SCK     = 5
-GAIN_PULSES = 25   # 25 = Channel A, gain 128 (default)
-                   # 26 = Channel B, gain 32
-                   # 27 = Channel A, gain 64
+import Op8
 
-def _open_device(pin):
-    try:
-        return InputDevice(pin)
-    except Exception:
-        h = lgpio.gpiochip_open(0)
-        lgpio.gpio_free(h, pin)
-        lgpio.gpiochip_close(h)
-        return InputDevice(pin)
-
-def _open_output(pin):
-    try:
-        return OutputDevice(pin, initial_value=False)
-    except Exception:
-        h = lgpio.gpiochip_open(0)
-        lgpio.gpio_free(h, pin)
-        lgpio.gpiochip_close(h)
-        return OutputDevice(pin, initial_value=False)
+SENSOR_COUNT = 3
+TIMEOUT = 1.0       # s, blocking calls
+
+
+def connect():
+    # Open the link unless this process already has it
+    if Op8.client is None:
+        Op8.connect_serial()
+    return Op8.client is not None
+
+def close():
+    if Op8.client is not None:
+        Op8.client.close()
+        Op8.client = None
+    if Op8.ser is not None and Op8.ser.is_open:
+        Op8.ser.close()
+
+def _wait(fut, cmd: str) -> str:
+    resp = fut.result(TIMEOUT + Op8.client.timeout if Op8.client else TIMEOUT)
+    if not resp:
+        raise TimeoutError(f"IO board did not answer {cmd!r}")
+    return resp
+
+
+def weights_async():
+    return Op8.send_async("WEIGHT")
+
+def parse_weights(resp: str) -> list:
+    # "WEIGHT:valid,g0,g1,g2" -> grams, None for a sensor without a value.
+    # No reply gives None for all of them.
+    if not resp.startswith("WEIGHT:"):
+        return [None] * SENSOR_COUNT
+    valid, *grams = resp[7:].split(",")
+    valid = int(valid)
+    return [float(g) if valid & (1 << i) else None for i, g in enumerate(grams)]
+
+def read_all() -> list:
+    resp = _wait(weights_async(), "WEIGHT")
+    if not resp.startswith("WEIGHT:"):
+        raise RuntimeError(f"bad reply {resp!r}")
+    return parse_weights(resp)
+
+def read_raw_all() -> list:
+    # (raw, filtered, reads, errors) per sensor
+    resp = _wait(Op8.send_async("HXRAW"), "HXRAW")
+    if not resp.startswith("HXRAW:"):
+        raise RuntimeError(f"bad reply {resp!r}")
+    parts = resp[6:].split(";")
+    return [tuple(int(v) for v in p.split(",")) for p in parts[:SENSOR_COUNT]]
+
+def tare_all_async():
+    return Op8.send_async("TARE")
+
+def tare_all():
+    if _wait(tare_all_async(), "TARE") != "OK":
+        raise RuntimeError("tare failed")
+
+def parse_calibration(resp: str) -> float:
+    # "OK:q8" -> counts per gram
+    if not resp.startswith("OK:"):
+        raise RuntimeError("calibration failed — tare first and put the weight on")
+    return int(resp[3:]) / 256
 
-# Shared clock
-sck = _open_output(PIN_SCK)
 
 class HX711:
-    def __init__(self, pin_dt):
-        self.dt          = _open_device(pin_dt)
-        self._buf        = deque(maxlen=10)
-        self.hx_offset   = 0.0
-        self.scale_factor = 1.0
+    def __init__(self, ch):
+        self.ch = ch
 
     def read_raw(self) -> int:
-        timeout = time.time() + 1.0
-        while self.dt.value == 1:
-            if time.time() > timeout:
-                raise TimeoutError("HX711 not responding — check wiring")
-        raw = 0
-        for _ in range(24):
-            sck.on()
-            raw = (raw << 1) | self.dt.value
-            sck.off()
-        for _ in range(GAIN_PULSES - 24):
-            sck.on()
-            sck.off()
-        if raw & 0x800000:
-            raw -= 0x1000000
-        return raw
-
-    def read_stable(self) -> float:
-        self._buf.append(self.read_raw())
-        return statistics.median(self._buf)
+        return read_raw_all()[self.ch][0]
+
+    def read_grams(self) -> float:
+        g = read_all()[self.ch]
+        if g is None:
+            raise TimeoutError("HX711 not responding — check wiring")
+        return g
 
     def read_median(self, samples: int = 10) -> float:
-        #Takes N fresh readingsand returns their median
-        readings = [self.read_raw() for _ in range(samples)]
-        return statistics.median(readings)
+        # The board already filters, kept for older callers
+        return self.read_grams()
 
-    def tare(self, samples: int = 10) -> float:
-        self.hx_offset = sum(self.read_raw() for _ in range(samples)) / samples
-        return self.hx_offset
+    def tare_async(self):
+        return Op8.send_async(f"TARE:{self.ch}")
 
-    def calibrate(self, known_grams: float, samples: int = 10) -> float:
-        tared = sum(self.read_raw() - self.hx_offset for _ in range(samples)) / samples
-        self.scale_factor = tared / known_grams
-        return self.scale_factor
+    def tare(self):
+        if _wait(self.tare_async(), "TARE") != "OK":
+            raise RuntimeError("tare failed, no reading yet")
 
-    def read_grams(self) -> float:
-        return (self.read_stable() - self.hx_offset) / self.scale_factor
+    def calibrate_async(self, known_grams: float):
+        return Op8.send_async(f"HXCAL:{self.ch},{round(known_grams)}")
+
+    def calibrate(self, known_grams: float):
+        return parse_calibration(_wait(self.calibrate_async(known_grams), "HXCAL"))
 
     def close(self):
-        self.dt.close()
+        pass
 
 
 # Sensor instances
-sensor1 = HX711(PIN_DT1)
-sensor2 = HX711(PIN_DT2)
-sensor3 = HX711(PIN_DT3)
+sensor1 = HX711(0)
+sensor2 = HX711(1)
+sensor3 = HX711(2)
 
 
 if __name__ == "__main__":
+    if not connect():
+        sys.exit(1)
     try:
         print("HX711 test — sensor 1")
         sensor1.tare()
-        print(f"  Offset = {sensor1.hx_offset:.0f}")
         known = float(input("Weight of calibration object in grams: "))
         input(f"Place {known}g on the scale and press Enter...")
-        sensor1.calibrate(known)
+        print(f"  {sensor1.calibrate(known):.1f} counts/g")
         input("Remove calibration weight and press Enter...")
         print("\nReading... (Ctrl+C to stop)\n")
         while True:
-            print(f"  {sensor1.read_grams():8.1f} g")
+            print("  " + "  ".join("   --   " if g is None else f"{g:8.1f}" for g in read_all()) + " g")
             time.sleep(0.2)
     except KeyboardInterrupt:
         print("\nStopped.")
     finally:
-        sensor1.close()
-        sensor2.close()
-        sensor3.close()
-        sck.close()
+        close()
@@ -3,6 +3,7 @@
 # Enable with: sudo raspi-config → Interface Options → I2C → Enable
 
 import smbus2
+import threading
 import time
 
 I2C_BUS  = 1
@@ -24,20 +25,55 @@ MIDJE_MIN_US = 500
 MIDJE_MAX_US = 2500
 PUMP_MIN_US  = 500
 PUMP_MAX_US  = 2500
+PUMP_US_PER_PCT = (PUMP_MAX_US - PUMP_MIN_US) / 100
+
+# PCA9685 registers
+REG_MODE1     = 0x00
+REG_LED0      = 0x06     # LEDn_ON_L, ON_H, OFF_L, OFF_H at 0x06 + 4*n
+REG_ALL_LED   = 0xFA     # ALL_LED_ON_L .. ALL_LED_OFF_H, written to every channel
+REG_PRESCALE  = 0xFE
+MODE1_AI      = 0x20     # auto-increment: one burst covers consecutive registers
+MODE1_SLEEP   = 0x10
+FULL_OFF      = 0x10     # bit 4 of LEDn_OFF_H
 
 bus = smbus2.SMBus(I2C_BUS)
-bus.write_byte_data(PCA_ADDR, 0x00, 0x10)   # sleep
-bus.write_byte_data(PCA_ADDR, 0xFE, 0x79)   # ~50 Hz
-bus.write_byte_data(PCA_ADDR, 0x00, 0x00)   # wake
+bus.write_byte_data(PCA_ADDR, REG_MODE1, MODE1_SLEEP)
+bus.write_byte_data(PCA_ADDR, REG_PRESCALE, 0x79)   # ~50 Hz
+bus.write_byte_data(PCA_ADDR, REG_MODE1, MODE1_AI)  # wake with auto-increment
 time.sleep(0.01)
 
+# Ticks last written per channel, unchanged channels are not sent again
+_last_ticks = [None] * 16
+
+def us_to_ticks(pulse_us):
+    return round(pulse_us / 20000 * 4096)
+
+def _led_bytes(ticks):
+    # ON at 0, OFF at ticks
+    return [0x00, 0x00, ticks & 0xFF, (ticks >> 8) & 0x0F]
+
+def write_ticks(first, ticks):
+    # Channels first.. get ticks[i] in one auto-increment burst. Only the span
+    # from the first to the last changed channel goes on the bus. The outputs
+    # switch together on the STOP, so a frame never shows half old, half new.
+    changed = [i for i, t in enumerate(ticks) if _last_ticks[first + i] != t]
+    if not changed:
+        return
+    lo, hi = changed[0], changed[-1]
+    data = []
+    for t in ticks[lo:hi + 1]:
+        data += _led_bytes(t)
+    bus.write_i2c_block_data(PCA_ADDR, REG_LED0 + 4 * (first + lo), data)   # max 8 channels (32 bytes)
+    _last_ticks[first + lo:first + hi + 1] = ticks[lo:hi + 1]
+
 def set_pwm(channel, pulse_us):
-    ticks = round(pulse_us / 20000 * 4096)
-    reg   = 0x06 + channel * 4
-    bus.write_byte_data(PCA_ADDR, reg + 0, 0x00)
-    bus.write_byte_data(PCA_ADDR, reg + 1, 0x00)
-    bus.write_byte_data(PCA_ADDR, reg + 2, ticks & 0xFF)
-    bus.write_byte_data(PCA_ADDR, reg + 3, (ticks >> 8) & 0x0F)
+    write_ticks(channel, [us_to_ticks(pulse_us)])
+
+def all_off():
+    # Every channel off with one 4-byte write to the ALL_LED registers
+    bus.write_i2c_block_data(PCA_ADDR, REG_ALL_LED, [0x00, 0x00, 0x00, FULL_OFF])
+    for ch in range(16):
+        _last_ticks[ch] = None      # the channel registers no longer match
 
 def angle_to_us(deg):
     return max(SERVO_MIN_US, min(SERVO_MAX_US, int(CENTER_US + deg * US_PER_DEG)))
@@ -46,14 +82,89 @@ def midje_to_us(deg):
     return max(MIDJE_MIN_US, min(MIDJE_MAX_US, int(CENTER_US + deg * US_PER_DEG)))
 
 def pump_to_us(pct):
-    return int(PUMP_MIN_US + pct * (PUMP_MAX_US - PUMP_MIN_US) / 100)
+    return max(PUMP_MIN_US, min(PUMP_MAX_US, int(PUMP_MIN_US + pct * PUMP_US_PER_PCT)))
+
+# (offset us, us per unit, min us, max us) for CH_MIDJE..CH_PUMP, the same
+# numbers as the *_to_us() functions above
+DRIVE_MAP = (
+    (CENTER_US,   US_PER_DEG,      MIDJE_MIN_US, MIDJE_MAX_US),
+    (CENTER_US,   US_PER_DEG,      SERVO_MIN_US, SERVO_MAX_US),
+    (CENTER_US,   US_PER_DEG,      SERVO_MIN_US, SERVO_MAX_US),
+    (CENTER_US,   US_PER_DEG,      SERVO_MIN_US, SERVO_MAX_US),
+    (PUMP_MIN_US, PUMP_US_PER_PCT, PUMP_MIN_US,  PUMP_MAX_US),
+)
+
+try:
+    import armext                       # native/, the whole frame in one C call
+    _drive_map = armext.ServoMap(DRIVE_MAP)
+except ImportError:
+    _drive_map = None
 
 def drive(midje, skulder, albue, wrist, pump):
-    set_pwm(CH_MIDJE,   midje_to_us(midje))
-    set_pwm(CH_SKULDER, angle_to_us(skulder))
-    set_pwm(CH_ALBUE,   angle_to_us(albue))
-    set_pwm(CH_WRIST,   angle_to_us(wrist))
-    set_pwm(CH_PUMP,   pump_to_us(pump))
+    # CH_MIDJE..CH_PUMP are channels 0..4: one burst of at most 20 bytes
+    if _drive_map is not None:
+        ticks = _drive_map.ticks((midje, skulder, albue, wrist, pump))
+    else:
+        ticks = [
+            us_to_ticks(midje_to_us(midje)),
+            us_to_ticks(angle_to_us(skulder)),
+            us_to_ticks(angle_to_us(albue)),
+            us_to_ticks(angle_to_us(wrist)),
+            us_to_ticks(pump_to_us(pump)),
+        ]
+    write_ticks(CH_MIDJE, ticks)
+
+FRAME_HZ = 50      # one PCA9685 PWM period, faster writes are never seen by the servos
+
+class Output:
+    # Servo output thread. set() only stores the newest joint targets, the
+    # thread sends them once per frame, so callers never wait for the bus
+    # and bus load stays one burst per frame however often set() is called.
+
+    def __init__(self, rate_hz: float = FRAME_HZ):
+        self.period   = 1.0 / rate_hz
+        self._lock    = threading.Lock()
+        self._pending = None
+        self._stop    = threading.Event()
+        self._thread  = threading.Thread(target=self._run, daemon=True)
+        self.frames   = 0          # frames that went on the bus
+        self.errors   = 0
+
+    def set(self, *joints):
+        with self._lock:
+            self._pending = joints
+
+    def start(self):
+        self._thread.start()
+
+    def stop(self):
+        # Sends what is still pending before returning
+        self._stop.set()
+        self._thread.join()
+
+    def _flush(self):
+        with self._lock:
+            joints, self._pending = self._pending, None
+        if joints is None:
+            return
+        try:
+            drive(*joints)
+            self.frames += 1
+        except OSError as e:
+            self.errors += 1
+            print(f"[I2C] {e}")
+
+    def _run(self):
+        next_t = time.monotonic()
+        while not self._stop.is_set():
+            self._flush()
+            next_t += self.period
+            delay = next_t - time.monotonic()
+            if delay < 0:
+                next_t = time.monotonic()      # fell behind, do not burst to catch up
+            else:
+                self._stop.wait(delay)
+        self._flush()
 
 
 if __name__ == "__main__":
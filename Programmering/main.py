@@ -3,6 +3,7 @@ import subprocess
 import math
 import i2c
 import hx711
+import Op8          # shared IO board link, on the path through hx711
 
 # Arm geometry (measure in cm)
 L1     = 15.0   # Skulder -> Albue
@@ -86,10 +87,15 @@ JOINT_VARS = [midje_var, skulder_var, albue_var, wrist_var, pump_var]
 def get_joints():
     return [v.get() for v in JOINT_VARS]
 
+# Servo writes go through one output thread at the PWM frame rate,
+# the GUI only hands over the newest targets
+output = i2c.Output()
+output.start()
+
 def set_joints(values):
     for var, val in zip(JOINT_VARS, values):
         var.set(val)
-    i2c.drive(*values)
+    output.set(*values)
 
 # Sliders
 
@@ -102,7 +108,7 @@ def make_slider(label, var, from_, to):
     s = Scale(f, variable=var, from_=from_, to=to, orient=HORIZONTAL,
               length=380, resolution=1)
     s.pack(side=LEFT, fill="x", expand=True)
-    s.config(command=lambda _: i2c.drive(*get_joints()))
+    s.config(command=lambda _: output.set(*get_joints()))
 
 make_slider("Midje",   midje_var,   -90, 90)
 make_slider("Skulder", skulder_var, -45, 45)
@@ -212,8 +218,6 @@ for i in range(NUM_POS):
 # Load cell
 Label(root, text=" Load Cell ", font=("Segoe UI", 11, "bold")).pack(pady=(14, 2))
 
-use_median = False
-
 for lbl_text, lbl_var in [("Sensor 1", None), ("Sensor 2", None), ("Sensor 3", None)]:
     Label(root, text=lbl_text, font=("Segoe UI", 9)).pack()
 
@@ -224,41 +228,36 @@ weight_lbl1.pack()
 weight_lbl2.pack()
 weight_lbl3.pack()
 
-mode_btn = Button(root, text="Mode: Live", width=16)
-mode_btn.pack(pady=4)
-
-def toggle_mode():
-    global use_median
-    use_median = not use_median
-    mode_btn.config(text="Mode: Median" if use_median else "Mode: Live")
-
-mode_btn.config(command=toggle_mode)
-
-def _read(sensor):
-    if use_median:
-        return (sensor.read_median() - sensor.hx_offset) / sensor.scale_factor
-    return sensor.read_grams()
-
 def poll_hx711():
-    interval = 500 if use_median else 200
-    for sensor, lbl in [(hx711.sensor1, weight_lbl1),
-                        (hx711.sensor2, weight_lbl2),
-                        (hx711.sensor3, weight_lbl3)]:
-        try:
-            lbl.config(text=f"{_read(sensor):.1f} g")
-        except Exception:
-            lbl.config(text="err")
-    root.after(interval, poll_hx711)
+    # One request for all three, the board does the reading and filtering.
+    # The reply comes back in the Tk thread, the next poll goes out after it.
+    labels = [weight_lbl1, weight_lbl2, weight_lbl3]
+
+    def show(resp):
+        for g, lbl in zip(hx711.parse_weights(resp), labels):
+            lbl.config(text="err" if g is None else f"{g:.1f} g")
+        root.after(200, poll_hx711)
+    Op8.on_reply(hx711.weights_async(), root, show)
 
 def calibrate_hx711():
     def do_calibrate():
         try:
-            hx711.sensor1.calibrate(float(cal_entry.get()))
-            hx711.sensor2.calibrate(float(cal_entry.get()))
-            hx711.sensor3.calibrate(float(cal_entry.get()))
-            cal_window.destroy()
-        except Exception as e:
-            cal_status.config(text=str(e), fg="red")
+            grams = float(cal_entry.get())
+        except ValueError:
+            cal_status.config(text="enter a weight in grams", fg="red")
+            return
+        sensors = [hx711.sensor1, hx711.sensor2, hx711.sensor3]
+        futs = [s.calibrate_async(grams) for s in sensors]
+
+        def done(_):
+            # replies come in order, all three are in with the last one
+            try:
+                for f in futs:
+                    hx711.parse_calibration(f.result())
+                cal_window.destroy()
+            except Exception as e:
+                cal_status.config(text=str(e), fg="red")
+        Op8.on_reply(futs[-1], root, done)
 
     cal_window = Toplevel(root)
     cal_window.title("Calibrate Load Cell")
@@ -270,7 +269,7 @@ def calibrate_hx711():
     cal_status.pack()
     Button(cal_window, text="Calibrate", command=do_calibrate).pack(pady=10)
 
-Button(root, text="Tare",      command=hx711.sensor1.tare).pack(pady=2)
+Button(root, text="Tare",      command=hx711.tare_all_async).pack(pady=2)
 Button(root, text="Calibrate", command=calibrate_hx711).pack(pady=2)
 
 # Benchmark launcher 
@@ -280,12 +279,12 @@ Button(root, text="Open Benchmark GUI",
 
 # Start
 
+hx711.connect()
 reset_all()
 poll_hx711()
 root.mainloop()
 
-hx711.sensor1.close()
-hx711.sensor2.close()
-hx711.sensor3.close()
-hx711.sck.close()
+hx711.close()
+output.stop()
+i2c.all_off()
 i2c.bus.close()
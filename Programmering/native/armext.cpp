@@ -0,0 +1,473 @@
+// Host side of the IO board code as one extension module. Framing, CRC and
+// the sample filters are the firmware's own proto.c and filter.c compiled
+// unchanged, so the RPi and the board cannot drift apart. ServoMap is the
+// angle -> PCA9685 tick conversion from i2c.py.
+//
+//   cd native && python3 setup.py build_ext --inplace
+//
+// Byte arguments take any buffer (bytes, bytearray, memoryview) and are read
+// in place, encode_into() writes straight into a caller's buffer.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+//Not on the include path: the firmware directory has its own sched.h
+extern "C" {
+#include "../Inv/Inv7/Op8/Op8/proto.h"
+#include "../Inv/Inv7/Op8/Op8/filter.h"
+}
+
+static bool to_i32(PyObject *o, int32_t *out){
+    long v = PyLong_AsLong(o);
+    if(v == -1 && PyErr_Occurred()) return false;
+    if(v < INT32_MIN || v > INT32_MAX){
+        PyErr_SetString(PyExc_OverflowError, "sample does not fit in int32");
+        return false;
+    }
+    *out = (int32_t)v;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Framing
+
+static PyObject *py_crc8(PyObject *, PyObject *args){
+    Py_buffer b;
+    unsigned int crc = 0;
+    if(!PyArg_ParseTuple(args, "y*|I:crc8", &b, &crc)) return nullptr;
+    uint8_t c = (uint8_t)crc;
+    const uint8_t *p = (const uint8_t *)b.buf;
+    for(Py_ssize_t i = 0; i < b.len; i++) c = proto_crc8_update(c, p[i]);
+    PyBuffer_Release(&b);
+    return PyLong_FromLong(c);
+}
+
+// Checks the payload and builds the frame into out, returns its size or -1
+static int encode_frame(uint8_t *out, int op, const Py_buffer *payload){
+    if(op < 0 || op > 0xFF){
+        PyErr_Format(PyExc_ValueError, "opcode %d out of range", op);
+        return -1;
+    }
+    if(payload->len > PROTO_MAX_PAYLOAD){
+        PyErr_Format(PyExc_ValueError, "payload %zd > %d", payload->len, PROTO_MAX_PAYLOAD);
+        return -1;
+    }
+    return proto_encode(out, (uint8_t)op, (const uint8_t *)payload->buf, (uint8_t)payload->len);
+}
+
+static PyObject *py_encode(PyObject *, PyObject *args){
+    int op;
+    Py_buffer b = {};
+    if(!PyArg_ParseTuple(args, "i|y*:encode", &op, &b)) return nullptr;
+    uint8_t out[PROTO_MAX_FRAME];
+    int n = encode_frame(out, op, &b);
+    PyBuffer_Release(&b);
+    if(n < 0) return nullptr;
+    return PyBytes_FromStringAndSize((const char *)out, n);
+}
+
+static PyObject *py_encode_into(PyObject *, PyObject *args){
+    Py_buffer dst, b = {};
+    Py_ssize_t offset;
+    int op;
+    if(!PyArg_ParseTuple(args, "w*ni|y*:encode_into", &dst, &offset, &op, &b)) return nullptr;
+    uint8_t out[PROTO_MAX_FRAME];
+    int n = encode_frame(out, op, &b);
+    if(n >= 0 && (offset < 0 || offset + n > dst.len)){
+        PyErr_SetString(PyExc_ValueError, "frame does not fit in the buffer");
+        n = -1;
+    }
+    if(n >= 0) memcpy((uint8_t *)dst.buf + offset, out, (size_t)n);
+    PyBuffer_Release(&dst);
+    PyBuffer_Release(&b);
+    if(n < 0) return nullptr;
+    return PyLong_FromLong(n);
+}
+
+// Decoder: proto.c's byte-at-a-time parser, frames come out as (op, payload)
+struct DecoderObject {
+    PyObject_HEAD
+    proto_rx_t rx;
+    Py_ssize_t errors;
+};
+
+static int decoder_init(PyObject *self, PyObject *args, PyObject *kw){
+    static const char *names[] = { nullptr };
+    if(!PyArg_ParseTupleAndKeywords(args, kw, ":Decoder", (char **)names)) return -1;
+    DecoderObject *d = (DecoderObject *)self;
+    proto_rx_reset(&d->rx);
+    d->errors = 0;
+    return 0;
+}
+
+static PyObject *decoder_feed(PyObject *self, PyObject *arg){
+    DecoderObject *d = (DecoderObject *)self;
+    Py_buffer b;
+    if(PyObject_GetBuffer(arg, &b, PyBUF_SIMPLE) < 0) return nullptr;
+    PyObject *frames = PyList_New(0);
+    const uint8_t *p = (const uint8_t *)b.buf;
+    for(Py_ssize_t i = 0; frames && i < b.len; i++){
+        uint8_t r = proto_rx_feed(&d->rx, p[i]);
+        if(r == PROTO_RX_ERROR){
+            d->errors++;
+        } else if(r == PROTO_RX_FRAME){
+            PyObject *f = Py_BuildValue("(iy#)", d->rx.opcode,
+                                        (const char *)d->rx.payload, (Py_ssize_t)d->rx.len);
+            if(!f || PyList_Append(frames, f) < 0) Py_CLEAR(frames);
+            Py_XDECREF(f);
+        }
+    }
+    PyBuffer_Release(&b);
+    return frames;
+}
+
+static PyObject *decoder_reset(PyObject *self, PyObject *){
+    proto_rx_reset(&((DecoderObject *)self)->rx);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef decoder_methods[] = {
+    { "feed",  decoder_feed,  METH_O,      "feed(data) -> [(op, payload), ...], bad frames count in .errors" },
+    { "reset", decoder_reset, METH_NOARGS, "drop a half received frame" },
+    { nullptr, nullptr, 0, nullptr },
+};
+
+static PyMemberDef decoder_members[] = {
+    { "errors", T_PYSSIZET, offsetof(DecoderObject, errors), 0, "frames with a bad length or CRC" },
+    { nullptr, 0, 0, 0, nullptr },
+};
+
+static PyType_Slot decoder_slots[] = {
+    { Py_tp_doc,     (void *)"Frame parser, same state machine as the firmware (proto.c)" },
+    { Py_tp_init,    (void *)decoder_init },
+    { Py_tp_methods, decoder_methods },
+    { Py_tp_members, decoder_members },
+    { 0, nullptr },
+};
+
+static PyType_Spec decoder_spec = {
+    "armext.Decoder", sizeof(DecoderObject), 0, Py_TPFLAGS_DEFAULT, decoder_slots,
+};
+
+// ---------------------------------------------------------------------------
+// Servo conversion, see drive() in i2c.py:
+//   us    = clamp(int(offset + value * scale), min_us, max_us)
+//   ticks = round(us / 20000 * 4096)
+
+struct ServoChannel {
+    double offset, scale;
+    long   min_us, max_us;
+};
+
+struct ServoMapObject {
+    PyObject_HEAD
+    ServoChannel *ch;
+    Py_ssize_t    n;
+};
+
+static int servomap_init(PyObject *self, PyObject *args, PyObject *){
+    ServoMapObject *m = (ServoMapObject *)self;
+    PyObject *spec;
+    if(!PyArg_ParseTuple(args, "O:ServoMap", &spec)) return -1;
+    PyObject *seq = PySequence_Fast(spec, "ServoMap takes a sequence of (offset, scale, min_us, max_us)");
+    if(!seq) return -1;
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    ServoChannel *ch = PyMem_New(ServoChannel, n ? n : 1);
+    for(Py_ssize_t i = 0; ch && i < n; i++){
+        if(!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, i), "ddll",
+                             &ch[i].offset, &ch[i].scale, &ch[i].min_us, &ch[i].max_us)){
+            PyMem_Free(ch);
+            ch = nullptr;
+        }
+    }
+    Py_DECREF(seq);
+    if(!ch){
+        if(!PyErr_Occurred()) PyErr_NoMemory();
+        return -1;
+    }
+    PyMem_Free(m->ch);
+    m->ch = ch;
+    m->n = n;
+    return 0;
+}
+
+static void servomap_dealloc(PyObject *self){
+    PyTypeObject *tp = Py_TYPE(self);
+    PyMem_Free(((ServoMapObject *)self)->ch);
+    tp->tp_free(self);
+    Py_DECREF(tp);
+}
+
+static PyObject *servomap_ticks(PyObject *self, PyObject *arg){
+    ServoMapObject *m = (ServoMapObject *)self;
+    PyObject *seq = PySequence_Fast(arg, "ticks() takes a sequence of values");
+    if(!seq) return nullptr;
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    if(n != m->n){
+        Py_DECREF(seq);
+        PyErr_Format(PyExc_ValueError, "%zd values for %zd channels", n, m->n);
+        return nullptr;
+    }
+    PyObject *out = PyList_New(m->n);
+    for(Py_ssize_t i = 0; out && i < m->n; i++){
+        double v = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, i));
+        if(v == -1.0 && PyErr_Occurred()){
+            Py_CLEAR(out);
+            break;
+        }
+        const ServoChannel &c = m->ch[i];
+        double raw = c.offset + v * c.scale;
+        if(!std::isfinite(raw)){
+            PyErr_Format(PyExc_ValueError, "channel %zd: value %R is not a finite pulse",
+                         i, PySequence_Fast_GET_ITEM(seq, i));
+            Py_CLEAR(out);
+            break;
+        }
+        //clamp before converting, a double beyond long is UB
+        if(raw < c.min_us) raw = c.min_us;
+        if(raw > c.max_us) raw = c.max_us;
+        long us = (long)raw;                            //truncates like int()
+        PyList_SET_ITEM(out, i, PyLong_FromLong(std::lround((double)us / 20000 * 4096)));
+    }
+    Py_DECREF(seq);
+    return out;
+}
+
+static PyMethodDef servomap_methods[] = {
+    { "ticks", servomap_ticks, METH_O, "ticks(values) -> PCA9685 OFF ticks, one per channel" },
+    { nullptr, nullptr, 0, nullptr },
+};
+
+static PyType_Slot servomap_slots[] = {
+    { Py_tp_doc,     (void *)"ServoMap([(offset, scale, min_us, max_us), ...])" },
+    { Py_tp_init,    (void *)servomap_init },
+    { Py_tp_dealloc, (void *)servomap_dealloc },
+    { Py_tp_methods, servomap_methods },
+    { 0, nullptr },
+};
+
+static PyType_Spec servomap_spec = {
+    "armext.ServoMap", sizeof(ServoMapObject), 0, Py_TPFLAGS_DEFAULT, servomap_slots,
+};
+
+// ---------------------------------------------------------------------------
+// Filters, filter.c with storage owned by the object. Integer results exactly
+// like the board: a median of an even count and the boxcar mean round
+// toward zero.
+
+template <typename T>
+struct FilterObject {
+    PyObject_HEAD
+    T        f;
+    int32_t *store;
+};
+
+//Every int32 sample is fine for these
+template <typename T>
+static bool any_sample(const T *, int32_t){
+    return true;
+}
+
+//filter.c keeps the average in acc << shift: |x| << shift must fit in 31 bits
+static bool ema_sample(const filter_ema_t *f, int32_t x){
+    int32_t lim = INT32_MAX >> f->shift;
+    if(x < -lim || x > lim){
+        PyErr_Format(PyExc_OverflowError, "sample %ld needs |x| <= %ld with shift %d",
+                     (long)x, (long)lim, f->shift);
+        return false;
+    }
+    return true;
+}
+
+template <typename T, int32_t (*Update)(T *, int32_t), int32_t (*Value)(const T *), void (*Reset)(T *),
+          bool (*Fits)(const T *, int32_t) = any_sample<T>>
+struct FilterMethods {
+    static bool sample(PyObject *self, PyObject *o, int32_t *x){
+        return to_i32(o, x) && Fits(&((FilterObject<T> *)self)->f, *x);
+    }
+
+    static PyObject *update(PyObject *self, PyObject *arg){
+        int32_t x;
+        if(!sample(self, arg, &x)) return nullptr;
+        return PyLong_FromLong(Update(&((FilterObject<T> *)self)->f, x));
+    }
+
+    //run(samples) -> filtered value after each sample
+    static PyObject *run(PyObject *self, PyObject *arg){
+        T *f = &((FilterObject<T> *)self)->f;
+        PyObject *seq = PySequence_Fast(arg, "run() takes a sequence of samples");
+        if(!seq) return nullptr;
+        Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+        PyObject *out = PyList_New(n);
+        for(Py_ssize_t i = 0; out && i < n; i++){
+            int32_t x;
+            if(!sample(self, PySequence_Fast_GET_ITEM(seq, i), &x)){
+                Py_CLEAR(out);
+                break;
+            }
+            PyList_SET_ITEM(out, i, PyLong_FromLong(Update(f, x)));
+        }
+        Py_DECREF(seq);
+        return out;
+    }
+
+    static PyObject *value(PyObject *self, PyObject *){
+        return PyLong_FromLong(Value(&((FilterObject<T> *)self)->f));
+    }
+
+    static PyObject *reset(PyObject *self, PyObject *){
+        Reset(&((FilterObject<T> *)self)->f);
+        Py_RETURN_NONE;
+    }
+
+    static void dealloc(PyObject *self){
+        PyTypeObject *tp = Py_TYPE(self);
+        PyMem_Free(((FilterObject<T> *)self)->store);
+        tp->tp_free(self);
+        Py_DECREF(tp);
+    }
+
+    static PyMethodDef table[];
+};
+
+template <typename T, int32_t (*Update)(T *, int32_t), int32_t (*Value)(const T *), void (*Reset)(T *),
+          bool (*Fits)(const T *, int32_t)>
+PyMethodDef FilterMethods<T, Update, Value, Reset, Fits>::table[] = {
+    { "update", update, METH_O,      "update(x) -> value after adding x" },
+    { "run",    run,    METH_O,      "run(samples) -> [value after each sample]" },
+    { "value",  value,  METH_NOARGS, "current value, 0 before the first sample" },
+    { "reset",  reset,  METH_NOARGS, "forget every sample" },
+    { nullptr, nullptr, 0, nullptr },
+};
+
+typedef FilterMethods<filter_median_t, filter_median_update, filter_median_value, filter_median_reset> MedianMethods;
+typedef FilterMethods<filter_boxcar_t, filter_boxcar_update, filter_boxcar_value, filter_boxcar_reset> BoxcarMethods;
+typedef FilterMethods<filter_ema_t,    filter_ema_update,    filter_ema_value,    filter_ema_reset,
+                      ema_sample>                                                                  EmaMethods;
+
+//Window length as in FILTER_x_INIT, at most 255 samples
+static int32_t *window_store(PyObject *args, const char *fmt, int *n, int per_sample){
+    if(!PyArg_ParseTuple(args, fmt, n)) return nullptr;
+    if(*n < 1 || *n > 255){
+        PyErr_Format(PyExc_ValueError, "window length %d not in 1..255", *n);
+        return nullptr;
+    }
+    int32_t *store = PyMem_New(int32_t, (size_t)*n * per_sample);
+    if(!store) PyErr_NoMemory();
+    return store;
+}
+
+static int median_init(PyObject *self, PyObject *args, PyObject *){
+    FilterObject<filter_median_t> *o = (FilterObject<filter_median_t> *)self;
+    int n;
+    int32_t *store = window_store(args, "i:Median", &n, 2);
+    if(!store) return -1;
+    PyMem_Free(o->store);
+    o->store = store;
+    o->f = filter_median_t{ store, store + n, (uint8_t)n, 0, 0 };
+    return 0;
+}
+
+static int boxcar_init(PyObject *self, PyObject *args, PyObject *){
+    FilterObject<filter_boxcar_t> *o = (FilterObject<filter_boxcar_t> *)self;
+    int n;
+    int32_t *store = window_store(args, "i:Boxcar", &n, 1);
+    if(!store) return -1;
+    PyMem_Free(o->store);
+    o->store = store;
+    o->f = filter_boxcar_t{ store, 0, (uint8_t)n, 0, 0 };
+    return 0;
+}
+
+//Leaves 16 bits for the sample, int16 and uint16 ADC values always fit
+#define EMA_SHIFT_MAX 15
+
+static int ema_init(PyObject *self, PyObject *args, PyObject *){
+    FilterObject<filter_ema_t> *o = (FilterObject<filter_ema_t> *)self;
+    int shift;
+    if(!PyArg_ParseTuple(args, "i:Ema", &shift)) return -1;
+    if(shift < 0 || shift > EMA_SHIFT_MAX){
+        PyErr_Format(PyExc_ValueError, "shift %d not in 0..%d", shift, EMA_SHIFT_MAX);
+        return -1;
+    }
+    o->f = filter_ema_t FILTER_EMA_INIT((uint8_t)shift);
+    return 0;
+}
+
+static PyType_Slot median_slots[] = {
+    { Py_tp_doc,     (void *)"Median(n): running median of the last n samples (filter.c)" },
+    { Py_tp_init,    (void *)median_init },
+    { Py_tp_dealloc, (void *)MedianMethods::dealloc },
+    { Py_tp_methods, MedianMethods::table },
+    { 0, nullptr },
+};
+
+static PyType_Slot boxcar_slots[] = {
+    { Py_tp_doc,     (void *)"Boxcar(n): mean of the last n samples (filter.c)" },
+    { Py_tp_init,    (void *)boxcar_init },
+    { Py_tp_dealloc, (void *)BoxcarMethods::dealloc },
+    { Py_tp_methods, BoxcarMethods::table },
+    { 0, nullptr },
+};
+
+static PyType_Slot ema_slots[] = {
+    { Py_tp_doc,     (void *)"Ema(shift): exponential moving average, alpha = 2^-shift (filter.c)" },
+    { Py_tp_init,    (void *)ema_init },
+    { Py_tp_dealloc, (void *)EmaMethods::dealloc },
+    { Py_tp_methods, EmaMethods::table },
+    { 0, nullptr },
+};
+
+static PyType_Spec median_spec = {
+    "armext.Median", sizeof(FilterObject<filter_median_t>), 0, Py_TPFLAGS_DEFAULT, median_slots,
+};
+static PyType_Spec boxcar_spec = {
+    "armext.Boxcar", sizeof(FilterObject<filter_boxcar_t>), 0, Py_TPFLAGS_DEFAULT, boxcar_slots,
+};
+static PyType_Spec ema_spec = {
+    "armext.Ema", sizeof(FilterObject<filter_ema_t>), 0, Py_TPFLAGS_DEFAULT, ema_slots,
+};
+
+// ---------------------------------------------------------------------------
+
+static PyMethodDef module_methods[] = {
+    { "crc8",        py_crc8,        METH_VARARGS, "crc8(data, crc=0) -> CRC-8 (poly 0x07) of data" },
+    { "encode",      py_encode,      METH_VARARGS, "encode(op, payload=b'') -> frame bytes" },
+    { "encode_into", py_encode_into, METH_VARARGS, "encode_into(buf, offset, op, payload=b'') -> frame size" },
+    { nullptr, nullptr, 0, nullptr },
+};
+
+static struct PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT, "armext",
+    "IO board framing, filters and servo conversion in C (firmware sources)",
+    -1, module_methods, nullptr, nullptr, nullptr, nullptr,
+};
+
+static int add_type(PyObject *m, PyType_Spec *spec){
+    PyObject *t = PyType_FromSpec(spec);
+    if(!t) return -1;
+    const char *name = strrchr(spec->name, '.') + 1;
+    if(PyModule_AddObject(m, name, t) < 0){
+        Py_DECREF(t);
+        return -1;
+    }
+    return 0;
+}
+
+PyMODINIT_FUNC PyInit_armext(void){
+    PyObject *m = PyModule_Create(&module_def);
+    if(!m) return nullptr;
+    if(add_type(m, &decoder_spec) < 0 || add_type(m, &servomap_spec) < 0 ||
+       add_type(m, &median_spec) < 0 || add_type(m, &boxcar_spec) < 0 ||
+       add_type(m, &ema_spec) < 0 ||
+       PyModule_AddIntConstant(m, "MAX_PAYLOAD", PROTO_MAX_PAYLOAD) < 0){
+        Py_DECREF(m);
+        return nullptr;
+    }
+    return m;
+}
@@ -0,0 +1,23 @@
+# Builds armext from armext.cpp and the IO board's own proto.c / filter.c
+#
+#   python3 setup.py build_ext --inplace      (needs python3-dev and g++)
+#
+# or "pip install ." to put it on every script's path. Without it the
+# Python modules fall back to their pure Python versions.
+
+import os
+from setuptools import setup, Extension
+
+FIRMWARE = os.path.join("..", "Inv", "Inv7", "Op8", "Op8")
+
+setup(
+    name="armext",
+    version="1.0",
+    ext_modules=[Extension(
+        "armext",
+        sources=["armext.cpp",
+                 os.path.join(FIRMWARE, "proto.c"),
+                 os.path.join(FIRMWARE, "filter.c")],
+        extra_compile_args=["-O2"],
+    )],
+)